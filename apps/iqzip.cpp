@@ -65,7 +65,11 @@
 #include <iqzip/ccsds_types.h>
 #include <iqzip/compressor.h>
 #include <iqzip/decompressor.h>
+#include <iqzip/iq_generator.h>
+#include <iqzip/tuner.h>
+#include <algorithm>
 #include <iostream>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -92,6 +96,230 @@ get_param(T *param, int *iarg, char *argv[])
     return 0;
 }
 
+/*
+ * The options that compress with the parameters of r
+ */
+static std::string
+tune_flags(const tune_result &r, uint8_t sample_resolution, uint8_t data_sense,
+           uint8_t endianness)
+{
+    std::string flags = "-e -n " + std::to_string(sample_resolution);
+    if (!data_sense) {
+        flags += " -s";
+    }
+    if (!endianness) {
+        flags += " -m";
+    }
+    flags += " -j " + std::to_string(r.block_size);
+    flags += " -r " + std::to_string(r.reference_sample_interval);
+    if (r.restricted_codes) {
+        flags += " -t";
+    }
+    if (r.predictor) {
+        flags += " -p " + std::to_string(r.predictor);
+    }
+    if (r.split_iq) {
+        flags += " -I";
+    }
+    return flags;
+}
+
+/*
+ * iqzip tune [OPTION]... SOURCE
+ */
+static int
+tune_main(int argc, char *argv[])
+{
+    uint8_t sample_resolution = 8;
+    uint8_t data_sense = 1;
+    uint8_t endianness = 1;
+    uint32_t threads = 0;
+    uint32_t sample_mb = 256;
+    uint32_t min_mbps = 0;
+    bool flags_only = false;
+    int iarg;
+
+    for (iarg = 2; iarg < argc - 1; iarg++) {
+        char *opt = argv[iarg];
+        if (opt[0] != '-') {
+            return 1;
+        }
+        switch (opt[1]) {
+        case 'f':
+            flags_only = true;
+            break;
+        case 'm':
+            endianness = 0;
+            break;
+        case 'M':
+            if (get_param(&min_mbps, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        case 'n':
+            if (get_param(&sample_resolution, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        case 's':
+            data_sense = 0;
+            break;
+        case 'S':
+            if (get_param(&sample_mb, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        case 'T':
+            if (get_param(&threads, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (iarg != argc - 1) {
+        return 1;
+    }
+
+    std::vector<tune_result> results;
+    if (tune(argv[iarg], (uint64_t) sample_mb << 20, sample_resolution,
+             data_sense, endianness, threads, results)) {
+        return 2;
+    }
+    std::vector<tune_result> front = pareto_front(results);
+
+    /* The smallest output that is fast enough */
+    const tune_result *best = nullptr;
+    for (const tune_result &r : front) {
+        if (r.mbps >= min_mbps) {
+            best = &r;
+        }
+    }
+    if (!best) {
+        best = &front.front();
+    }
+
+    if (flags_only) {
+        printf("%s\n", tune_flags(*best, sample_resolution, data_sense,
+                                   endianness).c_str());
+        return 0;
+    }
+    printf("%zu combinations on %.1f MB\n\n", results.size(),
+           front.front().in_bytes / 1e6);
+    printf("%8s %10s  %s\n", "ratio", "MB/s", "flags");
+    for (const tune_result &r : front) {
+        printf("%8.3f %10.1f  %s%s\n", r.ratio, r.mbps,
+               tune_flags(r, sample_resolution, data_sense,
+                          endianness).c_str(), &r == best ? "  *" : "");
+    }
+    return 0;
+}
+
+/*
+ * iqzip generate [OPTION]... DEST
+ */
+static int
+generate_main(int argc, char *argv[])
+{
+    static const char *signals[] = {
+        "noise", "tone", "qpsk", "fsk", "quiet", "clipped", "mixed"
+    };
+    iq_generator_config config = default_iq_generator_config(IQ_SIGNAL::MIXED);
+    uint32_t size_mb = 64;
+    config.sample_resolution = 8;
+    config.data_sense = 1;
+    int iarg;
+
+    for (iarg = 2; iarg < argc - 1; iarg++) {
+        char *opt = argv[iarg];
+        if (opt[0] != '-') {
+            return 1;
+        }
+        /* Options with a string or real argument */
+        const char *arg = opt[1] && opt[2] ? &opt[2] : argv[iarg + 1];
+        switch (opt[1]) {
+        case 'a':
+        case 'k':
+        case 'w':
+            if (!opt[2] && ++iarg == argc - 1) {
+                return 1;
+            }
+            break;
+        default:
+            break;
+        }
+        switch (opt[1]) {
+        case 'a':
+            config.amplitude = atof(arg);
+            break;
+        case 'k': {
+            size_t k = 0;
+            while (k < sizeof(signals) / sizeof(signals[0])
+                   && strcmp(arg, signals[k]) != 0) {
+                k++;
+            }
+            if (k == sizeof(signals) / sizeof(signals[0])) {
+                return 1;
+            }
+            config.signal = (IQ_SIGNAL) k;
+            break;
+        }
+        case 'm':
+            config.endianness = 0;
+            break;
+        case 'n':
+            if (get_param(&config.sample_resolution, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        case 's':
+            config.data_sense = 0;
+            break;
+        case 'S':
+            if (get_param(&size_mb, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        case 'w':
+            config.noise = atof(arg);
+            break;
+        case 'x':
+            if (get_param(&config.seed, &iarg, argv)) {
+                return 1;
+            }
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (iarg != argc - 1) {
+        return 1;
+    }
+
+    FILE *out = fopen(argv[iarg], "wb");
+    if (!out) {
+        std::cout << "Error opening output file: " << argv[iarg] << std::endl;
+        return 2;
+    }
+    iq_generator gen(config);
+    const uint64_t chunk_pairs = CHUNK / gen.pair_bytes();
+    uint64_t pairs = ((uint64_t) size_mb << 20) / gen.pair_bytes();
+    std::vector<char> buf(chunk_pairs * gen.pair_bytes());
+    while (pairs) {
+        uint64_t n = std::min(pairs, chunk_pairs);
+        gen.generate(n, buf.data());
+        if (fwrite(buf.data(), gen.pair_bytes(), n, out) != n) {
+            std::cout << "Error writing output file: " << argv[iarg]
+                      << std::endl;
+            fclose(out);
+            return 2;
+        }
+        pairs -= n;
+    }
+    return fclose(out) ? 2 : 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -110,6 +338,44 @@ main(int argc, char *argv[])
     uint8_t sample_resolution = 8;
     uint8_t reference_sample_interval = 1;
     uint16_t block_size = 64;
+    uint32_t threads = 0;
+    bool split_iq = false;
+    uint8_t predictor = 0;
+    bool adaptive = false;
+    uint8_t compression_tech_id =
+        (uint8_t)header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION;
+    bool leveled = false;
+    COMPRESSION_LEVEL level = COMPRESSION_LEVEL::DEFAULT;
+
+    /* Index an existing single stream file for parallel and random access */
+    if (argc == 3 && strcmp(argv[1], "index") == 0) {
+        iqzip::compression::decompressor_sptr sptr =
+            iqzip::compression::create_decompressor();
+        if (sptr->decompress_init(argv[2])) {
+            return 2;
+        }
+        int status = sptr->build_index();
+        sptr->decompress_fin();
+        return status ? 2 : 0;
+    }
+
+    /* Search the coding parameters that suit a file best */
+    if (argc >= 3 && strcmp(argv[1], "tune") == 0) {
+        int status = tune_main(argc, argv);
+        if (status == 1) {
+            goto FAIL;
+        }
+        return status;
+    }
+
+    /* Write a synthetic recording */
+    if (argc >= 3 && strcmp(argv[1], "generate") == 0) {
+        int status = generate_main(argc, argv);
+        if (status == 1) {
+            goto FAIL;
+        }
+        return status;
+    }
 
     while (iarg < argc - 2) {
         opt = argv[iarg];
@@ -117,12 +383,37 @@ main(int argc, char *argv[])
             goto FAIL;
         }
         switch (opt[1]) {
+        case '-':
+            if (strcmp(opt, "--fast") == 0) {
+                level = COMPRESSION_LEVEL::FAST;
+            }
+            else if (strcmp(opt, "--default") == 0) {
+                level = COMPRESSION_LEVEL::DEFAULT;
+            }
+            else if (strcmp(opt, "--max") == 0) {
+                level = COMPRESSION_LEVEL::MAX;
+            }
+            else {
+                goto FAIL;
+            }
+            leveled = true;
+            break;
+        case 'A':
+            adaptive = true;
+            break;
         case 'N':
             enable_preprocessing = 0;
             break;
         case 'd':
             dflag = 1;
             break;
+        case 'e':
+            compression_tech_id = (uint8_t)
+                                  header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION;
+            break;
+        case 'I':
+            split_iq = true;
+            break;
         case 'j':
             if (get_param(&block_size, &iarg, argv)) {
                 goto FAIL;
@@ -136,6 +427,11 @@ main(int argc, char *argv[])
                 goto FAIL;
             }
             break;
+        case 'p':
+            if (get_param(&predictor, &iarg, argv)) {
+                goto FAIL;
+            }
+            break;
         case 'r':
             if (get_param(&reference_sample_interval, &iarg, argv)) {
                 goto FAIL;
@@ -147,6 +443,11 @@ main(int argc, char *argv[])
         case 't':
             restricted_codes = 1;
             break;
+        case 'T':
+            if (get_param(&threads, &iarg, argv)) {
+                goto FAIL;
+            }
+            break;
         default:
             goto FAIL;
         }
@@ -162,13 +463,33 @@ main(int argc, char *argv[])
 
     if (dflag) {
         iqzip::compression::decompressor_sptr sptr =
-            iqzip::compression::create_decompressor();
+            iqzip::compression::create_decompressor(threads,
+                    compression_tech_id == (uint8_t)
+                    header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION);
         /* Initialize decompressor */
-        sptr->decompress_init(infn, outfn);
+        if (sptr->decompress_init(infn, outfn)) {
+            return 2;
+        }
         /* Decompress file */
-        sptr->decompress();
+        int status = sptr->decompress();
         /* Finalize decompression */
-        sptr->decompress_fin();
+        if (sptr->decompress_fin() || status) {
+            return 2;
+        }
+    }
+    else if (leveled) {
+        compressor_sptr sptr =
+            iqzip::compression::create_compressor(level, sample_resolution,
+                    data_sense, endianness, threads);
+        if (sptr->compress_init(infn, outfn)) {
+            sptr->compress_fin();
+            remove(outfn);
+            return 2;
+        }
+        int status = sptr->compress();
+        if (sptr->compress_fin() || status) {
+            return 2;
+        }
     }
     else {
         compressor_sptr sptr =
@@ -181,7 +502,7 @@ main(int argc, char *argv[])
                 (uint16_t)0xdffe,
                 (uint16_t)0x7efe,
                 (uint16_t)0xffff,
-                (uint8_t)header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION,
+                compression_tech_id,
                 (uint8_t)reference_sample_interval,
                 (uint8_t)enable_preprocessing,
                 (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC,
@@ -191,13 +512,23 @@ main(int argc, char *argv[])
                 (uint8_t)sample_resolution,
                 (uint8_t)1,
                 (uint8_t)restricted_codes,
-                (uint8_t)endianness);
-        /* Initialize compressor */
-        sptr->compress_init(infn, outfn);
+                (uint8_t)endianness,
+                threads,
+                split_iq,
+                predictor,
+                adaptive);
+        /* Initialize compressor, leaving no output behind on failure */
+        if (sptr->compress_init(infn, outfn)) {
+            sptr->compress_fin();
+            remove(outfn);
+            return 2;
+        }
         /* Compress file */
-        sptr->compress();
+        int status = sptr->compress();
         /* Finalize compression */
-        sptr->compress_fin();
+        if (sptr->compress_fin() || status) {
+            return 2;
+        }
     }
     return 0;
 
@@ -205,16 +536,56 @@ FAIL:
     fprintf(stderr, "NAME\n\taec - encode or decode files ");
     fprintf(stderr, "with Adaptive Entropy Coding\n\n");
     fprintf(stderr, "SYNOPSIS\n\taec [OPTION]... SOURCE DEST\n");
+    fprintf(stderr, "\taec index SOURCE\n");
+    fprintf(stderr, "\taec tune [-f] [-M MB/s] [-S megabytes] [-n bits] ");
+    fprintf(stderr, "[-s] [-m] [-T threads] SOURCE\n");
+    fprintf(stderr, "\taec generate [-k kind] [-S megabytes] [-n bits] ");
+    fprintf(stderr, "[-s] [-m] [-a amplitude]\n\t\t[-w noise] [-x seed] ");
+    fprintf(stderr, "DEST\n");
     fprintf(stderr, "\nOPTIONS\n");
+    fprintf(stderr, "\t-A\n\t\tpick the block size, reference sample ");
+    fprintf(stderr, "interval, predictor and\n\t\tplane split of every ");
+    fprintf(stderr, "segment from a trial on its first samples\n");
     fprintf(stderr, "\t-N\n\t\tdisable pre/post processing\n");
     fprintf(stderr, "\t-d\n\t\tdecode SOURCE. If -d is not used: encode.\n");
+    fprintf(stderr, "\t-e\n\t\tencode or decode with the native coder ");
+    fprintf(stderr, "instead of libaec, the\n\t\toutput is the same\n");
+    fprintf(stderr, "\t-I\n\t\tsamples are interleaved I/Q pairs, code the I ");
+    fprintf(stderr, "and Q planes\n\t\tseparately\n");
     fprintf(stderr, "\t-j samples\n\t\tblock size in samples\n");
     fprintf(stderr,
             "\t-F\n\t\tdo not enforce standard regarding legal block sizes\n");
     fprintf(stderr, "\t-m\n\t\tsamples are MSB first. Default is LSB\n");
     fprintf(stderr, "\t-n bits\n\t\tbits per sample\n");
+    fprintf(stderr, "\t-p predictor\n\t\tnative predictor of interleaved ");
+    fprintf(stderr, "I/Q samples: 1 second order\n\t\tpolynomial, 2 ");
+    fprintf(stderr, "per-channel delta, 3 IQ-aware delta, 4 complex\n");
+    fprintf(stderr, "\t\tNLMS over the last 4 pairs, up to 16 bits\n");
     fprintf(stderr, "\t-r blocks\n\t\treference sample interval in blocks\n");
     fprintf(stderr, "\t-s\n\t\tsamples are signed. Default is unsigned\n");
-    fprintf(stderr, "\t-t\n\t\tuse restricted set of code options\n\n");
+    fprintf(stderr, "\t-t\n\t\tuse restricted set of code options\n");
+    fprintf(stderr, "\t-T threads\n\t\tcompress or decompress independent ");
+    fprintf(stderr, "segments in parallel on this many threads\n");
+    fprintf(stderr, "\t--fast, --default, --max\n\t\tcompression level of ");
+    fprintf(stderr, "interleaved I/Q samples. A level\n\t\tpicks the coding ");
+    fprintf(stderr, "parameters, -e, -I, -j, -N, -p, -r and -t\n\t\tare ");
+    fprintf(stderr, "ignored. --max picks them for every segment\n");
+    fprintf(stderr, "\nCOMMANDS\n");
+    fprintf(stderr, "\tindex\n\t\twrite a sidecar index for a single stream ");
+    fprintf(stderr, "SOURCE, enabling\n\t\tparallel decoding and random ");
+    fprintf(stderr, "access on it\n");
+    fprintf(stderr, "\ttune\n\t\tcompress a sample of SOURCE, 256 MB or -S, ");
+    fprintf(stderr, "with a grid of\n\t\tblock sizes, reference sample ");
+    fprintf(stderr, "intervals, code options,\n\t\tpredictors and plane ");
+    fprintf(stderr, "splits on -T threads and print the ratio\n\t\tversus ");
+    fprintf(stderr, "speed Pareto front. The row marked * has the best\n\t\t");
+    fprintf(stderr, "ratio of at least -M MB/s, -f prints only its flags\n");
+    fprintf(stderr, "\tgenerate\n\t\twrite -S megabytes, 64 by default, ");
+    fprintf(stderr, "of synthetic I/Q pairs. -k is\n\t\tnoise, tone, qpsk, ");
+    fprintf(stderr, "fsk, quiet, clipped or mixed, the default,\n\t\tthat ");
+    fprintf(stderr, "cycles through the others every 262144 pairs. -a\n\t\t");
+    fprintf(stderr, "and -w are the signal amplitude and the noise level as ");
+    fprintf(stderr, "fractions\n\t\tof full scale. The output only depends ");
+    fprintf(stderr, "on the options\n\n");
     return 1;
 }
@@ -0,0 +1,706 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of compress(), decompress(), stream_compress() and
+ * stream_decompress() over a sweep of synthetic signals, block sizes,
+ * reference sample intervals, sample resolutions, native predictors and
+ * stream chunk sizes. Data stays in
+ * memory, so the numbers are those of the coder. The results are written
+ * as JSON, one result per line, and can be checked against a baseline
+ * written by an earlier run. Stream results also carry the 99.9th
+ * percentile latency of a stream call.
+ */
+
+#include <iqzip/ccsds_types.h>
+#include <iqzip/compressor.h>
+#include <iqzip/decompressor.h>
+#include <iqzip/iq_generator.h>
+#include <iqzip/iqzip_compression_header.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace iqzip::compression;
+
+/*
+ * A seekable source over a buffer in memory
+ */
+class memory_source : public source {
+
+public:
+    memory_source(const std::vector<char> &buf) :
+        d_buf(buf),
+        d_pos(0)
+    {
+    }
+
+    ssize_t read(char *buf, size_t nbytes)
+    {
+        nbytes = std::min(nbytes, d_buf.size() - d_pos);
+        memcpy(buf, &d_buf[d_pos], nbytes);
+        d_pos += nbytes;
+        return nbytes;
+    }
+
+    int seek(uint64_t offset)
+    {
+        if (offset > d_buf.size()) {
+            return -1;
+        }
+        d_pos = offset;
+        return 0;
+    }
+
+    int64_t size()
+    {
+        return d_buf.size();
+    }
+
+    size_t position() const
+    {
+        return d_pos;
+    }
+
+private:
+    const std::vector<char> &d_buf;
+    size_t d_pos;
+};
+
+/*
+ * A sink that appends to a buffer in memory
+ */
+class memory_sink : public sink {
+
+public:
+    memory_sink(std::vector<char> &buf) :
+        d_buf(buf)
+    {
+        d_buf.clear();
+    }
+
+    int write(const char *buf, size_t nbytes)
+    {
+        d_buf.insert(d_buf.end(), buf, buf + nbytes);
+        return 0;
+    }
+
+private:
+    std::vector<char> &d_buf;
+};
+
+typedef struct bench_result {
+    std::string op;
+    std::string signal;
+    /* The NATIVE_PREDICTOR of compress(), 0 for the one of libaec */
+    uint8_t predictor;
+    uint16_t block_size;
+    uint16_t rsi;
+    uint8_t sample_resolution;
+    /* Bytes per stream call, 0 for compress() and decompress() */
+    size_t chunk;
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    double ratio;
+    double mbps;
+    /* 99.9th percentile of the stream call latency of the fastest run in
+     * microseconds, 0 for compress() and decompress() */
+    double p999_us;
+    bool match;
+} bench_result;
+
+typedef struct bench_options {
+    std::vector<std::string> signals;
+    std::vector<uint8_t> predictors;
+    std::vector<uint16_t> block_sizes;
+    std::vector<uint16_t> intervals;
+    std::vector<uint8_t> resolutions;
+    std::vector<size_t> chunks;
+    uint64_t input_bytes;
+    uint32_t repeats;
+    uint32_t threads;
+    uint8_t tech_id;
+    double tolerance;
+    std::string source;
+    std::string output;
+    std::string baseline;
+} bench_options;
+
+static void
+usage()
+{
+    fprintf(stderr,
+            "NAME\n\tiqzip_bench - measure the speed and ratio of iqzip\n\n"
+            "SYNOPSIS\n\tiqzip_bench [OPTION]...\n\n"
+            "OPTIONS\n"
+            "\t-k list\n\t\tsynthetic signals, comma separated: noise, tone, "
+            "qpsk, fsk,\n\t\tquiet, clipped or mixed. Default tone,fsk\n"
+            "\t-p list\n\t\tnative predictors of compress(), 0 for the one "
+            "of libaec.\n\t\tThe stream calls always use the one of libaec. "
+            "Default 0,4\n"
+            "\t-j list\n\t\tblock sizes, comma separated. Default 8,16,32,64\n"
+            "\t-r list\n\t\treference sample intervals, up to 255. Default "
+            "16,64,128\n"
+            "\t-n list\n\t\tsample resolutions in bits. Default 8,12,16\n"
+            "\t-c list\n\t\tbytes per stream call. Default 4096,65536,1048576\n"
+            "\t-S megabytes\n\t\tsize of the input. Default 4\n"
+            "\t-R repeats\n\t\truns per measurement, the fastest is kept. "
+            "Default 3\n"
+            "\t-T threads\n\t\tthreads of compress() and decompress(). "
+            "Default 0, a single stream\n"
+            "\t-e\n\t\tcode with the native coder instead of libaec\n"
+            "\t-f file\n\t\tbenchmark the MSB first unsigned samples of file "
+            "instead of the\n\t\tsynthetic signals\n"
+            "\t-o file\n\t\twrite the JSON report to file instead of stdout\n"
+            "\t-b file\n\t\tcompare with the JSON report of an earlier run\n"
+            "\t-t percent\n\t\tthroughput drop tolerated by -b. Default 10\n\n"
+            "EXIT STATUS\n\t0 on success, 1 on error, 2 if -b found a "
+            "regression\n");
+}
+
+template <typename T>
+static int
+parse_list(const char *arg, std::vector<T> &list)
+{
+    list.clear();
+    const char *p = arg;
+    while (*p) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 10);
+        if (end == p || (*end && *end != ',')) {
+            return -1;
+        }
+        list.push_back((T) v);
+        p = *end ? end + 1 : end;
+    }
+    return list.empty() ? -1 : 0;
+}
+
+/* The names of the IQ_SIGNAL kinds, in order */
+static const char *signal_names[] = {
+    "noise", "tone", "qpsk", "fsk", "quiet", "clipped", "mixed"
+};
+
+static int
+parse_signals(const char *arg, std::vector<std::string> &list)
+{
+    list.clear();
+    std::string names(arg);
+    size_t start = 0;
+    while (start <= names.size()) {
+        size_t end = std::min(names.find(',', start), names.size());
+        std::string name = names.substr(start, end - start);
+        if (std::find(std::begin(signal_names), std::end(signal_names),
+                      name) == std::end(signal_names)) {
+            return -1;
+        }
+        list.push_back(name);
+        start = end + 1;
+    }
+    return 0;
+}
+
+/*
+ * A signal in Gaussian noise from iq_generator, as unsigned, offset
+ * binary, MSB first I/Q samples of the resolution. The seed is fixed, so
+ * every run on any build codes the same data.
+ */
+static void
+synthesize(const std::string &signal, uint8_t sample_resolution,
+           uint64_t nbytes, std::vector<char> &out)
+{
+    size_t kind = std::find(std::begin(signal_names), std::end(signal_names),
+                            signal) - std::begin(signal_names);
+    iq_generator_config config = default_iq_generator_config((IQ_SIGNAL) kind);
+    config.sample_resolution = sample_resolution;
+    config.data_sense = 1;
+    config.endianness = 0;
+    config.frequency = 0.05;
+    config.noise = 0.02;
+    iq_generator gen(config);
+    const uint64_t pairs = nbytes / gen.pair_bytes();
+
+    out.resize(pairs * gen.pair_bytes());
+    gen.generate(pairs, out.data());
+}
+
+static compressor_sptr
+make_compressor(const bench_options &o, uint16_t block_size, uint16_t rsi,
+                uint8_t sample_resolution, uint8_t predictor, uint32_t threads)
+{
+    return create_compressor(
+               (uint8_t)header::PACKET_VERSION::CCSDS_PACKET_VERSION_1,
+               (uint8_t)header::PACKET_TYPE::CCSDS_TELECOMMAND,
+               (uint8_t)header::PACKET_SECONDARY_HEADER_FLAG::SEC_HDR_PRESENT,
+               (uint16_t)header::PACKET_APPLICATION_PROCESS_IDENTIFIER::IDLE_PACKET,
+               (uint8_t)header::PACKET_SEQUENCE_FLAGS::CONTINUATION_SEGMENT,
+               (uint16_t)0xdffe, (uint16_t)0x7efe, (uint16_t)0xffff,
+               o.tech_id, (uint8_t) rsi, (uint8_t)1,
+               (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::UNIT_DELAY,
+               (uint8_t)header::PREPROCESSOR_MAPPER_TYPE::PREDICTION_ERROR,
+               block_size, (uint8_t)1, sample_resolution, (uint16_t)1,
+               (uint8_t)0, (uint8_t)0, threads, false, predictor);
+}
+
+static double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return std::max(elapsed.count(), 1e-9);
+}
+
+/*
+ * The 99.9th percentile of the stream calls recorded in a histogram, in
+ * microseconds
+ */
+static double
+p999_us(const latency_histogram &calls)
+{
+    return calls.percentile(99.9) / 1e3;
+}
+
+/*
+ * Compresses samples with compress(), or with stream_compress() in chunks if
+ * chunk is not 0, and returns the time it took. The tail latency of the
+ * stream calls goes to p999.
+ */
+static double
+time_compress(const bench_options &o, const bench_result &r,
+              const std::vector<char> &samples, std::vector<char> &compressed,
+              double *p999)
+{
+    compressor_sptr comp = make_compressor(o, r.block_size, r.rsi,
+                                           r.sample_resolution, r.predictor,
+                                           r.chunk ? 0 : o.threads);
+    std::shared_ptr<memory_sink> out(new memory_sink(compressed));
+    int status;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    if (!r.chunk) {
+        std::shared_ptr<memory_source> in(new memory_source(samples));
+        status = comp->compress_init(in, out);
+        if (status == 0) {
+            status = comp->compress();
+        }
+        if (status == 0) {
+            status = comp->compress_fin();
+        }
+    }
+    else {
+        status = comp->stream_compress_init(out);
+        for (size_t off = 0; status == 0 && off < samples.size();
+             off += r.chunk) {
+            size_t len = std::min(r.chunk, samples.size() - off);
+            status = comp->stream_compress(&samples[off], len);
+        }
+        if (status == 0) {
+            status = comp->stream_compress_fin();
+        }
+    }
+    double t = seconds_since(start);
+    *p999 = r.chunk ? p999_us(comp->get_latency(STREAM_STAGE::CALL)) : 0;
+    return status ? -1 : t;
+}
+
+/*
+ * Decompresses compressed with decompress(), or with stream_decompress() in
+ * chunks if chunk is not 0, and returns the time it took. The tail latency
+ * of the stream calls goes to p999.
+ */
+static double
+time_decompress(const bench_options &o, const bench_result &r,
+                const std::vector<char> &compressed, std::vector<char> &samples,
+                double *p999)
+{
+    decompressor_sptr decomp = create_decompressor(
+                                   r.chunk ? 0 : o.threads);
+    std::shared_ptr<memory_source> in(new memory_source(compressed));
+    std::shared_ptr<memory_sink> out(new memory_sink(samples));
+    int status;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    status = decomp->decompress_init(in, out);
+    if (!r.chunk) {
+        if (status == 0) {
+            status = decomp->decompress();
+        }
+        if (status == 0) {
+            status = decomp->decompress_fin();
+        }
+    }
+    else {
+        /* The header has been read, the bitstream follows */
+        for (size_t off = in->position();
+             status == 0 && off < compressed.size(); off += r.chunk) {
+            size_t len = std::min(r.chunk, compressed.size() - off);
+            status = decomp->stream_decompress(&compressed[off], len);
+        }
+        if (status == 0) {
+            status = decomp->stream_decompress_fin();
+        }
+    }
+    double t = seconds_since(start);
+    *p999 = r.chunk ? p999_us(decomp->get_latency(STREAM_STAGE::CALL)) : 0;
+    return status ? -1 : t;
+}
+
+/*
+ * Runs the compression of r and then its decompression, o.repeats times
+ * each, and fills in both results.
+ */
+static int
+run(const bench_options &o, const std::vector<char> &samples,
+    bench_result &comp, bench_result &decomp)
+{
+    std::vector<char> compressed;
+    std::vector<char> restored;
+    double best_comp = 0;
+    double best_decomp = 0;
+
+    for (uint32_t i = 0; i < o.repeats; i++) {
+        double p999;
+        double t = time_compress(o, comp, samples, compressed, &p999);
+        if (t < 0) {
+            return -1;
+        }
+        if (!i || t < best_comp) {
+            best_comp = t;
+            comp.p999_us = p999;
+        }
+    }
+    for (uint32_t i = 0; i < o.repeats; i++) {
+        double p999;
+        double t = time_decompress(o, decomp, compressed, restored, &p999);
+        if (t < 0) {
+            return -1;
+        }
+        if (!i || t < best_decomp) {
+            best_decomp = t;
+            decomp.p999_us = p999;
+        }
+    }
+
+    comp.in_bytes = decomp.in_bytes = samples.size();
+    comp.out_bytes = decomp.out_bytes = compressed.size();
+    comp.ratio = decomp.ratio = (double) samples.size() / compressed.size();
+    comp.mbps = samples.size() / 1e6 / best_comp;
+    decomp.mbps = samples.size() / 1e6 / best_decomp;
+    comp.match = decomp.match = restored == samples;
+    return 0;
+}
+
+static std::string
+result_json(const bench_result &r)
+{
+    char line[512];
+    snprintf(line, sizeof(line),
+             "{\"op\": \"%s\", \"signal\": \"%s\", \"predictor\": %u, "
+             "\"block_size\": %u, \"rsi\": %u, "
+             "\"sample_resolution\": %u, \"chunk\": %zu, \"in_bytes\": %llu, "
+             "\"out_bytes\": %llu, \"ratio\": %.4f, \"mbps\": %.2f, "
+             "\"p999_us\": %.1f, \"match\": %s}",
+             r.op.c_str(), r.signal.c_str(), r.predictor, r.block_size, r.rsi,
+             r.sample_resolution, r.chunk,
+             (unsigned long long) r.in_bytes, (unsigned long long) r.out_bytes,
+             r.ratio, r.mbps, r.p999_us, r.match ? "true" : "false");
+    return line;
+}
+
+/*
+ * Reads the results of a report written by main, one per line. Reports of
+ * another coder or thread count are refused.
+ */
+static int
+load_baseline(const bench_options &o, std::vector<bench_result> &results)
+{
+    std::ifstream f(o.baseline);
+    if (!f.is_open()) {
+        return -1;
+    }
+    std::string line;
+    while (std::getline(f, line)) {
+        unsigned setting;
+        if ((sscanf(line.c_str(), "\"tech_id\": %u", &setting) == 1
+             && setting != o.tech_id)
+            || (sscanf(line.c_str(), "\"threads\": %u", &setting) == 1
+                && setting != o.threads)) {
+            fprintf(stderr, "The baseline was run with another -e or -T\n");
+            return -1;
+        }
+        const char *p = strstr(line.c_str(), "{\"op\"");
+        if (!p) {
+            continue;
+        }
+        char op[32];
+        char signal[32];
+        unsigned predictor, block_size, rsi, sample_resolution;
+        unsigned long long in_bytes, out_bytes;
+        bench_result r;
+        if (sscanf(p, "{\"op\": \"%31[^\"]\", \"signal\": \"%31[^\"]\", "
+                   "\"predictor\": %u, \"block_size\": %u, \"rsi\": %u, "
+                   "\"sample_resolution\": %u, \"chunk\": %zu, "
+                   "\"in_bytes\": %llu, \"out_bytes\": %llu, \"ratio\": %lf, "
+                   "\"mbps\": %lf", op, signal, &predictor, &block_size, &rsi,
+                   &sample_resolution, &r.chunk, &in_bytes, &out_bytes,
+                   &r.ratio, &r.mbps) != 11) {
+            return -1;
+        }
+        r.op = op;
+        r.signal = signal;
+        r.predictor = predictor;
+        r.block_size = block_size;
+        r.rsi = rsi;
+        r.sample_resolution = sample_resolution;
+        r.in_bytes = in_bytes;
+        r.out_bytes = out_bytes;
+        results.push_back(r);
+    }
+    return 0;
+}
+
+/*
+ * Reports the results that are slower than the baseline by more than the
+ * tolerance, or that compress the same input worse.
+ * @return the number of regressions
+ */
+static size_t
+compare(const bench_options &o, const std::vector<bench_result> &results,
+        const std::vector<bench_result> &baseline)
+{
+    size_t regressions = 0;
+    for (const bench_result &r : results) {
+        for (const bench_result &b : baseline) {
+            if (r.op != b.op || r.signal != b.signal
+                || r.predictor != b.predictor
+                || r.block_size != b.block_size || r.rsi != b.rsi
+                || r.sample_resolution != b.sample_resolution
+                || r.chunk != b.chunk) {
+                continue;
+            }
+            if (r.mbps < b.mbps * (1 - o.tolerance / 100)) {
+                fprintf(stderr, "slower: %s was %.2f MB/s\n",
+                        result_json(r).c_str(), b.mbps);
+                regressions++;
+            }
+            if (r.in_bytes == b.in_bytes && r.out_bytes > b.out_bytes) {
+                fprintf(stderr, "larger: %s was %llu bytes\n",
+                        result_json(r).c_str(),
+                        (unsigned long long) b.out_bytes);
+                regressions++;
+            }
+        }
+    }
+    return regressions;
+}
+
+int
+main(int argc, char *argv[])
+{
+    bench_options o;
+    uint32_t input_mb = 4;
+    int opt;
+
+    parse_signals("tone,fsk", o.signals);
+    parse_list("0,4", o.predictors);
+    parse_list("8,16,32,64", o.block_sizes);
+    parse_list("16,64,128", o.intervals);
+    parse_list("8,12,16", o.resolutions);
+    parse_list("4096,65536,1048576", o.chunks);
+    o.repeats = 3;
+    o.threads = 0;
+    o.tech_id = (uint8_t)
+                header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION;
+    o.tolerance = 10;
+
+    while ((opt = getopt(argc, argv, "k:p:j:r:n:c:S:R:T:ef:o:b:t:h")) != -1) {
+        int bad = 0;
+        switch (opt) {
+        case 'k':
+            bad = parse_signals(optarg, o.signals);
+            break;
+        case 'p':
+            bad = parse_list(optarg, o.predictors);
+            for (uint8_t predictor : o.predictors) {
+                bad |= predictor > (uint8_t)
+                       header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS;
+            }
+            break;
+        case 'j':
+            bad = parse_list(optarg, o.block_sizes);
+            break;
+        case 'r':
+            bad = parse_list(optarg, o.intervals);
+            for (uint16_t rsi : o.intervals) {
+                bad |= !rsi || rsi > 255;
+            }
+            break;
+        case 'n':
+            bad = parse_list(optarg, o.resolutions);
+            break;
+        case 'c':
+            bad = parse_list(optarg, o.chunks);
+            break;
+        case 'S':
+            input_mb = atoi(optarg);
+            bad = !input_mb;
+            break;
+        case 'R':
+            o.repeats = atoi(optarg);
+            bad = !o.repeats;
+            break;
+        case 'T':
+            o.threads = atoi(optarg);
+            break;
+        case 'e':
+            o.tech_id = (uint8_t)
+                        header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION;
+            break;
+        case 'f':
+            o.source = optarg;
+            break;
+        case 'o':
+            o.output = optarg;
+            break;
+        case 'b':
+            o.baseline = optarg;
+            break;
+        case 't':
+            o.tolerance = atof(optarg);
+            break;
+        default:
+            bad = 1;
+            break;
+        }
+        if (bad) {
+            usage();
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage();
+        return 1;
+    }
+    o.input_bytes = (uint64_t) input_mb << 20;
+
+    std::vector<char> file;
+    if (!o.source.empty()) {
+        std::ifstream f(o.source, std::ios::binary);
+        if (!f.is_open()) {
+            fprintf(stderr, "Error opening %s\n", o.source.c_str());
+            return 1;
+        }
+        file.assign(std::istreambuf_iterator<char>(f),
+                    std::istreambuf_iterator<char>());
+        file.resize(std::min<uint64_t>(file.size(), o.input_bytes) & ~3ull);
+        o.signals.assign(1, "file");
+    }
+
+    std::vector<bench_result> results;
+    std::vector<char> samples;
+    for (const std::string &signal : o.signals) {
+        for (uint8_t sample_resolution : o.resolutions) {
+            if (!sample_resolution || sample_resolution > 16) {
+                fprintf(stderr, "Sample resolutions go from 1 to 16 bits\n");
+                return 1;
+            }
+            if (file.empty()) {
+                synthesize(signal, sample_resolution, o.input_bytes, samples);
+            }
+            else {
+                samples = file;
+            }
+            for (uint16_t block_size : o.block_sizes) {
+                for (uint16_t rsi : o.intervals) {
+                    for (uint8_t predictor : o.predictors) {
+                        bench_result comp;
+                        comp.signal = signal;
+                        comp.predictor = predictor;
+                        comp.block_size = block_size;
+                        comp.rsi = rsi;
+                        comp.sample_resolution = sample_resolution;
+
+                        /* compress() and decompress() first, then every chunk
+                         * size. Only compress() has native predictors */
+                        for (size_t i = 0; i <= o.chunks.size(); i++) {
+                            if (i && predictor) {
+                                break;
+                            }
+                            comp.chunk = i ? o.chunks[i - 1] : 0;
+                            comp.op = i ? "stream_compress" : "compress";
+                            bench_result decomp = comp;
+                            decomp.op = i ? "stream_decompress" : "decompress";
+                            if (run(o, samples, comp, decomp)) {
+                                fprintf(stderr, "Error running %s\n",
+                                        result_json(comp).c_str());
+                                return 1;
+                            }
+                            results.push_back(comp);
+                            results.push_back(decomp);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    FILE *out = stdout;
+    if (!o.output.empty() && !(out = fopen(o.output.c_str(), "w"))) {
+        fprintf(stderr, "Error opening %s\n", o.output.c_str());
+        return 1;
+    }
+    fprintf(out, "{\n\"tech_id\": %u,\n\"threads\": %u,\n\"repeats\": %u,\n"
+            "\"input\": \"%s\",\n\"results\": [\n", o.tech_id, o.threads,
+            o.repeats, o.source.empty() ? "synthetic" : o.source.c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        fprintf(out, "%s%s\n", result_json(results[i]).c_str(),
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    int status = 0;
+    for (const bench_result &r : results) {
+        if (!r.match) {
+            fprintf(stderr, "mismatch: %s\n", result_json(r).c_str());
+            status = 1;
+        }
+    }
+    if (!o.baseline.empty()) {
+        std::vector<bench_result> baseline;
+        if (load_baseline(o, baseline)) {
+            fprintf(stderr, "Error reading baseline %s\n", o.baseline.c_str());
+            return 1;
+        }
+        if (compare(o, results, baseline)) {
+            return 2;
+        }
+    }
+    return status;
+}
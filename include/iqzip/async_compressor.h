@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Asynchronous stream compressor
+ *
+ * async_compressor decouples the thread that produces the samples from the
+ * encoder. Samples are pushed into a lock-free single producer, single
+ * consumer ring and a dedicated encoder thread drains it through the
+ * stream_compress of a compressor. The producer never runs the encoder, so
+ * neither encoder nor disk jitter can stall it.
+ */
+
+#ifndef ASYNC_COMPRESSOR_H
+#define ASYNC_COMPRESSOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <iqzip/compressor.h>
+#include <iqzip/stream_io.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class async_compressor;
+typedef std::shared_ptr<async_compressor> async_compressor_sptr;
+
+class async_compressor {
+
+public:
+
+    virtual ~async_compressor() {};
+
+    /*!
+     * Initializes stream compression to fout and starts the encoder thread.
+     * @param fout Name of output file.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int start(const std::string fout) = 0;
+
+    /*!
+     * Initializes stream compression to out and starts the encoder thread.
+     * @param out the sink to write the compressed data to. It is called
+     * from the encoder thread.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int start(sink_sptr out) = 0;
+
+    /*!
+     * Queues nbytes of inbuf for compression. It only copies the bytes into
+     * the ring, so it is safe to call from real-time threads. Buffers that do
+     * not fit in the ring are dropped whole and counted in dropped_bytes(),
+     * which keeps the rest of the stream aligned to samples.
+     * @param inbuf buffer to read samples from.
+     * @param nbytes number of bytes to read from buffer. Must be a multiple
+     * of sample size.
+     * @return 0 on success, != 0 if the buffer was dropped.
+     */
+    virtual int push(const char *inbuf, size_t nbytes) = 0;
+
+    /*!
+     * Waits for the encoder thread to compress everything queued, stops it
+     * and finalizes the compression.
+     * @return 0 on success, != 0 if any compression or write failed.
+     */
+    virtual int stop() = 0;
+
+    /*!
+     * @return the size of the ring in bytes.
+     */
+    virtual size_t capacity() const = 0;
+
+    /*!
+     * The highest fill level of the ring since start, seen right after a
+     * push. Use it to size the ring.
+     * @return the high water mark in bytes.
+     */
+    virtual size_t high_water_mark() const = 0;
+
+    /*!
+     * @return the number of pushed bytes dropped because the ring was full.
+     */
+    virtual uint64_t dropped_bytes() const = 0;
+};
+
+/*!
+ * Instantiates an async_compressor.
+ * @param comp the compressor that encodes the samples. It must not be used
+ * by anything else between start and stop.
+ * @param ring_size the size of the ring in bytes.
+ * @return a std::shared_ptr<async_compressor>
+ */
+async_compressor_sptr create_async_compressor(compressor_sptr comp,
+        size_t ring_size);
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* ASYNC_COMPRESSOR_H */
@@ -58,9 +58,12 @@ enum class PACKET_SEQUENCE_FLAGS {
 /*!
  * The default values for the Compression Technique Identification subfield
  *  as defined by the CCSDS Loosless Data Compression Blue Book.
+ *  NATIVE_LOSSLESS_COMPRESSION is specific to iqzip: the data is coded by the
+ *  in tree encoder instead of libaec, into the same bitstream.
  */
 enum class COMPRESSION_TECHNIQUE_IDENTIFICATION {
-    NO_COMPRESSION = 0x0, CCSDS_LOSSLESS_COMPRESSION = 0x1
+    NO_COMPRESSION = 0x0, CCSDS_LOSSLESS_COMPRESSION = 0x1,
+    NATIVE_LOSSLESS_COMPRESSION = 0x2
 };
 
 /*!
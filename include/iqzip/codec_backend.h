@@ -0,0 +1,150 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Codec backends
+ *
+ * A codec backend is the entropy coder behind a compression technique
+ * identifier of the CCSDS header. The compressor and the decompressor look
+ * the backend up by the identifier they write or read, so a coder is added
+ * by registering a factory for a new identifier.
+ *
+ * Backends follow the calling convention of libaec: the aec_stream carries
+ * the coding parameters and the buffers, encode and decode consume input
+ * and produce output as the buffers allow, and a call with AEC_FLUSH
+ * flushes the encoder at the end of a stream. Two backends are built in,
+ * CCSDS_LOSSLESS_COMPRESSION with libaec and NATIVE_LOSSLESS_COMPRESSION
+ * with the in tree coder.
+ */
+
+#ifndef CODEC_BACKEND_H
+#define CODEC_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <libaec.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class codec_backend;
+typedef std::shared_ptr<codec_backend> codec_backend_sptr;
+
+/*!
+ * Creates a backend with no stream attached
+ */
+typedef std::function<codec_backend_sptr()> codec_backend_factory;
+
+class codec_backend {
+
+public:
+    virtual ~codec_backend() {};
+
+    /*!
+     * Starts encoding strm.
+     * @param strm the stream to encode, as for aec_encode_init.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    virtual int encode_init(aec_stream *strm) = 0;
+
+    /*!
+     * Encodes the input of strm, with the contract of aec_encode.
+     * @param strm the stream to encode.
+     * @param flush AEC_FLUSH at the end of the stream, AEC_NO_FLUSH
+     * otherwise.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    virtual int encode(aec_stream *strm, int flush) = 0;
+
+    /*!
+     * Releases the encoder state, with the contract of aec_encode_end.
+     */
+    virtual int encode_end(aec_stream *strm) = 0;
+
+    /*!
+     * Starts decoding strm.
+     * @param strm the stream to decode, as for aec_decode_init.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    virtual int decode_init(aec_stream *strm) = 0;
+
+    /*!
+     * Decodes the input of strm, with the contract of aec_decode.
+     */
+    virtual int decode(aec_stream *strm, int flush) = 0;
+
+    /*!
+     * Releases the decoder state, with the contract of aec_decode_end.
+     */
+    virtual int decode_end(aec_stream *strm) = 0;
+
+    /*!
+     * Encodes a whole segment into an independent bitstream.
+     * @param strm the coding parameters. Its buffers are set here.
+     * @param in the samples of the segment.
+     * @param nbytes number of bytes of in.
+     * @param out the vector that holds the bitstream on return, grown as
+     * needed.
+     * @param offset the bytes of out to keep before the bitstream.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    virtual int encode_segment(aec_stream *strm, const char *in,
+                               size_t nbytes, std::vector<char> &out,
+                               size_t offset);
+
+    /*!
+     * Decodes the bitstream of a whole segment.
+     * @param strm the coding parameters. Its buffers are set here.
+     * @param in the bitstream of the segment.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the samples to.
+     * @param out_bytes the uncompressed size of the segment in bytes.
+     * @return AEC_OK on success, AEC_DATA_ERROR if the bitstream does not
+     * hold exactly out_bytes of samples, another AEC error code otherwise.
+     */
+    virtual int decode_segment(aec_stream *strm, const char *in,
+                               size_t nbytes, char *out, size_t out_bytes);
+};
+
+/*!
+ * Registers the backend of a compression technique identifier, replacing
+ * the one registered before, built in backends included. Files are always
+ * written and read with the backend registered at the time.
+ * @param tech_id the compression technique identifier.
+ * @param factory creates the backend, once per stream or segment.
+ * @return 0 on success, != 0 if factory is empty.
+ */
+int register_codec_backend(uint8_t tech_id, codec_backend_factory factory);
+
+/*!
+ * Creates the backend of a compression technique identifier.
+ * @param tech_id the compression technique identifier.
+ * @return the backend, nullptr if none is registered for tech_id.
+ */
+codec_backend_sptr create_codec_backend(uint8_t tech_id);
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* CODEC_BACKEND_H */
@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Runtime statistics of a compressor or a decompressor
+ *
+ * codec_stats is a snapshot of the counters a compressor or a decompressor
+ * keeps while it runs. The counters are updated with relaxed atomics, so
+ * get_stats() may be polled from another thread while the stream is being
+ * coded, at the cost of a few counters being one call apart.
+ */
+
+#ifndef CODEC_STATS_H
+#define CODEC_STATS_H
+
+#include <cstdint>
+
+namespace iqzip {
+
+namespace compression {
+
+struct codec_stats {
+    /*! Bytes the codec consumed, samples when compressing and compressed
+     * data when decompressing */
+    uint64_t bytes_in;
+    /*! Bytes the codec produced */
+    uint64_t bytes_out;
+    /*! Uncompressed over compressed bytes since the stream was initialized,
+     * 0 before any output */
+    double ratio;
+    /*! The same ratio over the bytes coded since the previous get_stats()
+     * call, 0 if nothing was coded in between */
+    double current_ratio;
+    /*! Nanoseconds spent in the encoder or the decoder, summed over the
+     * threads of segmented files */
+    uint64_t codec_ns;
+    /*! Nanoseconds spent reading the source and writing the sink */
+    uint64_t io_ns;
+    /*! Calls of the encoder or the decoder */
+    uint64_t codec_calls;
+    /*! Reads of the source and writes of the sink */
+    uint64_t io_calls;
+    /*! Calls of stream_compress or stream_decompress */
+    uint64_t stream_calls;
+    /*! Most bytes ever held back by stream_compress or stream_decompress
+     * for the next call */
+    uint64_t staged_high_water;
+    /*! Most bytes produced by a single call of the encoder or the decoder */
+    uint64_t output_high_water;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* CODEC_STATS_H */
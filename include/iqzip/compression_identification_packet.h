@@ -423,7 +423,8 @@ public:
 
     /*!
      * Get the decoded value of preprocessor sample resolution subfield.
-     * \return a uint8_t representing the preprocessor sample resolution.
+     * \return a uint8_t representing the preprocessor sample resolution,
+     * from 1 to 32 bits.
      */
     uint8_t
     decode_preprocessor_sample_resolution() const;
@@ -27,7 +27,14 @@
 #ifndef COMPRESSOR_H
 #define COMPRESSOR_H
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <sys/types.h>
+
+#include <iqzip/codec_stats.h>
+#include <iqzip/latency_histogram.h>
+#include <iqzip/stream_io.h>
 
 namespace iqzip {
 
@@ -36,6 +43,15 @@ namespace compression {
 class compressor;
 typedef std::shared_ptr<compressor> compressor_sptr;
 
+/*!
+ * Speed and compression ratio presets of create_compressor. Every level
+ * writes the parameters it chose in the header, so any decompressor reads
+ * the output of any level.
+ */
+enum class COMPRESSION_LEVEL {
+    FAST = 0x0, DEFAULT = 0x1, MAX = 0x2
+};
+
 class compressor {
 
 public:
@@ -52,6 +68,16 @@ public:
      */
     virtual int compress_init(const std::string fin, const std::string fout) = 0;
 
+    /*!
+     * Initializes necessary variables for compression from in to out. The
+     * CCSDS header is written to out. compress_init(fin, fout) is this call
+     * with a file_source and a file_sink.
+     * @param in the source to read samples from.
+     * @param out the sink to write the compressed data to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int compress_init(source_sptr in, sink_sptr out) = 0;
+
     /*!
      * Initializes necessary variables for stream compression. Should always be called
      * before stream compressing. It opens the fout file and the CCSDS header is written.
@@ -60,9 +86,55 @@ public:
      */
     virtual int stream_compress_init(const std::string fout) = 0;
 
+    /*!
+     * Initializes necessary variables for stream compression to out. The
+     * CCSDS header is written to out and stream_compress hands every
+     * compressed chunk to it straight from the encoder output buffer.
+     * @param out the sink to write the compressed data to.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    virtual int stream_compress_init(sink_sptr out) = 0;
+
+    /*!
+     * Initializes stream compression in real-time mode, for callers of
+     * stream_compress that must never stall. Every buffer is allocated here
+     * and locked in memory, which memory_locked() confirms, and the output
+     * is written to fout by a separate writer thread fed through a lock-free
+     * ring. stream_compress then makes no heap allocation and no blocking
+     * system call. If the writer cannot keep up and the ring fills,
+     * stream_compress fails.
+     * @param fout Name of output file.
+     * @param ring_size size of the ring between stream_compress and the
+     * writer thread in bytes.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    virtual int stream_compress_init_realtime(const std::string fout,
+            size_t ring_size) = 0;
+
+    /*!
+     * Initializes stream compression in real-time mode to out. The sink is
+     * called from the writer thread.
+     * @param out the sink to write the compressed data to.
+     * @param ring_size size of the ring between stream_compress and the
+     * writer thread in bytes.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    virtual int stream_compress_init_realtime(sink_sptr out,
+            size_t ring_size) = 0;
+
+    /*!
+     * Whether stream_compress_init_realtime could lock every buffer in
+     * memory. If not, usually because of RLIMIT_MEMLOCK, the stream still
+     * works but stream_compress may stall on page faults.
+     * @return true if the buffers of the real-time stream are locked.
+     */
+    virtual bool memory_locked() const = 0;
+
     /*!
      * Reads the input file given in compress_init, compresses it, and
-     * writes the results to fout given in compress_init.
+     * writes the results to fout given in compress_init. If the compressor
+     * was created with threads, the segments of the input are compressed in
+     * parallel.
      * @return 0 on success, != 0 otherwise.
      */
     virtual int compress() = 0;
@@ -77,6 +149,56 @@ public:
      */
     virtual int stream_compress(const char *inbuf, size_t nbytes) = 0;
 
+    /*!
+     * Compresses the nbytes bytes of in into out, CCSDS header included. The
+     * result is a single stream, equivalent to a file written by compress()
+     * without threads, but no file is opened and no system call is made.
+     * The bytes passed must be a multiple of sample size.
+     * @param in buffer to read samples from.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the compressed data to.
+     * @param cap size of out in bytes. compress_bound(nbytes) always suffices.
+     * @return the number of bytes written to out, < 0 on error or if out is
+     * too small.
+     */
+    virtual ssize_t compress_buffer(const void *in, size_t nbytes, void *out,
+                                    size_t cap) = 0;
+
+    /*!
+     * The largest size compress_buffer may need for nbytes of input.
+     * @param nbytes number of bytes of input.
+     * @return the required capacity of the output buffer in bytes.
+     */
+    virtual size_t compress_bound(size_t nbytes) const = 0;
+
+    /*!
+     * Reads the counters of the stream: bytes in and out of the encoder,
+     * the compression ratio, the time spent encoding and on I/O, call
+     * counts and buffer high water marks. They are reset by compress_init
+     * and stream_compress_init. The call takes no lock and may be made from
+     * any thread while the stream is compressed, e.g. by a monitoring
+     * thread that polls it periodically.
+     * @return a snapshot of the counters.
+     */
+    virtual codec_stats get_stats() = 0;
+
+    /*!
+     * The latency histogram of a stage of the stream_compress calls. Every
+     * call records the time it took, the time it spent copying to and from
+     * the staging buffer, encoding and writing to the sink, so the tail of
+     * the CALL histogram can be matched with the stage that caused it. The
+     * histograms are reset by stream_compress_init and reset_latency, and
+     * may be read from any thread.
+     * @param stage the stage.
+     * @return the histogram, valid for the life of the compressor
+     */
+    virtual const latency_histogram &get_latency(STREAM_STAGE stage) const = 0;
+
+    /*!
+     * Zeroes the latency histograms of every stage.
+     */
+    virtual void reset_latency() = 0;
+
     /*!
      * Finalizes the compression and clears internal variables. Should always be called
      * after compress otherwise output file may not be written correctly.
@@ -115,6 +237,22 @@ public:
  * @param cds_per_packet Secondary header number of CDSes per packet.
  * @param restricted_codes Secondary header restricted codes.
  * @param endianness Endianness of samples.
+ * @param threads Number of threads used by compress(). 0 produces a single
+ * aec bitstream, otherwise the input is split into independent segments that
+ * are compressed in parallel.
+ * @param split_iq Treat the samples as interleaved I/Q pairs and code the I
+ * and the Q plane of every segment separately, so that the predictor never
+ * estimates an I sample from a Q sample. Applies to compress(), which then
+ * always writes a segmented file, even with no threads.
+ * @param predictor One of header::iqzip_compression_header::NATIVE_PREDICTOR.
+ * Anything but NONE replaces the unit delay predictor of libaec with a native
+ * one for samples of up to 24 bits, 16 for COMPLEX_NLMS. Applies to
+ * compress(), which then always writes a segmented file.
+ * @param adaptive Pick the block size, the reference sample interval, the
+ * native predictor and the plane split of every segment from trials on its
+ * first samples, or the ones given here if they code the whole segment
+ * smaller, and store them in front of the segment. Applies to compress(),
+ * which then always writes a segmented file.
  * @return a std::shared_ptr<compressor>
  */
 compressor_sptr create_compressor(uint8_t version, uint8_t type,
@@ -126,7 +264,33 @@ compressor_sptr create_compressor(uint8_t version, uint8_t type,
                                   uint8_t predictor_type, uint8_t mapper_type, uint16_t block_size,
                                   uint8_t data_sense, uint8_t sample_resolution,
                                   uint16_t cds_per_packet, uint8_t restricted_codes,
-                                  uint8_t endianness);
+                                  uint8_t endianness, uint32_t threads = 0,
+                                  bool split_iq = false, uint8_t predictor = 0,
+                                  bool adaptive = false);
+
+/*!
+ * Instantiates a compressor class object for interleaved I/Q samples with the
+ * coding parameters of a level.
+ * FAST codes 64 sample blocks with the native encoder and no I/Q modeling,
+ * and uses the restricted code options on samples of up to 4 bits. The k of
+ * every block is estimated from its sum rather than searched.
+ * DEFAULT codes 16 sample blocks of the prediction errors of the second order
+ * polynomial predictor, or of the separate I and Q planes for samples wider
+ * than 24 bits.
+ * MAX picks the block size, reference sample interval, native predictor and
+ * plane split of every segment from trials on its first samples, and keeps
+ * the parameters of DEFAULT for a segment they code smaller. Every segment
+ * is then at most the size DEFAULT gives it plus its 6 byte parameters.
+ * @param level the preset.
+ * @param sample_resolution Bits per sample.
+ * @param data_sense 0 for signed samples, 1 for unsigned.
+ * @param endianness 0 for MSB first samples, 1 for LSB first.
+ * @param threads Number of threads used by compress().
+ * @return a std::shared_ptr<compressor>
+ */
+compressor_sptr create_compressor(COMPRESSION_LEVEL level,
+                                  uint8_t sample_resolution, uint8_t data_sense,
+                                  uint8_t endianness, uint32_t threads = 0);
 } // namspace compression
 } // namespace iqzip
 
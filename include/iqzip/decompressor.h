@@ -19,7 +19,14 @@
 #ifndef DECOMPRESSOR_H
 #define DECOMPRESSOR_H
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <sys/types.h>
+
+#include <iqzip/codec_stats.h>
+#include <iqzip/latency_histogram.h>
+#include <iqzip/stream_io.h>
 
 namespace iqzip {
 
@@ -47,13 +54,73 @@ public:
      */
     virtual int decompress_init(const std::string fin, const std::string fout) = 0;
 
+    /*!
+     * Initializes necessary variables for random access decompression with
+     * decompress_range. Only the fin file is opened. The CCSDS header is
+     * read from the file specified by fin.
+     * @param fin Name of input file.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int decompress_init(const std::string fin) = 0;
+
+    /*!
+     * Initializes necessary variables for decompression from in to out. The
+     * CCSDS header is read from in. decompress_init(fin, fout) is this call
+     * with a file_source and a file_sink. Single stream input can come from
+     * any source, segmented input requires a source that can seek.
+     * @param in the source to read the compressed data from.
+     * @param out the sink to write the samples to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int decompress_init(source_sptr in, sink_sptr out) = 0;
+
     /*!
      * Reads the input file given in decompress_init, decompresses it, and
-     * writes the results to fout given in decompress_init.
+     * writes the results to fout given in decompress_init. The segments of
+     * segmented files are decompressed in parallel if the decompressor was
+     * created with threads.
      * @return 0 on succes, != 0 otherwise.
      */
     virtual int decompress() = 0;
 
+    /*!
+     * Decompresses count samples starting at first_sample into out. Only the
+     * segments that cover the requested samples are decoded, so the cost
+     * depends on count and not on the position of the samples in the file.
+     * Requires a segmented input file or a sidecar index.
+     * @param first_sample index of the first sample to decompress.
+     * @param count number of samples to decompress.
+     * @param out buffer of at least count samples to write the samples to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int decompress_range(uint64_t first_sample, uint64_t count,
+                                 void *out) = 0;
+
+    /*!
+     * Indexes the single stream input file given in decompress_init. The file
+     * is read once and the position of every reference sample interval is
+     * written to a sidecar index next to it, named after the input file with
+     * IQZIP_SIDECAR_SUFFIX appended. Files with a sidecar index are
+     * decompressed in parallel and support decompress_range like segmented
+     * files do.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int build_index() = 0;
+
+    /*!
+     * Decompresses the nbytes bytes of in, CCSDS header included, into out.
+     * Single stream and segmented data are both accepted. The header is parsed
+     * from memory and no file is opened, so decompress_init is not needed.
+     * @param in buffer holding a complete compressed file.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the samples to.
+     * @param cap size of out in bytes.
+     * @return the number of bytes written to out, < 0 on error or if out is
+     * too small.
+     */
+    virtual ssize_t decompress_buffer(const void *in, size_t nbytes, void *out,
+                                      size_t cap) = 0;
+
     /*!
      * Reads the input file given in iqzip_decompress_init, decompresses it,
      * and writes the results to fout given in decompress_init.
@@ -63,6 +130,32 @@ public:
      */
     virtual int stream_decompress(const char *inbuf, size_t nbytes) = 0;
 
+    /*!
+     * Reads the counters of the stream: bytes in and out of the decoder,
+     * the compression ratio, the time spent decoding and on I/O, call
+     * counts and buffer high water marks. They are reset by
+     * decompress_init. The call takes no lock and may be made from any
+     * thread while the stream is decompressed.
+     * @return a snapshot of the counters.
+     */
+    virtual codec_stats get_stats() = 0;
+
+    /*!
+     * The latency histogram of a stage of the stream_decompress calls, as
+     * for the compressor: every call records its time and the time it spent
+     * copying to the staging buffer, decoding and writing to the sink. The
+     * histograms are reset by decompress_init and reset_latency, and may be
+     * read from any thread.
+     * @param stage the stage.
+     * @return the histogram, valid for the life of the decompressor
+     */
+    virtual const latency_histogram &get_latency(STREAM_STAGE stage) const = 0;
+
+    /*!
+     * Zeroes the latency histograms of every stage.
+     */
+    virtual void reset_latency() = 0;
+
     /*!
      * Finalizes the decompression and clears internal variables. Should always be called
      * after decompress otherwise output file may not be written correctly.
@@ -81,9 +174,14 @@ public:
 
 /*!
  * Instantiates a decompressor class object.
+ * @param threads Number of threads used to decompress segmented files. 0
+ * decodes the segments one after the other.
+ * @param native true to decode with the native decoder instead of libaec.
+ * Files written by the native encoder are always decoded natively.
  * @return a std::shared_ptr<decompressor>
  */
-decompressor_sptr create_decompressor();
+decompressor_sptr create_decompressor(uint32_t threads = 0,
+                                      bool native = false);
 
 } // namespace compression
 
@@ -0,0 +1,150 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Synthetic I/Q workloads
+ *
+ * iq_generator produces interleaved I/Q recordings of a few signal kinds, in
+ * the sample formats iqzip codes. The output depends only on the
+ * configuration: the random numbers come from a 64 bit Mersenne Twister
+ * turned into Gaussian noise in tree, so any build on any box produces the
+ * same samples for the same seed, and so does any split of the output into
+ * calls of generate().
+ */
+
+#ifndef IQ_GENERATOR_H
+#define IQ_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * The signal kinds of iq_generator
+ */
+enum class IQ_SIGNAL {
+    /*! Gaussian noise of the noise level */
+    NOISE = 0x0,
+    /*! A complex tone over the noise */
+    TONE = 0x1,
+    /*! QPSK bursts over the noise, separated by gaps of noise only */
+    QPSK = 0x2,
+    /*! Continuous phase binary FSK bursts, as QPSK */
+    FSK = 0x3,
+    /*! Digital silence, every sample at the middle of the range */
+    QUIET = 0x4,
+    /*! A tone overdriven past full scale, clipped at the sample range */
+    CLIPPED = 0x5,
+    /*! Every kind above in turn, for segment_pairs pairs each */
+    MIXED = 0x6
+};
+
+/*!
+ * The signal and the sample format of an iq_generator
+ */
+struct iq_generator_config {
+    IQ_SIGNAL signal;
+    /*! Bits per sample, from 1 to 32 */
+    uint8_t sample_resolution;
+    /*! 0 for signed samples, 1 for unsigned, offset binary ones */
+    uint8_t data_sense;
+    /*! 0 for MSB first samples, 1 for LSB first */
+    uint8_t endianness;
+    /*! Signal amplitude, as a fraction of full scale */
+    double amplitude;
+    /*! Standard deviation of the noise of each channel, as a fraction of
+     * full scale */
+    double noise;
+    /*! Tone frequency, and FSK deviation, in cycles per pair */
+    double frequency;
+    /*! Pairs per QPSK or FSK symbol */
+    uint32_t samples_per_symbol;
+    /*! Pairs of every burst and of every gap after it */
+    uint32_t burst_pairs;
+    uint32_t gap_pairs;
+    /*! Pairs of every signal kind of MIXED */
+    uint32_t segment_pairs;
+    uint64_t seed;
+};
+
+/*!
+ * The defaults of every signal: 16 bit signed LSB first samples, a signal
+ * at half scale over a noise floor of 1%, 8 pairs per symbol, bursts of
+ * 16384 pairs with gaps of 4096 and MIXED kinds of 262144 pairs.
+ * @param signal the signal kind.
+ * @return the configuration
+ */
+iq_generator_config default_iq_generator_config(IQ_SIGNAL signal);
+
+class iq_generator {
+
+public:
+    /*!
+     * @param config the signal and the sample format. Resolutions past 32
+     * bits are clamped.
+     */
+    iq_generator(const iq_generator_config &config);
+
+    /*!
+     * The size of an I/Q pair in bytes. Samples take 1, 2, 3 or 4 bytes, as
+     * in the compressor.
+     */
+    size_t pair_bytes() const;
+
+    /*!
+     * Writes the next pairs I/Q pairs.
+     * @param pairs number of pairs.
+     * @param out buffer of at least pairs * pair_bytes() bytes.
+     */
+    void generate(uint64_t pairs, char *out);
+
+private:
+    iq_generator_config d_config;
+    size_t d_sample_bytes;
+    double d_full_scale;
+    std::mt19937_64 d_rng;
+    /* Second Gaussian of the last Box-Muller pair, if d_has_spare */
+    double d_spare;
+    bool d_has_spare;
+    /* Pairs generated so far */
+    uint64_t d_pair;
+    double d_phase;
+    /* Current symbol and the filtered baseband of the modulators */
+    double d_symbol_i;
+    double d_symbol_q;
+    double d_base_i;
+    double d_base_q;
+
+    double gaussian();
+
+    IQ_SIGNAL signal_at(uint64_t pair) const;
+
+    void next_pair(double *i, double *q);
+
+    void store(double v, char *out) const;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* IQ_GENERATOR_H */
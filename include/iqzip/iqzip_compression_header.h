@@ -24,6 +24,30 @@
 #include <iqzip/compression_identification_packet.h>
 
 #define IQZIP_COMPRESSION_HDR_SIZE      2
+#define IQZIP_CONTAINER_HDR_SIZE        4
+#define IQZIP_MAX_HEADER_SIZE           (MAX_CIP_HEADER_SIZE_BYTES \
+                                         + IQZIP_COMPRESSION_HDR_SIZE \
+                                         + IQZIP_CONTAINER_HDR_SIZE)
+
+/*
+ * Reserved bit 8 of the Extended Parameters subfield. When set, the IQzip
+ * compression header and the IQzip container header follow the CIP header.
+ */
+#define IQZIP_CONTAINER_PRESENT_MASK    0x80
+
+/*
+ * Flags of the IQzip container header. IQZIP_CONTAINER_FLAG_SPLIT_IQ marks
+ * segments whose interleaved I/Q samples were split into an I and a Q plane
+ * before coding. IQZIP_CONTAINER_FLAG_ADAPTIVE marks segments that start with
+ * the segment parameters they were coded with, which then override the block
+ * size, the reference sample interval, the predictor and the plane split of
+ * the headers. IQZIP_CONTAINER_FLAG_RAW_SEGMENTS marks files whose segments
+ * that would not shrink are stored as their samples. Such a segment is as
+ * large as its samples, which no coded segment of these files is.
+ */
+#define IQZIP_CONTAINER_FLAG_SPLIT_IQ       0x01
+#define IQZIP_CONTAINER_FLAG_ADAPTIVE       0x02
+#define IQZIP_CONTAINER_FLAG_RAW_SEGMENTS   0x04
 
 namespace iqzip {
 
@@ -49,6 +73,13 @@ namespace header {
  * This class wraps the standard Compression Identification Packet header and the
  * IQzip compression header extension. The IQzip compression header is automatically
  * appended, if necessary, after the end of the CIP header.
+ *
+ * Files that do not carry a single Adaptive Entropy Coder bitstream, e.g. the
+ * segmented files produced by the multi-threaded compressor, additionally
+ * carry the IQzip container header after the IQzip compression header. Its
+ * presence is signalled by the IQZIP_CONTAINER_PRESENT_MASK bit of the
+ * Extended Parameters subfield, so both headers are always written for such
+ * files.
  */
 class iqzip_compression_header {
 
@@ -63,6 +94,34 @@ public:
         uint8_t endianness : 1;
     } iqzip_compression_header_t;
 
+    /*!
+     * A structure that defines the IQzip container header.
+     */
+    typedef struct iqzip_container_header_t {
+        uint8_t version;
+        uint8_t flags;
+        uint8_t predictor;
+        uint8_t reserved;
+    } iqzip_container_header_t;
+
+    /*!
+     * The layout of the compressed data that follows the headers
+     */
+    enum class CONTAINER_VERSION {
+        SINGLE_STREAM = 0x0, SEGMENTED = 0x1, INDEXED = 0x2
+    };
+
+    /*!
+     * The native predictor the segments were preprocessed with, instead of
+     * the unit delay predictor of libaec. NONE keeps the libaec one, any
+     * other is marked as an application specific predictor type in the
+     * Preprocessor subfield.
+     */
+    enum class NATIVE_PREDICTOR {
+        NONE = 0x0, POLYNOMIAL_2 = 0x1, CHANNEL_DELTA = 0x2, IQ_DELTA = 0x3,
+        COMPLEX_NLMS = 0x4
+    };
+
     /*!
      * The default block size value for the IQzip compression header
      */
@@ -110,8 +169,9 @@ public:
      * Write the IQzip compression header to the file in path. This function automatically
      * appends only the appropriate header segments to the file.
      * \param path The full path to the file
+     * \return a size_t representing the length of the written header in bytes
      */
-    void
+    size_t
     write_header_to_file(std::string path);
 
     /*!
@@ -123,6 +183,28 @@ public:
     size_t
     parse_header_from_file(std::string path);
 
+    /*!
+     * Write the IQzip compression header to the memory buffer buf. The same
+     * header segments as in write_header_to_file are written.
+     * \param buf The buffer to write the header to
+     * \param cap The size of buf in bytes
+     * \return a size_t representing the length of the written header in bytes,
+     * 0 if the header does not fit in cap bytes
+     */
+    size_t
+    write_header_to_buffer(uint8_t *buf, size_t cap);
+
+    /*!
+     * Parse the IQzip compression header from the memory buffer buf and
+     * populate the internal bit-fields of the class that describe the header.
+     * \param buf The buffer that starts with the header
+     * \param nbytes The number of valid bytes in buf
+     * \return a size_t representing the length of the parsed header in bytes,
+     * 0 if buf does not hold a complete header
+     */
+    size_t
+    parse_header_from_buffer(const uint8_t *buf, size_t nbytes);
+
     /*!
      * Get the appropriate block size by parsing the whole IQzip compression header.
      * For example, in the case that a block size of 64 samples is encoded in the
@@ -241,7 +323,8 @@ public:
 
     /*!
      * Get the decoded value of preprocessor sample resolution subfield.
-     * \return a uint8_t representing the preprocessor sample resolution.
+     * \return a uint8_t representing the preprocessor sample resolution,
+     * from 1 to 32 bits.
      */
     uint8_t
     decode_preprocessor_sample_resolution() const;
@@ -288,6 +371,27 @@ public:
     uint16_t
     decode_iqzip_header_reference_sample_interval() const;
 
+    /*!
+     * Get the decoded value of the iqzip container header version field.
+     * \return a uint8_t representing the layout of the compressed data.
+     */
+    uint8_t
+    decode_iqzip_container_version() const;
+
+    /*!
+     * Get the decoded value of the iqzip container header flags field.
+     * \return a uint8_t representing the IQZIP_CONTAINER_FLAG_* flags.
+     */
+    uint8_t
+    decode_iqzip_container_flags() const;
+
+    /*!
+     * Get the decoded value of the iqzip container header predictor field.
+     * \return a uint8_t representing the NATIVE_PREDICTOR of the segments.
+     */
+    uint8_t
+    decode_iqzip_container_predictor() const;
+
     /*!
      * Encode the application process identifier into the appropriate header subfield.
      * \param apid The application process identifier
@@ -480,8 +584,33 @@ public:
     void
     encode_iqzip_header_reference_sample_interval(uint16_t interval);
 
+    /*!
+     * Encode the layout of the compressed data into the iqzip container header.
+     * \param version The iqzip container version
+     */
+    void
+    encode_iqzip_container_version(uint8_t version);
+
+    /*!
+     * Encode the flags of the iqzip container header. They are written only
+     * along with a container version other than SINGLE_STREAM or with LSB
+     * first samples, whose byte order the IQzip header must carry.
+     * \param flags The IQZIP_CONTAINER_FLAG_* flags
+     */
+    void
+    encode_iqzip_container_flags(uint8_t flags);
+
+    /*!
+     * Encode the native predictor of the segments into the iqzip container
+     * header.
+     * \param predictor The NATIVE_PREDICTOR of the segments
+     */
+    void
+    encode_iqzip_container_predictor(uint8_t predictor);
+
 private:
     iqzip_compression_header_t d_iqzip_header;
+    iqzip_container_header_t d_container_header;
     ccsds_packet_primary_header *d_primary_header;
     compression_identification_packet *d_cip;
 
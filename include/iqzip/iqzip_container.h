@@ -0,0 +1,335 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IQZIP_CONTAINER_H_
+#define IQZIP_CONTAINER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define IQZIP_SEGMENT_HDR_SIZE          8
+#define IQZIP_SEGMENT_PARAMS_SIZE       6
+#define IQZIP_INDEX_ENTRY_SIZE          24
+#define IQZIP_TRAILER_SIZE              16
+#define IQZIP_TRAILER_MAGIC             "IQZI"
+#define IQZIP_SIDECAR_MAGIC             "IQZB"
+#define IQZIP_SIDECAR_SUFFIX            ".idx"
+
+namespace iqzip {
+
+namespace compression {
+
+namespace header {
+
+/*!
+ *
+ * \ingroup compression_header
+ *
+ * A segmented IQzip file stores the input as a sequence of independent
+ * segments right after the IQzip compression header. Every segment starts at a
+ * reference sample interval boundary and holds its own Adaptive Entropy Coder
+ * bitstream, so segments can be encoded and decoded in parallel.
+ *
+ * Each segment is preceded by the segment header, which stores the length of
+ * the compressed bitstream that follows it and the number of samples it
+ * decodes to. All fields are big endian.
+ *
+ *  +-------------+------------------+---------------+
+ *  |             |                  |               |
+ *  |    FIELD    | COMPRESSED BYTES |    SAMPLES    |
+ *  |             |                  |               |
+ *  +-------------+------------------+---------------+
+ *  | SIZE (BITS) |        32        |       32      |
+ *  +-------------+------------------+---------------+
+ */
+class iqzip_segment_header {
+
+public:
+
+    /*!
+     * The serialized segment header
+     */
+    typedef uint8_t segment_header_t[IQZIP_SEGMENT_HDR_SIZE];
+
+    iqzip_segment_header(uint32_t compressed_bytes, uint32_t samples);
+
+    iqzip_segment_header();
+
+    virtual
+    ~iqzip_segment_header();
+
+    /*!
+     * Get the inner buffer that represents the serialized segment header
+     * \return a segment_header_t representing the segment header
+     */
+    segment_header_t &
+    get_segment_header();
+
+    void
+    set_segment_header(const segment_header_t *hdr);
+
+    /*!
+     * Encode the length of the compressed bitstream of the segment.
+     * \param compressed_bytes The length of the bitstream in bytes
+     */
+    void
+    encode_compressed_bytes(uint32_t compressed_bytes);
+
+    /*!
+     * Encode the number of samples of the segment.
+     * \param samples The number of samples
+     */
+    void
+    encode_samples(uint32_t samples);
+
+    /*!
+     * Get the decoded value of the compressed bytes field.
+     * \return a uint32_t representing the length of the bitstream in bytes.
+     */
+    uint32_t
+    decode_compressed_bytes() const;
+
+    /*!
+     * Get the decoded value of the samples field.
+     * \return a uint32_t representing the number of samples of the segment.
+     */
+    uint32_t
+    decode_samples() const;
+
+private:
+    segment_header_t d_segment_header;
+};
+
+/*!
+ *
+ * \ingroup compression_header
+ *
+ * In files with the IQZIP_CONTAINER_FLAG_ADAPTIVE container flag, the
+ * compressed bitstream of every segment is preceded by the parameters it was
+ * coded with. They are counted in the compressed bytes of the segment header
+ * and of the index. The flags field holds IQZIP_CONTAINER_FLAG_SPLIT_IQ for
+ * split segments. All fields are big endian.
+ *
+ *  +-------------+------------+-----+-----------+-------+
+ *  |             |            |     |           |       |
+ *  |    FIELD    | BLOCK SIZE | RSI | PREDICTOR | FLAGS |
+ *  |             |            |     |           |       |
+ *  +-------------+------------+-----+-----------+-------+
+ *  | SIZE (BITS) |     16     |  16 |     8     |   8   |
+ *  +-------------+------------+-----+-----------+-------+
+ */
+class iqzip_segment_params {
+
+public:
+
+    /*!
+     * The serialized segment parameters
+     */
+    typedef uint8_t segment_params_t[IQZIP_SEGMENT_PARAMS_SIZE];
+
+    iqzip_segment_params(uint16_t block_size, uint16_t rsi, uint8_t predictor,
+                         uint8_t flags);
+
+    iqzip_segment_params();
+
+    virtual
+    ~iqzip_segment_params();
+
+    /*!
+     * Get the inner buffer that represents the serialized segment parameters
+     * \return a segment_params_t representing the segment parameters
+     */
+    segment_params_t &
+    get_segment_params();
+
+    void
+    set_segment_params(const segment_params_t *params);
+
+    /*!
+     * Get the decoded value of the block size field.
+     * \return a uint16_t representing the samples per block.
+     */
+    uint16_t
+    decode_block_size() const;
+
+    /*!
+     * Get the decoded value of the reference sample interval field.
+     * \return a uint16_t representing the blocks per reference sample interval.
+     */
+    uint16_t
+    decode_reference_sample_interval() const;
+
+    /*!
+     * Get the decoded value of the predictor field.
+     * \return a uint8_t representing the NATIVE_PREDICTOR of the segment.
+     */
+    uint8_t
+    decode_predictor() const;
+
+    /*!
+     * Get the decoded value of the flags field.
+     * \return a uint8_t representing the IQZIP_CONTAINER_FLAG_* flags.
+     */
+    uint8_t
+    decode_flags() const;
+
+private:
+    segment_params_t d_segment_params;
+};
+
+/*!
+ *
+ * \ingroup compression_header
+ *
+ * Indexed IQzip files append the segment index after the last segment, so
+ * readers can locate any segment without decoding the ones before it. The
+ * index holds one entry per segment, followed by a fixed size trailer at the
+ * very end of the file that points back to the first entry. All fields are big
+ * endian.
+ *
+ *  +-------------+--------+------------------+--------------+---------+
+ *  |             |        |                  |              |         |
+ *  | INDEX ENTRY | OFFSET | COMPRESSED BYTES | FIRST SAMPLE | SAMPLES |
+ *  |             |        |                  |              |         |
+ *  +-------------+--------+------------------+--------------+---------+
+ *  | SIZE (BITS) |   64   |        32        |      64      |    32   |
+ *  +-------------+--------+------------------+--------------+---------+
+ *
+ *  +-------------+-------+----------+--------------+
+ *  |             |       |          |              |
+ *  |   TRAILER   | MAGIC | SEGMENTS | INDEX OFFSET |
+ *  |             |       |          |              |
+ *  +-------------+-------+----------+--------------+
+ *  | SIZE (BITS) |   32  |    32    |      64      |
+ *  +-------------+-------+----------+--------------+
+ *
+ * The offset of an entry is the file offset of the compressed bitstream of
+ * the segment, right after its segment header.
+ *
+ * Single stream files have no segments of their own, but can be indexed
+ * after the fact into a sidecar file next to them, named after the file with
+ * IQZIP_SIDECAR_SUFFIX appended. The sidecar holds the same entries and
+ * trailer, with IQZIP_SIDECAR_MAGIC as the magic and an index offset of 0.
+ * Since reference sample intervals are not byte aligned in a single stream,
+ * the offset of a sidecar entry is the bit offset of its first reference
+ * sample interval in the file, and compressed bytes counts the bytes that
+ * hold any of its bits, starting from the byte at offset / 8.
+ */
+class iqzip_segment_index {
+
+public:
+
+    /*!
+     * The description of a single segment
+     */
+    typedef struct index_entry_t {
+        uint64_t offset;
+        uint32_t compressed_bytes;
+        uint64_t first_sample;
+        uint32_t samples;
+    } index_entry_t;
+
+    /*!
+     * The serialized trailer
+     */
+    typedef uint8_t trailer_t[IQZIP_TRAILER_SIZE];
+
+    iqzip_segment_index();
+
+    virtual
+    ~iqzip_segment_index();
+
+    /*!
+     * Append a segment to the index. Its first sample follows the last sample
+     * of the previous segment.
+     * \param offset The file offset of the compressed bitstream
+     * \param compressed_bytes The length of the bitstream in bytes
+     * \param samples The number of samples of the segment
+     */
+    void
+    add_segment(uint64_t offset, uint32_t compressed_bytes, uint32_t samples);
+
+    /*!
+     * Remove all segments from the index.
+     */
+    void
+    clear();
+
+    /*!
+     * Get the segments of the index.
+     * \return a vector with one entry per segment, in file order
+     */
+    const std::vector<index_entry_t> &
+    get_entries() const;
+
+    /*!
+     * Get the total number of samples of all the segments.
+     * \return a uint64_t representing the number of samples
+     */
+    uint64_t
+    total_samples() const;
+
+    /*!
+     * Find the segment that holds a sample.
+     * \param sample The index of the sample, less than total_samples()
+     * \return the position of the segment in get_entries()
+     */
+    size_t
+    find_segment(uint64_t sample) const;
+
+    /*!
+     * Serialize the index entries followed by the trailer.
+     * \param buf The vector that holds the serialized index on return
+     * \param index_offset The file offset the index is written at
+     * \param magic The magic of the trailer
+     */
+    void
+    encode(std::vector<uint8_t> &buf, uint64_t index_offset,
+           const char *magic = IQZIP_TRAILER_MAGIC) const;
+
+    /*!
+     * Parse the trailer of an indexed file.
+     * \param trailer The last IQZIP_TRAILER_SIZE bytes of the file
+     * \param index_offset The file offset of the index on return
+     * \param segments The number of index entries on return
+     * \param magic The magic the trailer is expected to carry
+     * \return true if the trailer is valid, false otherwise
+     */
+    static bool
+    decode_trailer(const trailer_t trailer, uint64_t *index_offset,
+                   uint32_t *segments, const char *magic = IQZIP_TRAILER_MAGIC);
+
+    /*!
+     * Replace the contents of the index with the serialized entries in buf.
+     * \param buf The serialized index entries
+     * \param segments The number of entries in buf
+     */
+    void
+    decode_entries(const uint8_t *buf, uint32_t segments);
+
+private:
+    std::vector<index_entry_t> d_entries;
+    uint64_t d_total_samples;
+};
+
+} // namespace header
+} // namespace compression
+} // namespace iqzip
+
+#endif /* IQZIP_CONTAINER_H_ */
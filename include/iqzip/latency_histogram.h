@@ -0,0 +1,137 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Latency histograms of the stream calls
+ *
+ * latency_histogram counts durations in log-linear buckets, in the manner
+ * of HdrHistogram: every power of two is split into 32 buckets, so any
+ * recorded value is known to within 3%, from nanoseconds to hours, in a
+ * fixed array of counters. Recording is a relaxed atomic increment, so
+ * a histogram can be read, exported and reset from another thread while
+ * the stream calls record into it.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * The stages of a stream_compress or stream_decompress call. Every call
+ * records one value in the histogram of every stage, 0 for the stages it
+ * did not go through, so the percentiles of all stages are per call.
+ */
+enum class STREAM_STAGE {
+    /*! The whole call */
+    CALL = 0x0,
+    /*! Copying input to and from the staging buffer */
+    COPY = 0x1,
+    /*! The encoder or the decoder */
+    CODEC = 0x2,
+    /*! Writing the output to the sink */
+    WRITE = 0x3
+};
+
+#define STREAM_STAGES 4
+
+/*!
+ * The count of a histogram bucket, holding the values from the upper bound
+ * of the previous bucket, excluded, to upper_ns, included
+ */
+typedef struct latency_bucket {
+    uint64_t upper_ns;
+    uint64_t count;
+} latency_bucket;
+
+class latency_histogram {
+
+public:
+    latency_histogram();
+
+    /*!
+     * Counts a duration.
+     * @param ns the duration in nanoseconds.
+     */
+    void record(uint64_t ns);
+
+    /*!
+     * Zeroes every bucket.
+     */
+    void reset();
+
+    /*!
+     * The number of recorded values.
+     */
+    uint64_t count() const;
+
+    /*!
+     * The largest recorded value, exactly.
+     * @return the value in nanoseconds, 0 if nothing was recorded
+     */
+    uint64_t max() const;
+
+    /*!
+     * The value below which a percentage of the recorded values fall.
+     * @param percentile the percentage, e.g. 99.9.
+     * @return the upper bound of the bucket of that value in nanoseconds,
+     * at most max(), 0 if nothing was recorded
+     */
+    uint64_t percentile(double percentile) const;
+
+    /*!
+     * The buckets that hold any value, in increasing order.
+     * @return the buckets
+     */
+    std::vector<latency_bucket> buckets() const;
+
+    /*!
+     * The histogram as a JSON object, with the count, the maximum, the
+     * 50th, 90th, 99th, 99.9th and 99.99th percentiles and the non empty
+     * buckets, all durations in nanoseconds.
+     * @return the JSON text
+     */
+    std::string to_json() const;
+
+private:
+    static const size_t SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    /* Exact buckets up to 2 * SUB_BUCKETS, then SUB_BUCKETS per octave */
+    static const size_t BUCKETS = (65 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    std::atomic<uint64_t> d_counts[BUCKETS];
+    std::atomic<uint64_t> d_max;
+
+    static size_t index(uint64_t ns);
+
+    static uint64_t upper_bound(size_t index);
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* LATENCY_HISTOGRAM_H */
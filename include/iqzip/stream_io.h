@@ -0,0 +1,182 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAM_IO_H
+#define STREAM_IO_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class sink;
+class source;
+typedef std::shared_ptr<sink> sink_sptr;
+typedef std::shared_ptr<source> source_sptr;
+
+/*!
+ * The destination of the bytes produced by a compressor or a decompressor.
+ * Implement it to send data to a socket, a shared memory ring or any other
+ * storage without going through a file.
+ */
+class sink {
+
+public:
+
+    virtual ~sink() {};
+
+    /*!
+     * Consumes a span of output bytes. The span points into the internal
+     * buffers of the caller and is only valid during the call, so sinks that
+     * keep the data around must copy it.
+     * @param buf the bytes to write.
+     * @param nbytes number of bytes of buf.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int write(const char *buf, size_t nbytes) = 0;
+
+    /*!
+     * Called once all the output has been written.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int close()
+    {
+        return 0;
+    }
+};
+
+/*!
+ * The origin of the bytes consumed by a compressor or a decompressor.
+ * Sources that support seek() and size() enable the features that need
+ * random access, such as segment indexes and decompress_range.
+ */
+class source {
+
+public:
+
+    virtual ~source() {};
+
+    /*!
+     * Reads up to nbytes into buf. Fewer than nbytes are returned only at the
+     * end of the data.
+     * @param buf the buffer to read into.
+     * @param nbytes number of bytes to read.
+     * @return the number of bytes read, 0 at the end of the data, < 0 on
+     * error.
+     */
+    virtual ssize_t read(char *buf, size_t nbytes) = 0;
+
+    /*!
+     * Moves the read position to offset bytes from the start of the data.
+     * @param offset the new read position.
+     * @return 0 on success, != 0 if the source is not seekable.
+     */
+    virtual int seek(uint64_t /* offset */)
+    {
+        return -1;
+    }
+
+    /*!
+     * The total size of the data.
+     * @return the size in bytes, < 0 if it is not known.
+     */
+    virtual int64_t size()
+    {
+        return -1;
+    }
+
+    /*!
+     * Called once no more data will be read.
+     * @return 0 on success, != 0 otherwise.
+     */
+    virtual int close()
+    {
+        return 0;
+    }
+};
+
+/*!
+ * A sink that writes to a file
+ */
+class file_sink : public sink {
+
+public:
+
+    /*!
+     * Opens path for writing, truncating it.
+     * @param path Name of the file.
+     */
+    file_sink(const std::string path);
+
+    ~file_sink();
+
+    /*!
+     * @return true if the file was opened successfully.
+     */
+    bool is_open() const;
+
+    int write(const char *buf, size_t nbytes);
+
+    int close();
+
+private:
+    std::ofstream d_stream;
+};
+
+/*!
+ * A seekable source that reads from a file
+ */
+class file_source : public source {
+
+public:
+
+    /*!
+     * Opens path for reading.
+     * @param path Name of the file.
+     */
+    file_source(const std::string path);
+
+    ~file_source();
+
+    /*!
+     * @return true if the file was opened successfully.
+     */
+    bool is_open() const;
+
+    ssize_t read(char *buf, size_t nbytes);
+
+    int seek(uint64_t offset);
+
+    int64_t size();
+
+    int close();
+
+private:
+    std::ifstream d_stream;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* STREAM_IO_H */
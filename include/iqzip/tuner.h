@@ -0,0 +1,89 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Coding parameter tuner
+ *
+ * tune() compresses a sample of a file of interleaved I/Q samples with every
+ * combination of a grid of block sizes, reference sample intervals, code
+ * option sets, native predictors and plane splits, and measures the size and
+ * the speed of each. pareto_front() keeps the combinations that no other one
+ * beats on both.
+ */
+
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * The coding parameters of a trial compression and how they did
+ */
+struct tune_result {
+    uint16_t block_size;
+    uint8_t reference_sample_interval;
+    uint8_t restricted_codes;
+    uint8_t predictor;
+    bool split_iq;
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    /*! in_bytes over out_bytes */
+    double ratio;
+    /*! Compression speed of one thread, in MB/s of input */
+    double mbps;
+};
+
+/*!
+ * Runs a trial compression of a sample of fin for every combination of the
+ * grid. The sample is made of 1 MiB chunks spread evenly over the file. Every
+ * trial writes what compress() does without threads, with the native encoder:
+ * a single stream, or a segmented file for a predictor or the plane split.
+ * @param fin Name of the input file.
+ * @param sample_bytes Size of the sample. The whole file is used if it is
+ * smaller.
+ * @param sample_resolution Bits per sample.
+ * @param data_sense 0 for signed samples, 1 for unsigned.
+ * @param endianness 0 for MSB first samples, 1 for LSB first.
+ * @param threads Number of trials that run in parallel. 0 runs one per
+ * hardware thread.
+ * @param results the outcome of every trial, in grid order.
+ * @return 0 on success, != 0 otherwise.
+ */
+int tune(const std::string fin, uint64_t sample_bytes,
+         uint8_t sample_resolution, uint8_t data_sense, uint8_t endianness,
+         uint32_t threads, std::vector<tune_result> &results);
+
+/*!
+ * The results that no other result beats on both ratio and speed.
+ * @param results trial results.
+ * @return the Pareto front, from the fastest to the smallest.
+ */
+std::vector<tune_result> pareto_front(const std::vector<tune_result>
+                                      &results);
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* TUNER_H */
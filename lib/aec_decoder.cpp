@@ -0,0 +1,608 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aec_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+/* The largest reference sample interval libaec accepts */
+#define AEC_RSI_MAX             4096
+/* Zero block count that stands for the remainder of the segment */
+#define AEC_ROS                 5
+/* Blocks per segment, zero block runs never cross a segment */
+#define AEC_SEGMENT_BLOCKS      64
+/* Second extension codes resolved by the table */
+#define AEC_SE_TABLE_SIZE       91
+
+namespace iqzip {
+
+namespace compression {
+
+/*
+ * MSB first bit reader over a complete buffer. Reads past the end return
+ * zeros and move pos past len * 8, which the caller checks once per block.
+ */
+typedef struct bit_reader_t {
+    const uint8_t *buf;
+    size_t len;
+    uint64_t pos;
+} bit_reader_t;
+
+/*
+ * The next 64 bits, of which at least the first 57 are valid. Unchecked
+ * reads are for blocks that lie well inside the buffer.
+ */
+template <bool CHECKED>
+static inline uint64_t
+peek_bits(const bit_reader_t *r)
+{
+    size_t byte = r->pos >> 3;
+    uint64_t w = 0;
+    if (!CHECKED || byte + 8 <= r->len) {
+        memcpy(&w, r->buf + byte, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+    }
+    else {
+        for (size_t i = 0; i < 8; i++) {
+            w = (w << 8) | (byte + i < r->len ? r->buf[byte + i] : 0);
+        }
+    }
+    return w << (r->pos & 7);
+}
+
+/* bits <= 32 */
+template <bool CHECKED>
+static inline uint32_t
+get_bits(bit_reader_t *r, uint32_t bits)
+{
+    if (bits == 0) {
+        return 0;
+    }
+    uint32_t value = (uint32_t)(peek_bits<CHECKED>(r) >> (64 - bits));
+    r->pos += bits;
+    return value;
+}
+
+/*
+ * Fundamental sequence: the zeros before the next one. An unchecked read
+ * gives up on codes longer than a peek, false is returned then.
+ */
+template <bool CHECKED>
+static inline bool
+get_fs(bit_reader_t *r, uint64_t *fs)
+{
+    uint64_t w = peek_bits<CHECKED>(r);
+    uint64_t zeros = 0;
+    if (!CHECKED && !w) {
+        return false;
+    }
+    while (!w) {
+        /* Only the first 57 bits are sure to be data */
+        zeros += 56;
+        r->pos += 56;
+        if (r->pos > (uint64_t) r->len * 8) {
+            *fs = zeros;
+            return true;
+        }
+        w = peek_bits<CHECKED>(r);
+    }
+    uint32_t z = __builtin_clzll(w);
+    r->pos += z + 1;
+    *fs = zeros + z;
+    return true;
+}
+
+/* The sum of the pair of every second extension code below the size */
+typedef struct se_table_t {
+    uint8_t beta[AEC_SE_TABLE_SIZE];
+    uint8_t base[AEC_SE_TABLE_SIZE];
+
+    se_table_t()
+    {
+        uint32_t m = 0;
+        for (uint32_t beta_ = 0; m < AEC_SE_TABLE_SIZE; beta_++) {
+            for (uint32_t j = 0; j <= beta_ && m < AEC_SE_TABLE_SIZE; j++, m++) {
+                beta[m] = beta_;
+                base[m] = beta_ * (beta_ + 1) / 2;
+            }
+        }
+    }
+} se_table_t;
+
+static const se_table_t se_table;
+
+static inline void
+se_pair(uint64_t m, uint32_t *first, uint32_t *second)
+{
+    uint64_t beta;
+    uint64_t base;
+    if (m < AEC_SE_TABLE_SIZE) {
+        beta = se_table.beta[m];
+        base = se_table.base[m];
+    }
+    else {
+        beta = 0;
+        while ((beta + 1) * (beta + 2) / 2 <= m) {
+            beta++;
+        }
+        base = beta * (beta + 1) / 2;
+    }
+    *second = (uint32_t)(m - base);
+    *first = (uint32_t)(beta - (m - base));
+}
+
+template <size_t BYTES, bool MSB>
+static void
+store_samples(const uint32_t *x, size_t samples, uint8_t *p)
+{
+    for (size_t i = 0; i < samples; i++, p += BYTES) {
+        for (size_t b = 0; b < BYTES; b++) {
+            p[b] = (uint8_t)(x[i] >> 8 * (MSB ? BYTES - 1 - b : b));
+        }
+    }
+}
+
+/* The coding parameters of the blocks */
+typedef struct block_format_t {
+    uint32_t block_size;
+    uint32_t bits_per_sample;
+    uint32_t id_len;
+} block_format_t;
+
+/*
+ * Reads the mapped samples of a coded block to d, or the length of a zero
+ * block run to zero_blocks, which is 0 for every other option.
+ * @return false if an unchecked read gave up.
+ */
+template <bool CHECKED>
+static bool
+read_block(bit_reader_t *r, const block_format_t &f, bool ref, uint32_t *d,
+           uint64_t *zero_blocks, uint64_t *ref_end)
+{
+    const uint32_t J = f.block_size;
+    const uint32_t n = f.bits_per_sample;
+    const uint32_t id = get_bits<CHECKED>(r, f.id_len);
+    uint32_t i = 0;
+    uint64_t fs;
+
+    *zero_blocks = 0;
+    *ref_end = 0;
+    if (id == 0) {
+        const uint32_t se = get_bits<CHECKED>(r, 1);
+        if (ref) {
+            d[0] = get_bits<CHECKED>(r, n);
+            *ref_end = r->pos;
+            i = 1;
+        }
+        if (!se) {
+            if (!get_fs<CHECKED>(r, &fs)) {
+                return false;
+            }
+            *zero_blocks = fs + 1;
+            std::fill(d + i, d + J, 0);
+            return true;
+        }
+        while (i < J) {
+            uint32_t first, second;
+            if (!get_fs<CHECKED>(r, &fs)) {
+                return false;
+            }
+            se_pair(fs, &first, &second);
+            if (i & 1) {
+                d[i++] = second;
+            }
+            else {
+                d[i++] = first;
+                d[i++] = second;
+            }
+        }
+        return true;
+    }
+
+    if (id == (1u << f.id_len) - 1) {
+        for (i = 0; i < J; i++) {
+            d[i] = get_bits<CHECKED>(r, n);
+        }
+        return true;
+    }
+
+    const uint32_t k = id - 1;
+    if (ref) {
+        d[0] = get_bits<CHECKED>(r, n);
+        i = 1;
+    }
+    for (uint32_t j = i; j < J; j++) {
+        if (!get_fs<CHECKED>(r, &fs)) {
+            return false;
+        }
+        d[j] = (uint32_t) fs;
+    }
+    if (k) {
+        for (uint32_t j = i; j < J; j++) {
+            d[j] = (d[j] << k) | get_bits<CHECKED>(r, k);
+        }
+    }
+    return true;
+}
+
+aec_native_decoder::aec_native_decoder() :
+    d_bits_per_sample(0),
+    d_block_size(0),
+    d_rsi(0),
+    d_bytes_per_sample(0),
+    d_flags(0),
+    d_id_len(0),
+    d_max_block_bytes(0),
+    d_fast_bytes(0),
+    d_block(0),
+    d_zero_blocks(0),
+    d_last(0),
+    d_ref_out(false),
+    d_bit(0),
+    d_pending_pos(0),
+    d_pending_len(0)
+{
+}
+
+aec_native_decoder::~aec_native_decoder()
+{
+}
+
+int
+aec_native_decoder::init(aec_stream *strm)
+{
+    if (strm->bits_per_sample == 0 || strm->bits_per_sample > 32) {
+        return AEC_CONF_ERROR;
+    }
+    if (strm->flags & AEC_NOT_ENFORCE) {
+        if (strm->block_size == 0 || (strm->block_size & 1)) {
+            return AEC_CONF_ERROR;
+        }
+    }
+    else if (strm->block_size != 8 && strm->block_size != 16
+             && strm->block_size != 32 && strm->block_size != 64) {
+        return AEC_CONF_ERROR;
+    }
+    if (strm->rsi == 0 || strm->rsi > AEC_RSI_MAX) {
+        return AEC_CONF_ERROR;
+    }
+
+    d_bits_per_sample = strm->bits_per_sample;
+    d_block_size = strm->block_size;
+    d_rsi = strm->rsi;
+    /* As in aec_native_encoder, AEC_PAD_RSI is ignored */
+    d_flags = strm->flags & ~AEC_PAD_RSI;
+    if (d_bits_per_sample > 16) {
+        d_id_len = 5;
+        d_bytes_per_sample = d_bits_per_sample <= 24
+                             && (d_flags & AEC_DATA_3BYTE) ? 3 : 4;
+    }
+    else if (d_bits_per_sample > 8) {
+        d_id_len = 4;
+        d_bytes_per_sample = 2;
+    }
+    else {
+        if (d_flags & AEC_RESTRICTED) {
+            if (d_bits_per_sample > 4) {
+                return AEC_CONF_ERROR;
+            }
+            d_id_len = d_bits_per_sample <= 2 ? 1 : 2;
+        }
+        else {
+            d_id_len = 3;
+        }
+        d_bytes_per_sample = 1;
+    }
+
+    /* An encoder picks the shortest option, so no block is longer than its
+     * samples verbatim. Longer ones only cost the carry buffer more. */
+    d_max_block_bytes = (d_id_len + 1 + (uint64_t)(d_block_size + 1)
+                         * d_bits_per_sample) / 8 + 8;
+    /* Unchecked reads advance at most 57 bits for a fundamental sequence
+     * and 32 bits for anything else, and peek 8 bytes ahead */
+    d_fast_bytes = (d_id_len + 1 + 32 + (uint64_t) d_block_size * (57 + 32))
+                   / 8 + 9;
+    d_mapped.assign(d_block_size, 0);
+    d_samples.assign(d_block_size, 0);
+    d_pending.assign((size_t) d_block_size * d_bytes_per_sample, 0);
+    d_carry.clear();
+    d_carry.reserve(2 * d_max_block_bytes);
+    d_block = 0;
+    d_zero_blocks = 0;
+    d_last = 0;
+    d_ref_out = false;
+    d_bit = 0;
+    d_pending_pos = 0;
+    d_pending_len = 0;
+    strm->total_in = 0;
+    strm->total_out = 0;
+    return AEC_OK;
+}
+
+void
+aec_native_decoder::reconstruct(bool ref)
+{
+    const uint32_t *d = d_mapped.data();
+    uint32_t *x = d_samples.data();
+
+    if (!(d_flags & AEC_DATA_PREPROCESS)) {
+        memcpy(x, d, d_block_size * sizeof(uint32_t));
+        return;
+    }
+
+    /*
+     * Signed samples are offset by med to the unsigned range [0, xmax], so
+     * the distance of a sample from the nearest bound is x or xmax - x, as
+     * the upper bit tells.
+     */
+    const uint32_t xmax = d_bits_per_sample == 32 ? UINT32_MAX
+                          : (1u << d_bits_per_sample) - 1;
+    const uint32_t med = xmax / 2 + 1;
+    const uint32_t offset = d_flags & AEC_DATA_SIGNED ? med : 0;
+    uint32_t u = d_last;
+    size_t i = 0;
+    if (ref) {
+        u = d[0] ^ offset;
+        x[0] = u - offset;
+        i = 1;
+    }
+    for (; i < d_block_size; i++) {
+        const uint32_t di = d[i];
+        const uint32_t mask = u & med ? xmax : 0;
+        /* |delta| <= theta for the folded errors, the rest are past it */
+        if ((di >> 1) + (di & 1) <= (mask ^ u)) {
+            u += (di >> 1) ^ ~((di & 1) - 1);
+        }
+        else {
+            u = mask ^ di;
+        }
+        x[i] = u - offset;
+    }
+    d_last = u;
+}
+
+void
+aec_native_decoder::store(const uint32_t *x, size_t samples,
+                          uint8_t *out) const
+{
+    const bool msb = d_flags & AEC_DATA_MSB;
+    switch (d_bytes_per_sample) {
+    case 1:
+        store_samples<1, false>(x, samples, out);
+        break;
+    case 2:
+        if (msb) {
+            store_samples<2, true>(x, samples, out);
+        }
+        else {
+            store_samples<2, false>(x, samples, out);
+        }
+        break;
+    case 3:
+        if (msb) {
+            store_samples<3, true>(x, samples, out);
+        }
+        else {
+            store_samples<3, false>(x, samples, out);
+        }
+        break;
+    default:
+        if (msb) {
+            store_samples<4, true>(x, samples, out);
+        }
+        else {
+            store_samples<4, false>(x, samples, out);
+        }
+        break;
+    }
+}
+
+void
+aec_native_decoder::put_block(aec_stream *strm, bool ref, uint32_t first)
+{
+    const size_t bytes = (size_t)(d_block_size - first) * d_bytes_per_sample;
+
+    reconstruct(ref);
+    /* Large output buffers are written to directly */
+    if (strm->avail_out >= bytes) {
+        store(&d_samples[first], d_block_size - first, strm->next_out);
+        strm->next_out += bytes;
+        strm->avail_out -= bytes;
+        strm->total_out += bytes;
+    }
+    else {
+        store(&d_samples[first], d_block_size - first, d_pending.data());
+        d_pending_pos = 0;
+        d_pending_len = bytes;
+        drain(strm);
+    }
+}
+
+bool
+aec_native_decoder::drain(aec_stream *strm)
+{
+    size_t n = std::min(d_pending_len - d_pending_pos, strm->avail_out);
+    memcpy(strm->next_out, &d_pending[d_pending_pos], n);
+    strm->next_out += n;
+    strm->avail_out -= n;
+    strm->total_out += n;
+    d_pending_pos += n;
+    return d_pending_pos == d_pending_len;
+}
+
+int
+aec_native_decoder::decode_blocks(const uint8_t *buf, size_t len,
+                                  uint64_t *pos, aec_stream *strm,
+                                  size_t blocks)
+{
+    const bool pre = d_flags & AEC_DATA_PREPROCESS;
+    uint32_t *d = d_mapped.data();
+    block_format_t f;
+    f.block_size = d_block_size;
+    f.bits_per_sample = d_bits_per_sample;
+    f.id_len = d_id_len;
+    bit_reader_t r;
+    r.buf = buf;
+    r.len = len;
+    r.pos = *pos;
+
+    for (; blocks && strm->avail_out; blocks--) {
+        bool ref = false;
+
+        if (d_zero_blocks) {
+            /* The rest of a zero block run needs no input */
+            std::fill(d, d + d_block_size, 0);
+            d_zero_blocks--;
+        }
+        else {
+            const uint64_t start = r.pos;
+            uint64_t zero_blocks;
+            uint64_t ref_end;
+            ref = pre && d_block == 0;
+            if ((start >> 3) + d_fast_bytes > len
+                || !read_block<false>(&r, f, ref, d, &zero_blocks, &ref_end)) {
+                r.pos = start;
+                read_block<true>(&r, f, ref, d, &zero_blocks, &ref_end);
+            }
+
+            /* Start over with more input */
+            if (r.pos > (uint64_t) len * 8) {
+                *pos = start;
+                /* libaec outputs the reference sample of a low entropy
+                 * block as soon as it is read, so does the zero padding at
+                 * the end of a bitstream when it is long enough */
+                if (ref_end && ref_end <= (uint64_t) len * 8 && !d_ref_out) {
+                    reconstruct(true);
+                    store(d_samples.data(), 1, d_pending.data());
+                    d_pending_pos = 0;
+                    d_pending_len = d_bytes_per_sample;
+                    drain(strm);
+                    d_ref_out = true;
+                }
+                return AEC_OK;
+            }
+
+            if (zero_blocks == AEC_ROS) {
+                zero_blocks = std::min(d_rsi - d_block,
+                                       AEC_SEGMENT_BLOCKS
+                                       - d_block % AEC_SEGMENT_BLOCKS);
+            }
+            else if (zero_blocks > AEC_ROS) {
+                zero_blocks--;
+            }
+            if (zero_blocks > d_rsi - d_block) {
+                return AEC_DATA_ERROR;
+            }
+            if (zero_blocks) {
+                d_zero_blocks = (uint32_t) zero_blocks - 1;
+            }
+        }
+
+        put_block(strm, ref, d_ref_out ? 1 : 0);
+        d_ref_out = false;
+        if (++d_block == d_rsi) {
+            d_block = 0;
+        }
+        *pos = r.pos;
+    }
+    return AEC_OK;
+}
+
+int
+aec_native_decoder::decode(aec_stream *strm, int flush)
+{
+    (void) flush;
+    int status;
+
+    if (!drain(strm)) {
+        return AEC_OK;
+    }
+
+    /*
+     * Blocks that started in the input of an earlier call are decoded from
+     * the carried bytes, extended with enough of the new input, one at a
+     * time until the carry is used up.
+     */
+    while (!d_carry.empty()) {
+        const size_t carried = d_carry.size();
+        size_t n = std::min(strm->avail_in,
+                            std::max(d_max_block_bytes, carried));
+        d_carry.insert(d_carry.end(), strm->next_in, strm->next_in + n);
+        strm->next_in += n;
+        strm->avail_in -= n;
+        strm->total_in += n;
+
+        uint64_t pos = d_bit;
+        while (pos < (uint64_t) carried * 8 && strm->avail_out) {
+            uint64_t from = pos;
+            bool zero_run = d_zero_blocks != 0;
+            status = decode_blocks(d_carry.data(), d_carry.size(), &pos, strm,
+                                   1);
+            if (status != AEC_OK) {
+                return status;
+            }
+            if (pos == from && !zero_run) {
+                break;
+            }
+        }
+
+        if (pos >= (uint64_t) carried * 8) {
+            /* Give the new input that was not needed back */
+            size_t back = d_carry.size() - pos / 8;
+            strm->next_in -= back;
+            strm->avail_in += back;
+            strm->total_in -= back;
+            d_bit = pos % 8;
+            d_carry.clear();
+            break;
+        }
+        d_carry.erase(d_carry.begin(), d_carry.begin() + pos / 8);
+        d_bit = pos % 8;
+        if (!strm->avail_out || !strm->avail_in) {
+            return AEC_OK;
+        }
+    }
+
+    uint64_t pos = d_bit;
+    status = decode_blocks(strm->next_in, strm->avail_in, &pos, strm,
+                           SIZE_MAX);
+    if (status != AEC_OK) {
+        return status;
+    }
+    size_t used = pos / 8;
+    strm->next_in += used;
+    strm->avail_in -= used;
+    strm->total_in += used;
+    d_bit = pos % 8;
+
+    /* The input ended inside a block, keep its start for the next call */
+    if (strm->avail_out) {
+        d_carry.assign(strm->next_in, strm->next_in + strm->avail_in);
+        strm->next_in += strm->avail_in;
+        strm->total_in += strm->avail_in;
+        strm->avail_in = 0;
+    }
+    return AEC_OK;
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,145 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Native Adaptive Entropy Coder decoder
+ *
+ * aec_native_decoder is an in tree implementation of the CCSDS 121.0-B
+ * decoder. It takes the same aec_stream configuration as libaec and
+ * produces the same samples from any bitstream aec_encode or
+ * aec_native_encoder wrote.
+ *
+ * The bitstream is read 64 bits at a time and fundamental sequences are
+ * decoded with a count of leading zeros, so a whole code costs a few
+ * instructions instead of a loop over its bits. Second extension pairs are
+ * looked up in a table. A block is decoded at once and restarted from its
+ * first bit when the input ends in the middle of it, so the decoder keeps
+ * only the tail of the input it could not use between calls.
+ *
+ * It is the decoder of the NATIVE_LOSSLESS_COMPRESSION codec backend.
+ */
+
+#ifndef AEC_DECODER_H
+#define AEC_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <libaec.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class aec_native_decoder {
+
+public:
+    aec_native_decoder();
+
+    ~aec_native_decoder();
+
+    /*!
+     * Validates the configuration of strm and allocates every buffer the
+     * decoder needs.
+     * @param strm the stream to decode, as for aec_decode_init.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    int init(aec_stream *strm);
+
+    /*!
+     * Decodes the input of strm, as aec_decode does. Decoding stops when the
+     * output buffer fills or at the first block the input does not hold
+     * entirely. That block is decoded on the next call.
+     * @param strm the stream to decode.
+     * @param flush ignored, as in libaec.
+     * @return AEC_OK on success, AEC_DATA_ERROR if the bitstream is invalid.
+     */
+    int decode(aec_stream *strm, int flush);
+
+private:
+    uint32_t d_bits_per_sample;
+    uint32_t d_block_size;
+    uint32_t d_rsi;
+    uint32_t d_bytes_per_sample;
+    uint32_t d_flags;
+    uint32_t d_id_len;
+    size_t d_max_block_bytes;
+    size_t d_fast_bytes;
+
+    /* Position in the current reference sample interval */
+    uint32_t d_block;
+    uint32_t d_zero_blocks;
+    uint32_t d_last;
+    bool d_ref_out;
+
+    /* Input left over from the previous call and the bits used of it */
+    std::vector<uint8_t> d_carry;
+    uint32_t d_bit;
+
+    std::vector<uint32_t> d_mapped;
+    std::vector<uint32_t> d_samples;
+    std::vector<uint8_t> d_pending;
+    size_t d_pending_pos;
+    size_t d_pending_len;
+
+    /*!
+     * Decodes the blocks of buf starting at bit *pos, as long as out has
+     * space for a whole block.
+     * @param buf the bitstream.
+     * @param len the number of bytes of buf.
+     * @param pos the bit to start from, the bit after the last block
+     * decoded on return.
+     * @param strm the stream whose output buffer receives the samples.
+     * @param blocks the largest number of blocks to decode.
+     * @return AEC_OK, or AEC_DATA_ERROR if the bitstream is invalid.
+     */
+    int decode_blocks(const uint8_t *buf, size_t len, uint64_t *pos,
+                      aec_stream *strm, size_t blocks);
+
+    /*!
+     * Reconstructs the samples of the block in d_mapped into d_samples.
+     * @param ref true if the block starts with the reference sample.
+     */
+    void reconstruct(bool ref);
+
+    /*!
+     * Writes samples in the configured layout.
+     */
+    void store(const uint32_t *x, size_t samples, uint8_t *out) const;
+
+    /*!
+     * Reconstructs the block in d_mapped and writes its samples to strm,
+     * or to d_pending if they do not fit.
+     * @param ref true if the block starts with the reference sample.
+     * @param first the first sample to write.
+     */
+    void put_block(aec_stream *strm, bool ref, uint32_t first);
+
+    /*!
+     * Copies pending output to strm.
+     * @return true if all of it fit.
+     */
+    bool drain(aec_stream *strm);
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* AEC_DECODER_H */
@@ -0,0 +1,642 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aec_encoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+/* The largest reference sample interval libaec accepts */
+#define AEC_RSI_MAX             4096
+/* Zero block count that stands for the remainder of the segment */
+#define AEC_ROS                 (-1)
+/* Blocks per segment, zero block runs never cross a segment */
+#define AEC_SEGMENT_BLOCKS      64
+
+/* Building for AVX2 too needs ifunc support from the loader. Only the
+ * preprocessor is cloned, a clone of the block coder would not inline the
+ * bit packer */
+#if defined(__x86_64__) && defined(__GLIBC__)
+#define AEC_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define AEC_CLONES
+#endif
+
+namespace iqzip {
+
+namespace compression {
+
+/*
+ * MSB first bit packer. Bits gather in a 64 bit word and leave it 32 at a
+ * time, so at most 31 bits are held back between calls.
+ */
+typedef struct bit_writer_t {
+    uint8_t *out;
+    uint64_t acc;
+    uint32_t bits;
+} bit_writer_t;
+
+/* value must fit in bits, bits <= 32 */
+static inline void
+put_bits(bit_writer_t *w, uint32_t value, uint32_t bits)
+{
+    w->acc = (w->acc << bits) | value;
+    w->bits += bits;
+    if (w->bits >= 32) {
+        w->bits -= 32;
+        uint32_t word = (uint32_t)(w->acc >> w->bits);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap32(word);
+#endif
+        memcpy(w->out, &word, 4);
+        w->out += 4;
+    }
+}
+
+/* Fundamental sequence: fs zeros and a one */
+static inline void
+put_fs(bit_writer_t *w, uint64_t fs)
+{
+    while (fs >= 32) {
+        put_bits(w, 0, 32);
+        fs -= 32;
+    }
+    put_bits(w, 1, (uint32_t) fs + 1);
+}
+
+/* The parameters of the coded data sets of an interval */
+typedef struct block_coder_t {
+    uint32_t block_size;
+    uint32_t bits_per_sample;
+    uint32_t id_len;
+    uint32_t kmax;
+    uint32_t ref_sample;
+    bool ref;
+    bool estimate_k;
+} block_coder_t;
+
+static inline bool
+block_is_zero(const uint32_t *b, size_t n)
+{
+    uint32_t any = 0;
+    for (size_t i = 0; i < n; i++) {
+        any |= b[i];
+    }
+    return any == 0;
+}
+
+static inline uint64_t
+block_fs_len(const uint32_t *b, size_t n, uint32_t k)
+{
+    uint64_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        len += b[i] >> k;
+    }
+    return len;
+}
+
+/*
+ * Length of the block with the sample splitting option and the best k. As
+ * in libaec the search starts at the k of the previous block and walks
+ * towards the single minimum of the length, so ties are broken the same.
+ */
+static inline uint32_t
+assess_splitting(const block_coder_t &c, const uint32_t *b, uint32_t ref,
+                 uint32_t *k_prev)
+{
+    const uint64_t this_bs = c.block_size - ref;
+    uint32_t k = *k_prev;
+    uint32_t k_min = k;
+    bool no_turn = k == 0;
+    bool up = true;
+    uint64_t len_min = UINT64_MAX;
+
+    for (;;) {
+        uint64_t fs_len = block_fs_len(b + ref, this_bs, k);
+        uint64_t len = fs_len + this_bs * (k + 1);
+        if (len < len_min) {
+            if (len_min < UINT64_MAX) {
+                no_turn = true;
+            }
+            len_min = len;
+            k_min = k;
+            if (up) {
+                /* A larger k costs block_size bits more than it saves */
+                if (fs_len < this_bs || k >= c.kmax) {
+                    if (no_turn) {
+                        break;
+                    }
+                    k = *k_prev - 1;
+                    up = false;
+                    no_turn = true;
+                }
+                else {
+                    k++;
+                }
+            }
+            else {
+                if (fs_len >= this_bs || k == 0) {
+                    break;
+                }
+                k--;
+            }
+        }
+        else {
+            if (no_turn) {
+                break;
+            }
+            k = *k_prev - 1;
+            up = false;
+            no_turn = true;
+        }
+    }
+    *k_prev = k_min;
+    return (uint32_t) len_min;
+}
+
+/*
+ * Length of the block with the sample splitting option and a k estimated
+ * from the sum of the block, in a single pass. Raising k saves a bit on
+ * every sample while it halves the sum, and costs one. The length is taken
+ * from the sum too, so it is never shorter than the coded block.
+ */
+static inline uint32_t
+estimate_splitting(const block_coder_t &c, const uint32_t *b, uint32_t ref,
+                   uint32_t *k_prev)
+{
+    const uint64_t this_bs = c.block_size - ref;
+    uint64_t sum = 0;
+    for (size_t i = ref; i < c.block_size; i++) {
+        sum += b[i];
+    }
+
+    uint32_t k = 0;
+    while (k < c.kmax && (sum >> (k + 1)) > this_bs) {
+        k++;
+    }
+    *k_prev = k;
+    return (uint32_t) std::min<uint64_t>((sum >> k) + this_bs * (k + 1),
+                                         UINT32_MAX);
+}
+
+/* Length of the block with the second extension option, if it may win */
+static inline uint32_t
+assess_se(const block_coder_t &c, const uint32_t *b, uint32_t uncomp_len)
+{
+    uint64_t len = 1;
+    for (size_t i = 0; i < c.block_size; i += 2) {
+        uint64_t d = (uint64_t) b[i] + b[i + 1];
+        len += d * (d + 1) / 2 + b[i + 1] + 1;
+        if (len > uncomp_len) {
+            return UINT32_MAX;
+        }
+    }
+    return (uint32_t) len;
+}
+
+static inline uint32_t
+sample_mask(uint32_t bits)
+{
+    return bits == 32 ? UINT32_MAX : (1u << bits) - 1;
+}
+
+static inline void
+put_zero_run(const block_coder_t &c, bit_writer_t *w, int zero_blocks,
+             bool zero_ref)
+{
+    put_bits(w, 0, c.id_len + 1);
+    if (zero_ref) {
+        put_bits(w, c.ref_sample, c.bits_per_sample);
+    }
+    if (zero_blocks == AEC_ROS) {
+        put_fs(w, 4);
+    }
+    else if (zero_blocks >= 5) {
+        put_fs(w, zero_blocks);
+    }
+    else {
+        put_fs(w, zero_blocks - 1);
+    }
+}
+
+static inline void
+put_block(const block_coder_t &c, bit_writer_t *w, const uint32_t *b,
+          uint32_t ref, uint32_t *k_prev)
+{
+    const uint32_t uncomp_len = (c.block_size - ref) * c.bits_per_sample;
+    uint32_t split_len = UINT32_MAX;
+    if (c.id_len > 1) {
+        split_len = c.estimate_k ? estimate_splitting(c, b, ref, k_prev)
+                    : assess_splitting(c, b, ref, k_prev);
+    }
+    /* A block with an estimated k above zero is too dense for the second
+     * extension to win */
+    uint32_t se_len = c.estimate_k && split_len < uncomp_len && *k_prev
+                      ? UINT32_MAX : assess_se(c, b, uncomp_len);
+    bool split = false;
+    bool se = false;
+
+    if (split_len < uncomp_len) {
+        split = split_len < se_len;
+        se = !split;
+    }
+    else {
+        se = se_len < uncomp_len;
+    }
+
+    if (split) {
+        const uint32_t k = *k_prev;
+        put_bits(w, k + 1, c.id_len);
+        if (ref) {
+            put_bits(w, c.ref_sample, c.bits_per_sample);
+        }
+        for (size_t i = ref; i < c.block_size; i++) {
+            put_fs(w, b[i] >> k);
+        }
+        if (k) {
+            const uint32_t mask = (1u << k) - 1;
+            for (size_t i = ref; i < c.block_size; i++) {
+                put_bits(w, b[i] & mask, k);
+            }
+        }
+    }
+    else if (se) {
+        put_bits(w, 1, c.id_len + 1);
+        if (ref) {
+            put_bits(w, c.ref_sample, c.bits_per_sample);
+        }
+        for (size_t i = 0; i < c.block_size; i += 2) {
+            uint64_t d = (uint64_t) b[i] + b[i + 1];
+            put_fs(w, d * (d + 1) / 2 + b[i + 1]);
+        }
+    }
+    else {
+        const uint32_t mask = sample_mask(c.bits_per_sample);
+        put_bits(w, (1u << c.id_len) - 1, c.id_len);
+        if (ref) {
+            put_bits(w, c.ref_sample, c.bits_per_sample);
+        }
+        for (size_t i = ref; i < c.block_size; i++) {
+            put_bits(w, b[i] & mask, c.bits_per_sample);
+        }
+    }
+}
+
+/*
+ * Codes the first blocks of a preprocessed interval. Zero blocks are
+ * gathered into runs that end at the end of a segment of 64 blocks, at the
+ * end of the interval, or before a block that is not zero.
+ */
+static void
+code_blocks(const block_coder_t &c, const uint32_t *pp, uint32_t blocks,
+            bit_writer_t *w, uint32_t *k_prev)
+{
+    int zero_blocks = 0;
+    bool zero_ref = false;
+
+    for (uint32_t b = 0; b < blocks; b++) {
+        const uint32_t *block = pp + (size_t) b * c.block_size;
+        const uint32_t ref = c.ref && b == 0;
+
+        if (!block_is_zero(block + ref, c.block_size - ref)) {
+            if (zero_blocks) {
+                put_zero_run(c, w, zero_blocks, zero_ref);
+                zero_blocks = 0;
+            }
+            put_block(c, w, block, ref, k_prev);
+            continue;
+        }
+
+        if (zero_blocks++ == 0) {
+            zero_ref = ref;
+        }
+        if (b + 1 == blocks || (b + 1) % AEC_SEGMENT_BLOCKS == 0) {
+            put_zero_run(c, w, zero_blocks > 4 ? AEC_ROS : zero_blocks,
+                         zero_ref);
+            zero_blocks = 0;
+        }
+    }
+}
+
+/*
+ * Unit delay predictor and prediction error mapper of CCSDS 121.0-B, over
+ * the first n samples of an interval. The first sample is the reference.
+ */
+template <typename T>
+AEC_CLONES static void
+preprocess(const uint32_t *raw, size_t n, uint32_t bits, bool is_signed,
+           uint32_t *d)
+{
+    T xmax, xmin;
+    if (is_signed) {
+        xmax = (T)(((uint64_t) 1 << (bits - 1)) - 1);
+        xmin = -xmax - 1;
+    }
+    else {
+        xmax = (T)(((uint64_t) 1 << bits) - 1);
+        xmin = 0;
+    }
+    const uint32_t m = is_signed ? (uint32_t)((uint64_t) 1 << (bits - 1)) : 0;
+
+    d[0] = 0;
+    for (size_t i = 1; i < n; i++) {
+        /* Sign extension of the samples is a no-op for unsigned data */
+        T prev = is_signed ? (T)(int32_t)((raw[i - 1] ^ m) - m) : (T) raw[i - 1];
+        T x = is_signed ? (T)(int32_t)((raw[i] ^ m) - m) : (T) raw[i];
+        T delta = x - prev;
+        T theta = std::min(prev - xmin, xmax - prev);
+        T abs_delta = delta < 0 ? -delta : delta;
+        T folded = delta < 0 ? 2 * abs_delta - 1 : 2 * delta;
+        d[i] = (uint32_t)(abs_delta <= theta ? folded : theta + abs_delta);
+    }
+}
+
+/*
+ * Bits above the sample resolution are dropped, so the preprocessor never
+ * sees a sample out of its range and signed samples may come sign extended.
+ */
+template <size_t BYTES, bool MSB>
+static void
+load_samples(const unsigned char *p, size_t samples, uint32_t mask,
+             uint32_t *raw)
+{
+    for (size_t i = 0; i < samples; i++, p += BYTES) {
+        uint32_t u = 0;
+        for (size_t b = 0; b < BYTES; b++) {
+            u |= (uint32_t) p[b] << 8 * (MSB ? BYTES - 1 - b : b);
+        }
+        raw[i] = u & mask;
+    }
+}
+
+aec_native_encoder::aec_native_encoder() :
+    d_bits_per_sample(0),
+    d_block_size(0),
+    d_rsi(0),
+    d_bytes_per_sample(0),
+    d_flags(0),
+    d_id_len(0),
+    d_kmax(0),
+    d_rsi_samples(0),
+    d_max_rsi_bytes(0),
+    d_staged(0),
+    d_k(0),
+    d_acc(0),
+    d_acc_bits(0),
+    d_pending_pos(0),
+    d_pending_len(0),
+    d_coded(false),
+    d_flushed(false)
+{
+}
+
+aec_native_encoder::~aec_native_encoder()
+{
+}
+
+int
+aec_native_encoder::init(aec_stream *strm)
+{
+    if (strm->bits_per_sample == 0 || strm->bits_per_sample > 32) {
+        return AEC_CONF_ERROR;
+    }
+    if (strm->flags & AEC_NOT_ENFORCE) {
+        if (strm->block_size == 0 || (strm->block_size & 1)) {
+            return AEC_CONF_ERROR;
+        }
+    }
+    else if (strm->block_size != 8 && strm->block_size != 16
+             && strm->block_size != 32 && strm->block_size != 64) {
+        return AEC_CONF_ERROR;
+    }
+    if (strm->rsi == 0 || strm->rsi > AEC_RSI_MAX) {
+        return AEC_CONF_ERROR;
+    }
+
+    d_bits_per_sample = strm->bits_per_sample;
+    d_block_size = strm->block_size;
+    d_rsi = strm->rsi;
+    /* AEC_PAD_RSI is a build option of libaec that is off by default and
+     * ignored then, so is it here */
+    d_flags = strm->flags & ~AEC_PAD_RSI;
+    if (d_bits_per_sample > 16) {
+        d_id_len = 5;
+        d_bytes_per_sample = d_bits_per_sample <= 24
+                             && (d_flags & AEC_DATA_3BYTE) ? 3 : 4;
+    }
+    else if (d_bits_per_sample > 8) {
+        d_id_len = 4;
+        d_bytes_per_sample = 2;
+    }
+    else {
+        if (d_flags & AEC_RESTRICTED) {
+            if (d_bits_per_sample > 4) {
+                return AEC_CONF_ERROR;
+            }
+            d_id_len = d_bits_per_sample <= 2 ? 1 : 2;
+        }
+        else {
+            d_id_len = 3;
+        }
+        d_bytes_per_sample = 1;
+    }
+    /* Options left for sample splitting, none with a single bit id */
+    d_kmax = d_id_len > 1 ? (1u << d_id_len) - 3 : 0;
+
+    d_rsi_samples = (size_t) d_rsi * d_block_size;
+    /* No coded block is longer than its option id and the samples verbatim,
+     * plus a word of slack for the packer */
+    d_max_rsi_bytes = ((uint64_t) d_rsi
+                       * (d_id_len + 1
+                          + (uint64_t) d_block_size * d_bits_per_sample))
+                      / 8 + 8;
+    d_raw.assign(d_rsi_samples, 0);
+    d_pp.assign(d_rsi_samples, 0);
+    d_pending.assign(d_max_rsi_bytes + 8, 0);
+    d_staged = 0;
+    d_k = 0;
+    d_acc = 0;
+    d_acc_bits = 0;
+    d_pending_pos = 0;
+    d_pending_len = 0;
+    d_coded = false;
+    d_flushed = false;
+    strm->total_in = 0;
+    strm->total_out = 0;
+    return AEC_OK;
+}
+
+void
+aec_native_encoder::load(const unsigned char *in, size_t samples,
+                         uint32_t *raw) const
+{
+    const bool msb = d_flags & AEC_DATA_MSB;
+    const uint32_t mask = sample_mask(d_bits_per_sample);
+    switch (d_bytes_per_sample) {
+    case 1:
+        load_samples<1, false>(in, samples, mask, raw);
+        break;
+    case 2:
+        if (msb) {
+            load_samples<2, true>(in, samples, mask, raw);
+        }
+        else {
+            load_samples<2, false>(in, samples, mask, raw);
+        }
+        break;
+    case 3:
+        if (msb) {
+            load_samples<3, true>(in, samples, mask, raw);
+        }
+        else {
+            load_samples<3, false>(in, samples, mask, raw);
+        }
+        break;
+    default:
+        if (msb) {
+            load_samples<4, true>(in, samples, mask, raw);
+        }
+        else {
+            load_samples<4, false>(in, samples, mask, raw);
+        }
+        break;
+    }
+}
+
+size_t
+aec_native_encoder::encode_rsi(uint32_t blocks, uint8_t *out)
+{
+    const size_t samples = (size_t) blocks * d_block_size;
+    const bool pre = d_flags & AEC_DATA_PREPROCESS;
+    const bool is_signed = d_flags & AEC_DATA_SIGNED;
+
+    /* A short last interval repeats its last sample up to a whole block */
+    for (size_t i = d_staged; i < samples; i++) {
+        d_raw[i] = d_raw[i - 1];
+    }
+
+    block_coder_t c;
+    c.block_size = d_block_size;
+    c.bits_per_sample = d_bits_per_sample;
+    c.id_len = d_id_len;
+    c.kmax = d_kmax;
+    c.ref = pre;
+    c.estimate_k = d_flags & AEC_NATIVE_ESTIMATE_K;
+    c.ref_sample = d_raw[0] & sample_mask(d_bits_per_sample);
+
+    const uint32_t *pp = d_raw.data();
+    if (pre) {
+        if (d_bits_per_sample <= 30) {
+            preprocess<int32_t>(d_raw.data(), samples, d_bits_per_sample,
+                                is_signed, d_pp.data());
+        }
+        else {
+            preprocess<int64_t>(d_raw.data(), samples, d_bits_per_sample,
+                                is_signed, d_pp.data());
+        }
+        pp = d_pp.data();
+    }
+
+    bit_writer_t w;
+    w.out = out;
+    w.acc = d_acc;
+    w.bits = d_acc_bits;
+    code_blocks(c, pp, blocks, &w, &d_k);
+    d_acc = w.acc;
+    d_acc_bits = w.bits;
+    return w.out - out;
+}
+
+bool
+aec_native_encoder::drain(aec_stream *strm)
+{
+    size_t n = std::min(d_pending_len - d_pending_pos, strm->avail_out);
+    memcpy(strm->next_out, &d_pending[d_pending_pos], n);
+    strm->next_out += n;
+    strm->avail_out -= n;
+    strm->total_out += n;
+    d_pending_pos += n;
+    return d_pending_pos == d_pending_len;
+}
+
+int
+aec_native_encoder::encode(aec_stream *strm, int flush)
+{
+    for (;;) {
+        if (!drain(strm)) {
+            return AEC_OK;
+        }
+
+        size_t avail = strm->avail_in / d_bytes_per_sample;
+        size_t n = std::min(d_rsi_samples - d_staged, avail);
+        load(strm->next_in, n, &d_raw[d_staged]);
+        strm->next_in += n * d_bytes_per_sample;
+        strm->avail_in -= n * d_bytes_per_sample;
+        strm->total_in += n * d_bytes_per_sample;
+        d_staged += n;
+
+        uint32_t blocks = d_rsi;
+        if (d_staged < d_rsi_samples) {
+            if (flush != AEC_FLUSH) {
+                return AEC_OK;
+            }
+            if (d_staged == 0) {
+                break;
+            }
+            blocks = (d_staged + d_block_size - 1) / d_block_size;
+        }
+
+        /* Large output buffers are written to directly */
+        bool direct = strm->avail_out >= d_max_rsi_bytes;
+        uint8_t *out = direct ? strm->next_out : d_pending.data();
+        size_t len = encode_rsi(blocks, out);
+        d_staged = 0;
+        d_coded = true;
+        if (direct) {
+            strm->next_out += len;
+            strm->avail_out -= len;
+            strm->total_out += len;
+        }
+        else {
+            d_pending_pos = 0;
+            d_pending_len = len;
+        }
+    }
+
+    /* The held back bits end the bitstream, zero padded to a byte */
+    if (!d_flushed) {
+        d_flushed = true;
+        d_pending_pos = 0;
+        d_pending_len = 0;
+        while (d_acc_bits >= 8) {
+            d_acc_bits -= 8;
+            d_pending[d_pending_len++] = (uint8_t)(d_acc >> d_acc_bits);
+        }
+        /* As libaec, an empty stream is a single zero byte */
+        if (d_acc_bits || !d_coded) {
+            d_pending[d_pending_len++] = (uint8_t)(d_acc << (8 - d_acc_bits));
+            d_acc_bits = 0;
+        }
+        drain(strm);
+    }
+    return AEC_OK;
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,130 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Native Adaptive Entropy Coder encoder
+ *
+ * aec_native_encoder is an in tree implementation of the CCSDS 121.0-B
+ * encoder. It takes the same aec_stream configuration as libaec and makes
+ * the same coding decisions, so its bitstream is byte for byte the one of
+ * aec_encode and any libaec based decoder reads it.
+ *
+ * Every reference sample interval is coded at once: the samples are
+ * predicted and mapped in a single pass, zero blocks are detected and the
+ * block sums of the k search are taken with loops the compiler vectorizes,
+ * and the bits are packed into 64 bit words that are stored 32 bits at a
+ * time.
+ *
+ * With AEC_NATIVE_ESTIMATE_K in the flags, the k of every block is estimated
+ * from the block sum instead of searched. The bitstream is still valid for
+ * any decoder but no longer the one of libaec, and a little larger.
+ *
+ * It is the encoder of the NATIVE_LOSSLESS_COMPRESSION codec backend.
+ */
+
+#ifndef AEC_ENCODER_H
+#define AEC_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <libaec.h>
+
+/* Flag of the native encoder only, above the ones of libaec */
+#define AEC_NATIVE_ESTIMATE_K   0x8000
+
+namespace iqzip {
+
+namespace compression {
+
+class aec_native_encoder {
+
+public:
+    aec_native_encoder();
+
+    ~aec_native_encoder();
+
+    /*!
+     * Validates the configuration of strm and allocates every buffer the
+     * encoder needs.
+     * @param strm the stream to encode, as for aec_encode_init.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    int init(aec_stream *strm);
+
+    /*!
+     * Encodes the input of strm, as aec_encode does. Input that does not
+     * fill a reference sample interval is kept until more arrives or the
+     * stream is flushed. Encoding stops early when the output buffer fills.
+     * @param strm the stream to encode.
+     * @param flush AEC_FLUSH to terminate the stream, AEC_NO_FLUSH otherwise.
+     * @return AEC_OK on success, an AEC error code otherwise.
+     */
+    int encode(aec_stream *strm, int flush);
+
+private:
+    uint32_t d_bits_per_sample;
+    uint32_t d_block_size;
+    uint32_t d_rsi;
+    uint32_t d_bytes_per_sample;
+    uint32_t d_flags;
+    uint32_t d_id_len;
+    uint32_t d_kmax;
+    size_t d_rsi_samples;
+    size_t d_max_rsi_bytes;
+
+    std::vector<uint32_t> d_raw;
+    std::vector<uint32_t> d_pp;
+    size_t d_staged;
+    uint32_t d_k;
+
+    uint64_t d_acc;
+    uint32_t d_acc_bits;
+    std::vector<uint8_t> d_pending;
+    size_t d_pending_pos;
+    size_t d_pending_len;
+    bool d_coded;
+    bool d_flushed;
+
+    /*!
+     * Reads samples of the configured layout into 32 bit values, without
+     * the bits above the sample resolution.
+     */
+    void load(const unsigned char *in, size_t samples, uint32_t *raw) const;
+
+    /*!
+     * Codes the interval in d_raw, whose first blocks samples hold data.
+     * @param blocks the number of blocks to code.
+     * @param out buffer of at least d_max_rsi_bytes.
+     * @return the number of bytes written to out.
+     */
+    size_t encode_rsi(uint32_t blocks, uint8_t *out);
+
+    /*!
+     * Copies pending output to strm.
+     * @return true if all of it fit.
+     */
+    bool drain(aec_stream *strm);
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* AEC_ENCODER_H */
@@ -0,0 +1,274 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aec_scanner.h"
+#include <algorithm>
+#include <cstring>
+
+/* Option ids and zero block run lengths as defined by CCSDS 121.0-B */
+#define AEC_ROS                 5
+#define AEC_SE_TABLE_SIZE       90
+
+namespace iqzip {
+
+namespace compression {
+
+aec_scanner::aec_scanner(const aec_stream &strm) :
+    d_bits_per_sample(strm.bits_per_sample),
+    d_block_size(strm.block_size),
+    d_rsi(strm.rsi),
+    d_preprocess(strm.flags & AEC_DATA_PREPROCESS),
+    d_pad_rsi(strm.flags & AEC_PAD_RSI),
+    d_len(0),
+    d_pos(0),
+    d_base(0)
+{
+    if (d_bits_per_sample > 16) {
+        d_id_len = 5;
+    }
+    else if (d_bits_per_sample > 8) {
+        d_id_len = 4;
+    }
+    else if (strm.flags & AEC_RESTRICTED) {
+        d_id_len = d_bits_per_sample <= 2 ? 1 : 2;
+    }
+    else {
+        d_id_len = 3;
+    }
+}
+
+aec_scanner::~aec_scanner()
+{
+}
+
+static inline uint64_t
+load_be64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+int
+aec_scanner::refill(source &in, bool *eof)
+{
+    /* Drop the consumed bytes, keeping the position byte aligned */
+    size_t consumed = d_pos / 8;
+    memmove(d_buf.data(), d_buf.data() + consumed, d_len - consumed);
+    d_len -= consumed;
+    d_base += consumed * 8;
+    d_pos -= consumed * 8;
+
+    size_t room = d_buf.size() - 8 - d_len;
+    ssize_t avail = in.read(reinterpret_cast<char *>(d_buf.data() + d_len),
+                            room);
+    if (avail < 0) {
+        return -1;
+    }
+    d_len += avail;
+    if ((size_t) avail < room) {
+        *eof = true;
+    }
+    /* Zero padding lets the bit readers load whole words near the end */
+    memset(d_buf.data() + d_len, 0, 8);
+    return 0;
+}
+
+bool
+aec_scanner::get_bits(uint32_t bits, uint32_t *value)
+{
+    if (d_pos + bits > d_len * 8) {
+        return false;
+    }
+    uint64_t w = load_be64(&d_buf[d_pos >> 3]) << (d_pos & 7);
+    *value = w >> (64 - bits);
+    d_pos += bits;
+    return true;
+}
+
+bool
+aec_scanner::skip_bits(uint64_t bits)
+{
+    if (d_pos + bits > d_len * 8) {
+        return false;
+    }
+    d_pos += bits;
+    return true;
+}
+
+bool
+aec_scanner::get_fs(uint32_t *value)
+{
+    uint32_t zeros = 0;
+    while (d_pos < d_len * 8) {
+        uint32_t valid = 64 - (d_pos & 7);
+        uint64_t w = load_be64(&d_buf[d_pos >> 3]) << (d_pos & 7);
+        if (w) {
+            uint32_t z = __builtin_clzll(w);
+            if (d_pos + z >= d_len * 8) {
+                return false;
+            }
+            d_pos += z + 1;
+            *value = zeros + z;
+            return true;
+        }
+        zeros += valid;
+        d_pos += valid;
+    }
+    return false;
+}
+
+/*!
+ * Parses a single coded block, or a run of zero blocks.
+ * @return the number of blocks parsed, 0 if the bitstream ends before the
+ * block does and < 0 if the bitstream is invalid.
+ */
+int
+aec_scanner::parse_block(uint32_t block, bool ref)
+{
+    uint32_t id;
+    uint32_t fs;
+    if (!get_bits(d_id_len, &id)) {
+        return 0;
+    }
+
+    if (id == 0) {
+        uint32_t second_extension;
+        if (!get_bits(1, &second_extension)) {
+            return 0;
+        }
+        if (ref && !skip_bits(d_bits_per_sample)) {
+            return 0;
+        }
+        if (second_extension) {
+            for (uint32_t i = 0; i < d_block_size / 2; i++) {
+                if (!get_fs(&fs)) {
+                    return 0;
+                }
+                if (fs > AEC_SE_TABLE_SIZE) {
+                    return -1;
+                }
+            }
+            return 1;
+        }
+
+        if (!get_fs(&fs)) {
+            return 0;
+        }
+        uint32_t zero_blocks = fs + 1;
+        if (zero_blocks == AEC_ROS) {
+            zero_blocks = std::min(d_rsi - block, 64 - (block % 64));
+        }
+        else if (zero_blocks > AEC_ROS) {
+            zero_blocks--;
+        }
+        if (zero_blocks > d_rsi - block) {
+            return -1;
+        }
+        return zero_blocks;
+    }
+
+    if (id == (1u << d_id_len) - 1) {
+        return skip_bits((uint64_t) d_block_size * d_bits_per_sample) ? 1 : 0;
+    }
+
+    /* Split sample option, k = id - 1 */
+    if (ref && !skip_bits(d_bits_per_sample)) {
+        return 0;
+    }
+    uint32_t samples = d_block_size - ref;
+    for (uint32_t i = 0; i < samples; i++) {
+        if (!get_fs(&fs)) {
+            return 0;
+        }
+    }
+    return skip_bits((uint64_t) samples * (id - 1)) ? 1 : 0;
+}
+
+/*!
+ * Parses the blocks of a reference sample interval.
+ * @param blocks the number of complete blocks parsed on return.
+ * @return 0 on success, != 0 if the bitstream is invalid.
+ */
+int
+aec_scanner::parse_rsi(uint32_t *blocks)
+{
+    *blocks = 0;
+    while (*blocks < d_rsi) {
+        int ret = parse_block(*blocks, d_preprocess && *blocks == 0);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        *blocks += ret;
+    }
+    if (d_pad_rsi && (d_pos & 7)) {
+        skip_bits(std::min<uint64_t>(8 - (d_pos & 7), d_len * 8 - d_pos));
+    }
+    return 0;
+}
+
+int
+aec_scanner::scan(source &in, uint32_t group_rsis,
+                  std::vector<rsi_group_t> &groups)
+{
+    /* No coded block is longer than its option id and the samples verbatim */
+    const size_t max_rsi_bytes = ((uint64_t) d_rsi
+                                  * (d_id_len + 1
+                                     + (uint64_t) d_block_size * d_bits_per_sample))
+                                 / 8 + 8;
+    d_buf.resize(std::max<size_t>(4 * max_rsi_bytes, 1 << 22) + 8);
+    d_len = 0;
+    d_pos = 0;
+    d_base = 0;
+    groups.clear();
+
+    bool eof = false;
+    uint64_t rsis = 0;
+    while (true) {
+        if (!eof && d_len - d_pos / 8 < max_rsi_bytes && refill(in, &eof)) {
+            return -1;
+        }
+        uint64_t start = d_base + d_pos;
+        uint32_t blocks;
+        if (parse_rsi(&blocks)) {
+            return -1;
+        }
+        /* The trailing padding of the bitstream never parses as a block */
+        if (blocks == 0) {
+            break;
+        }
+        if (rsis % group_rsis == 0) {
+            groups.push_back({start, 0});
+        }
+        groups.back().blocks += blocks;
+        rsis++;
+        if (blocks < d_rsi) {
+            break;
+        }
+    }
+    return 0;
+}
+
+} // namespace compression
+
+} // namespace iqzip
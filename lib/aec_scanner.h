@@ -0,0 +1,104 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Adaptive Entropy Coder bitstream scanner
+ *
+ * aec_scanner walks the bitstream produced by libaec and locates the
+ * reference sample interval boundaries in it. Only the option ids and the
+ * code lengths of every block are parsed, no sample is reconstructed. Since
+ * every reference sample interval restarts the predictor, libaec can decode
+ * the bitstream from any of these boundaries.
+ */
+
+#ifndef AEC_SCANNER_H
+#define AEC_SCANNER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <libaec.h>
+#include <iqzip/stream_io.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class aec_scanner {
+
+public:
+
+    /*!
+     * A run of consecutive reference sample intervals
+     */
+    typedef struct rsi_group_t {
+        uint64_t bit_offset;
+        uint64_t blocks;
+    } rsi_group_t;
+
+    /*!
+     * Constructor.
+     * @param strm the aec stream configuration the bitstream was encoded with.
+     */
+    aec_scanner(const aec_stream &strm);
+
+    ~aec_scanner();
+
+    /*!
+     * Scans the bitstream from the current position of in up to the end of
+     * the data.
+     * @param in the source to read the bitstream from.
+     * @param group_rsis number of reference sample intervals per group.
+     * @param groups the bit offset, relative to the start of the bitstream,
+     * and the number of blocks of every group on return.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int scan(source &in, uint32_t group_rsis,
+             std::vector<rsi_group_t> &groups);
+
+private:
+    const uint32_t d_bits_per_sample;
+    const uint32_t d_block_size;
+    const uint32_t d_rsi;
+    const bool d_preprocess;
+    const bool d_pad_rsi;
+    uint32_t d_id_len;
+
+    std::vector<uint8_t> d_buf;
+    size_t d_len;
+    uint64_t d_pos;
+    uint64_t d_base;
+
+    int refill(source &in, bool *eof);
+
+    bool get_bits(uint32_t bits, uint32_t *value);
+
+    bool skip_bits(uint64_t bits);
+
+    bool get_fs(uint32_t *value);
+
+    int parse_block(uint32_t block, bool ref);
+
+    int parse_rsi(uint32_t *blocks);
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* AEC_SCANNER_H */
@@ -0,0 +1,160 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async_compressor_impl.h"
+
+#include <cerrno>
+#include <iostream>
+
+namespace iqzip {
+
+namespace compression {
+
+async_compressor_impl::async_compressor_impl(compressor_sptr comp,
+        size_t ring_size) :
+    d_comp(comp),
+    d_ring(ring_size),
+    d_stop(false),
+    d_failed(false),
+    d_high_water_mark(0),
+    d_dropped_bytes(0)
+{
+    if (d_ring.lock()) {
+        std::cout << "Could not lock ring in memory, check RLIMIT_MEMLOCK"
+                  << std::endl;
+    }
+    sem_init(&d_wake, 0, 0);
+}
+
+async_compressor_impl::~async_compressor_impl()
+{
+    stop();
+    sem_destroy(&d_wake);
+}
+
+int
+async_compressor_impl::start(const std::string fout)
+{
+    int status = d_comp->stream_compress_init(fout);
+    if (status) {
+        return status;
+    }
+    run();
+    return 0;
+}
+
+int
+async_compressor_impl::start(sink_sptr out)
+{
+    int status = d_comp->stream_compress_init(out);
+    if (status) {
+        return status;
+    }
+    run();
+    return 0;
+}
+
+void
+async_compressor_impl::run()
+{
+    d_stop.store(false);
+    d_failed.store(false);
+    d_high_water_mark.store(0);
+    d_dropped_bytes.store(0);
+    d_encoder = std::thread(&async_compressor_impl::encoder, this);
+}
+
+int
+async_compressor_impl::push(const char *inbuf, size_t nbytes)
+{
+    if (!d_ring.push(inbuf, nbytes)) {
+        d_dropped_bytes.fetch_add(nbytes, std::memory_order_relaxed);
+        return -1;
+    }
+    /* Only the producer raises the mark, no compare and swap needed */
+    size_t fill = d_ring.size();
+    if (fill > d_high_water_mark.load(std::memory_order_relaxed)) {
+        d_high_water_mark.store(fill, std::memory_order_relaxed);
+    }
+    sem_post(&d_wake);
+    return 0;
+}
+
+int
+async_compressor_impl::stop()
+{
+    if (!d_encoder.joinable()) {
+        return -1;
+    }
+    d_stop.store(true);
+    sem_post(&d_wake);
+    d_encoder.join();
+
+    int status = d_comp->stream_compress_fin();
+    return d_failed || status ? -1 : 0;
+}
+
+void
+async_compressor_impl::encoder()
+{
+    const char *span;
+    size_t avail;
+    for (;;) {
+        while (sem_wait(&d_wake) && errno == EINTR);
+        /* Every post may stand for more than one push, drain them all */
+        while ((avail = d_ring.peek(&span)) > 0) {
+            if (!d_failed && d_comp->stream_compress(span, avail)) {
+                std::cout << "Error in asynchronous compression" << std::endl;
+                d_failed.store(true);
+            }
+            d_ring.consume(avail);
+        }
+        if (d_stop.load()) {
+            return;
+        }
+    }
+}
+
+size_t
+async_compressor_impl::capacity() const
+{
+    return d_ring.capacity();
+}
+
+size_t
+async_compressor_impl::high_water_mark() const
+{
+    return d_high_water_mark.load(std::memory_order_relaxed);
+}
+
+uint64_t
+async_compressor_impl::dropped_bytes() const
+{
+    return d_dropped_bytes.load(std::memory_order_relaxed);
+}
+
+async_compressor_sptr
+create_async_compressor(compressor_sptr comp, size_t ring_size)
+{
+    return std::shared_ptr<async_compressor>(new async_compressor_impl(comp,
+            ring_size));
+}
+
+} // namespace compression
+
+} // namespace iqzip
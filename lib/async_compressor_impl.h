@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASYNC_COMPRESSOR_IMPL_H
+#define ASYNC_COMPRESSOR_IMPL_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <semaphore.h>
+
+#include "spsc_ring.h"
+#include <iqzip/async_compressor.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class async_compressor_impl : public async_compressor, public cache_aligned {
+
+private:
+    compressor_sptr d_comp;
+    spsc_ring d_ring;
+    sem_t d_wake;
+    std::thread d_encoder;
+    std::atomic<bool> d_stop;
+    std::atomic<bool> d_failed;
+    std::atomic<size_t> d_high_water_mark;
+    std::atomic<uint64_t> d_dropped_bytes;
+
+    /*!
+     * Resets the counters and starts the encoder thread.
+     */
+    void run();
+
+    /*!
+     * The body of the encoder thread. Hands the contents of the ring to
+     * stream_compress until stop is requested and the ring is empty.
+     */
+    void encoder();
+
+public:
+
+    /*!
+     * Constructor.
+     * @param comp the compressor that encodes the samples.
+     * @param ring_size the size of the ring in bytes.
+     */
+    async_compressor_impl(compressor_sptr comp, size_t ring_size);
+
+    ~async_compressor_impl();
+
+    /*!
+     * Initializes stream compression to fout and starts the encoder thread.
+     * @param fout Name of output file.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int start(const std::string fout);
+
+    /*!
+     * Initializes stream compression to out and starts the encoder thread.
+     * @param out the sink to write the compressed data to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int start(sink_sptr out);
+
+    /*!
+     * Queues nbytes of inbuf for compression, or drops them whole if they
+     * do not fit in the ring.
+     * @param inbuf buffer to read samples from.
+     * @param nbytes number of bytes to read from buffer.
+     * @return 0 on success, != 0 if the buffer was dropped.
+     */
+    int push(const char *inbuf, size_t nbytes);
+
+    /*!
+     * Drains the ring, stops the encoder thread and finalizes the
+     * compression.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int stop();
+
+    size_t capacity() const;
+
+    size_t high_water_mark() const;
+
+    uint64_t dropped_bytes() const;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* ASYNC_COMPRESSOR_IMPL_H */
@@ -0,0 +1,98 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "async_sink.h"
+
+#include <cerrno>
+
+namespace iqzip {
+
+namespace compression {
+
+async_sink::async_sink(sink_sptr out, size_t ring_size) :
+    d_out(out),
+    d_ring(new spsc_ring(ring_size)),
+    d_stop(false),
+    d_failed(false)
+{
+    d_locked = !d_ring->lock();
+    sem_init(&d_wake, 0, 0);
+    d_writer = std::thread(&async_sink::writer, this);
+}
+
+async_sink::~async_sink()
+{
+    close();
+    sem_destroy(&d_wake);
+}
+
+bool
+async_sink::is_locked() const
+{
+    return d_locked;
+}
+
+int
+async_sink::write(const char *buf, size_t nbytes)
+{
+    if (d_failed.load(std::memory_order_relaxed) || !d_ring->push(buf, nbytes)) {
+        d_failed.store(true, std::memory_order_relaxed);
+        return -1;
+    }
+    sem_post(&d_wake);
+    return 0;
+}
+
+int
+async_sink::close()
+{
+    if (!d_writer.joinable()) {
+        return d_failed ? -1 : 0;
+    }
+    d_stop.store(true);
+    sem_post(&d_wake);
+    d_writer.join();
+    if (d_out->close()) {
+        d_failed.store(true);
+    }
+    return d_failed ? -1 : 0;
+}
+
+void
+async_sink::writer()
+{
+    const char *span;
+    size_t avail;
+    for (;;) {
+        while (sem_wait(&d_wake) && errno == EINTR);
+        /* Every post may stand for more than one write, drain them all */
+        while ((avail = d_ring->peek(&span)) > 0) {
+            if (!d_failed && d_out->write(span, avail)) {
+                d_failed.store(true);
+            }
+            d_ring->consume(avail);
+        }
+        if (d_stop.load()) {
+            return;
+        }
+    }
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Sink that writes on a thread of its own
+ *
+ * async_sink hands the output to another sink on a writer thread of its own.
+ * write() only copies the bytes into a ring that is allocated and locked in
+ * memory up front, so it never allocates, never blocks and makes no system
+ * call other than waking the writer. If the writer falls behind and the ring
+ * fills up, write() fails instead of waiting.
+ */
+
+#ifndef ASYNC_SINK_H
+#define ASYNC_SINK_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <semaphore.h>
+
+#include <iqzip/stream_io.h>
+#include "spsc_ring.h"
+
+namespace iqzip {
+
+namespace compression {
+
+class async_sink : public sink {
+
+public:
+
+    /*!
+     * Allocates the ring, locks it in memory and starts the writer thread.
+     * @param out the sink the writer thread writes to.
+     * @param ring_size the size of the ring in bytes.
+     */
+    async_sink(sink_sptr out, size_t ring_size);
+
+    ~async_sink();
+
+    /*!
+     * @return true if the ring could be locked in memory.
+     */
+    bool is_locked() const;
+
+    int write(const char *buf, size_t nbytes);
+
+    /*!
+     * Waits for the writer thread to write everything queued, stops it and
+     * closes the wrapped sink.
+     * @return 0 on success, != 0 if any write failed.
+     */
+    int close();
+
+private:
+    sink_sptr d_out;
+    std::unique_ptr<spsc_ring> d_ring;
+    bool d_locked;
+    sem_t d_wake;
+    std::atomic<bool> d_stop;
+    std::atomic<bool> d_failed;
+    std::thread d_writer;
+
+    void writer();
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* ASYNC_SINK_H */
@@ -61,6 +61,8 @@ ccsds_packet_primary_header::~ccsds_packet_primary_header()
 void
 ccsds_packet_primary_header::encode()
 {
+    // Fields are ORed into the header, so it must start cleared
+    memset(&d_primary_header, 0, sizeof(packet_primary_header_t));
     encode_type(d_type);
     encode_version(d_version);
     encode_sequence_flags(d_sequence_flags);
@@ -0,0 +1,232 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/ccsds_types.h>
+#include <iqzip/codec_backend.h>
+#include <map>
+#include <mutex>
+
+#include "aec_decoder.h"
+#include "aec_encoder.h"
+#include "probes.h"
+
+namespace iqzip {
+
+namespace compression {
+
+int
+codec_backend::encode_segment(aec_stream *strm, const char *in, size_t nbytes,
+                              std::vector<char> &out, size_t offset)
+{
+    int status = encode_init(strm);
+    if (status != AEC_OK) {
+        return status;
+    }
+
+    /* Uncompressed blocks cost at most an option id on top of the samples */
+    if (out.size() < offset + nbytes + nbytes / 8 + 64) {
+        out.resize(offset + nbytes + nbytes / 8 + 64);
+    }
+    strm->next_in = reinterpret_cast<const unsigned char *>(in);
+    strm->avail_in = nbytes;
+    strm->next_out = reinterpret_cast<unsigned char *>(&out[offset]);
+    strm->avail_out = out.size() - offset;
+
+    IQZIP_PROBE1(encode__start, strm->avail_in);
+    status = encode(strm, AEC_FLUSH);
+    IQZIP_PROBE2(encode__done, strm->total_in, strm->total_out);
+    while (status == AEC_OK && strm->avail_out == 0) {
+        out.resize(2 * out.size());
+        strm->next_out = reinterpret_cast<unsigned char *>(
+                             &out[offset + strm->total_out]);
+        strm->avail_out = out.size() - offset - strm->total_out;
+        size_t total_in = strm->total_in;
+        size_t total_out = strm->total_out;
+        IQZIP_PROBE1(encode__start, strm->avail_in);
+        status = encode(strm, AEC_FLUSH);
+        IQZIP_PROBE2(encode__done, strm->total_in - total_in,
+                     strm->total_out - total_out);
+    }
+    out.resize(offset + strm->total_out);
+
+    encode_end(strm);
+    return status;
+}
+
+int
+codec_backend::decode_segment(aec_stream *strm, const char *in, size_t nbytes,
+                              char *out, size_t out_bytes)
+{
+    int status = decode_init(strm);
+    if (status != AEC_OK) {
+        return status;
+    }
+
+    /*
+     * The encoder pads the last block of a segment, so the output space
+     * limits the decoder to the samples of the segment.
+     */
+    strm->next_in = reinterpret_cast<const unsigned char *>(in);
+    strm->avail_in = nbytes;
+    strm->next_out = reinterpret_cast<unsigned char *>(out);
+    strm->avail_out = out_bytes;
+
+    IQZIP_PROBE1(decode__start, strm->avail_in);
+    status = decode(strm, AEC_FLUSH);
+    IQZIP_PROBE2(decode__done, strm->total_in, strm->total_out);
+    if (status == AEC_OK && strm->total_out != out_bytes) {
+        status = AEC_DATA_ERROR;
+    }
+    decode_end(strm);
+    return status;
+}
+
+/*
+ * CCSDS_LOSSLESS_COMPRESSION, coded by libaec
+ */
+class libaec_backend : public codec_backend {
+
+public:
+    int encode_init(aec_stream *strm)
+    {
+        return aec_encode_init(strm);
+    }
+
+    int encode(aec_stream *strm, int flush)
+    {
+        return aec_encode(strm, flush);
+    }
+
+    int encode_end(aec_stream *strm)
+    {
+        return aec_encode_end(strm);
+    }
+
+    int decode_init(aec_stream *strm)
+    {
+        return aec_decode_init(strm);
+    }
+
+    int decode(aec_stream *strm, int flush)
+    {
+        return aec_decode(strm, flush);
+    }
+
+    int decode_end(aec_stream *strm)
+    {
+        return aec_decode_end(strm);
+    }
+};
+
+/*
+ * NATIVE_LOSSLESS_COMPRESSION, coded by aec_native_encoder and
+ * aec_native_decoder. The bitstream is the one of libaec.
+ */
+class native_backend : public codec_backend {
+
+public:
+    int encode_init(aec_stream *strm)
+    {
+        return d_encoder.init(strm);
+    }
+
+    int encode(aec_stream *strm, int flush)
+    {
+        return d_encoder.encode(strm, flush);
+    }
+
+    int encode_end(aec_stream * /* strm */)
+    {
+        return AEC_OK;
+    }
+
+    int decode_init(aec_stream *strm)
+    {
+        return d_decoder.init(strm);
+    }
+
+    int decode(aec_stream *strm, int flush)
+    {
+        return d_decoder.decode(strm, flush);
+    }
+
+    int decode_end(aec_stream * /* strm */)
+    {
+        return AEC_OK;
+    }
+
+private:
+    aec_native_encoder d_encoder;
+    aec_native_decoder d_decoder;
+};
+
+/*
+ * The factories by technique identifier, with the built in backends
+ * registered on first use
+ */
+static std::map<uint8_t, codec_backend_factory> &
+backends(std::unique_lock<std::mutex> &lock)
+{
+    static std::mutex mtx;
+    static std::map<uint8_t, codec_backend_factory> factories = {
+        {
+            (uint8_t) header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION,
+            []() {
+                return codec_backend_sptr(new libaec_backend());
+            }
+        },
+        {
+            (uint8_t) header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION,
+            []() {
+                return codec_backend_sptr(new native_backend());
+            }
+        }
+    };
+    lock = std::unique_lock<std::mutex>(mtx);
+    return factories;
+}
+
+int
+register_codec_backend(uint8_t tech_id, codec_backend_factory factory)
+{
+    if (!factory) {
+        return -1;
+    }
+    std::unique_lock<std::mutex> lock;
+    backends(lock)[tech_id] = factory;
+    return 0;
+}
+
+codec_backend_sptr
+create_codec_backend(uint8_t tech_id)
+{
+    std::unique_lock<std::mutex> lock;
+    std::map<uint8_t, codec_backend_factory> &factories = backends(lock);
+    std::map<uint8_t, codec_backend_factory>::const_iterator it =
+        factories.find(tech_id);
+    if (it == factories.end()) {
+        return nullptr;
+    }
+    codec_backend_factory factory = it->second;
+    lock.unlock();
+    return factory();
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -72,6 +72,8 @@ compression_identification_packet::~compression_identification_packet()
 void
 compression_identification_packet::encode()
 {
+    // Fields are ORed into the buffers, so they must start cleared
+    memset(&d_source_data_fixed, 0, sizeof(source_data_fixed_t));
     encode_grouping_data_length(d_grouping_data_length);
     encode_compression_technique_id(d_compression_tech_id);
     encode_reference_sample_interval(d_reference_sample_interval);
@@ -84,6 +86,7 @@ compression_identification_packet::encode()
 void
 compression_identification_packet::encode_preprocessor()
 {
+    memset(&d_source_data_variable.preprocessor, 0, sizeof(preprocessor_t));
     encode_preprocessor_header();
     encode_preprocessor_status(d_preprocessor_status);
     encode_preprocessor_predictor_type(d_predictor_type);
@@ -97,6 +100,7 @@ compression_identification_packet::encode_preprocessor()
 void
 compression_identification_packet::encode_entropy_coder()
 {
+    memset(&d_source_data_variable.entropy_coder, 0, sizeof(entropy_coder_t));
     encode_entropy_coder_header();
     encode_entropy_coder_resolution_range(d_sample_resolution);
     encode_entropy_coder_cds_num(d_cds_per_packet);
@@ -465,8 +469,10 @@ compression_identification_packet::decode_preprocessor_data_sense() const
 uint8_t
 compression_identification_packet::decode_preprocessor_sample_resolution() const
 {
-    return (d_source_data_variable.preprocessor[1] &
-            PREPROCESSOR_SAMPLE_RESOLUTION_MASK);
+    uint8_t resolution = d_source_data_variable.preprocessor[1] &
+                         PREPROCESSOR_SAMPLE_RESOLUTION_MASK;
+    /* The 5 bit field holds 32 as 0 */
+    return resolution ? resolution : 32;
 }
 
 uint16_t
@@ -17,7 +17,16 @@
  */
 
 #include "compressor_impl.h"
+#include "async_sink.h"
+#include "probes.h"
+#include "spsc_ring.h"
+#include <iqzip/iqzip_container.h>
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace iqzip {
 
@@ -39,7 +48,12 @@ compressor_impl::compressor_impl(uint8_t version, uint8_t type,
                                  uint8_t sample_resolution,
                                  uint16_t cds_per_packet,
                                  uint8_t restricted_codes,
-                                 uint8_t endianness) :
+                                 uint8_t endianness,
+                                 uint32_t threads,
+                                 bool split_iq,
+                                 uint8_t predictor,
+                                 bool adaptive,
+                                 bool estimate_k) :
     iqzip_impl(version, type, sec_hdr_flag, apid, sequence_flags,
                sequence_count, packet_data_length,
                grouping_data_length, compression_tech_id,
@@ -47,76 +61,224 @@ compressor_impl::compressor_impl(uint8_t version, uint8_t type,
                predictor_type, mapper_type, block_size, data_sense,
                sample_resolution, cds_per_packet, restricted_codes,
                endianness),
-    d_tmp_stream(new char[sample_resolution * STREAM_CHUNK]),
+    d_tmp_stream_size(STREAM_CHUNK + block_size * sample_bytes()),
+    d_tmp_stream(new char[d_tmp_stream_size]),
     d_reference_samples_bytes((reference_sample_interval + 1) *
                               sample_resolution / 8 * block_size),
     d_stream_avail_in(0),
     d_out(new char[CHUNK]),
-    d_total_out(0)
-
+    d_out_chunk(CHUNK),
+    d_locked(false),
+    d_memory_locked(false),
+    d_ready(false),
+    d_threads(threads),
+    d_header_size(0)
 {
+    d_split_iq = split_iq;
+    d_predictor = predictor;
+    d_adaptive = adaptive;
+    d_estimate_k = estimate_k;
+    d_raw_segments = true;
 }
 
 compressor_impl::~compressor_impl()
 {
+    release_memory();
     delete[] d_tmp_stream;
+    delete[] d_out;
 }
 
 int
 compressor_impl::compress_init(const std::string fin,
                                const std::string fout)
 {
+    /* Open input & output file */
+    std::shared_ptr<file_source> in(new file_source(fin));
+    if (!in->is_open()) {
+        std::cout << "Error opening input file" << std::endl;
+        return -1;
+    }
+    std::shared_ptr<file_sink> out(new file_sink(fout));
+    if (!out->is_open()) {
+        std::cout << "Error opening output file" << std::endl;
+        return -1;
+    }
+    return compress_init(in, out);
+}
+
+int
+compressor_impl::compress_init(source_sptr in, sink_sptr out)
+{
+    d_ready = false;
+    d_source = in;
+    d_sink = out;
+    d_stats.reset();
+
+    /* Refuse the predictor before anything is set up or written */
+    if (d_predictor > (uint8_t)
+        header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS) {
+        std::cout << "Unknown native predictor " << (int) d_predictor
+                  << std::endl;
+        return -1;
+    }
+    if (d_predictor && d_sample_resolution > 24) {
+        std::cout << "Native predictors support up to 24 bit samples"
+                  << std::endl;
+        return -1;
+    }
+    if (d_predictor == (uint8_t)
+        header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS
+        && d_sample_resolution > 16) {
+        std::cout << "The complex NLMS predictor supports up to 16 bit samples"
+                  << std::endl;
+        return -1;
+    }
+
     /* Initialize libaec stream */
     init_aec_stream();
     /* Initialize libaec stream for compression */
-    int status = aec_encode_init(&d_strm);
+    d_encoder = encoder_backend();
+    int status = d_encoder ? d_encoder->encode_init(&d_strm) : AEC_CONF_ERROR;
     if (status != AEC_OK) {
         std::cout << "Error in initializing stream" << std::endl;
         print_error(status);
+        return status;
     }
 
-    /* Write header to compressed file */
-    d_ccsds_cip_hdr.write_header_to_file(fout);
-
-    /* Open input & output file */
-    input_stream.open(fin, std::ios::in | std::ios::binary);
-    if (!input_stream.is_open()) {
-        std::cout << "Error opening input file" << std::endl;
+    d_in.resize(CHUNK);
+
+    /* Write header to compressed file. Planes and predictors are per segment */
+    d_ccsds_cip_hdr.encode_iqzip_container_version(segmented() ?
+            (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::INDEXED :
+            (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM);
+    d_ccsds_cip_hdr.encode_iqzip_container_flags(
+        (d_split_iq ? IQZIP_CONTAINER_FLAG_SPLIT_IQ : 0)
+        | (d_adaptive ? IQZIP_CONTAINER_FLAG_ADAPTIVE : 0)
+        | (segmented() ? IQZIP_CONTAINER_FLAG_RAW_SEGMENTS : 0));
+    d_ccsds_cip_hdr.encode_iqzip_container_predictor(d_predictor);
+    d_header_size = write_header();
+    if (!d_header_size) {
+        std::cout << "Error writing output" << std::endl;
         return -1;
     }
-    output_stream.open(fout,
-                       std::ios::out | std::ios::app | std::ios::binary);
-    if (!output_stream.is_open()) {
-        std::cout << "Error opening output file" << std::endl;
+
+    d_ready = true;
+    return status;
+}
+
+bool
+compressor_impl::segmented() const
+{
+    return d_threads || d_split_iq || d_predictor || d_adaptive;
+}
+
+size_t
+compressor_impl::write_header()
+{
+    uint8_t hdr[IQZIP_MAX_HEADER_SIZE];
+    size_t hdr_size = d_ccsds_cip_hdr.write_header_to_buffer(hdr,
+                      IQZIP_MAX_HEADER_SIZE);
+    if (write_sink(reinterpret_cast<const char *>(hdr), hdr_size)) {
+        return 0;
+    }
+    return hdr_size;
+}
+
+size_t
+compressor_impl::compress_bound(size_t nbytes) const
+{
+    /* Every coded block fits its samples verbatim plus an option id byte,
+     * the last block is padded to a full block */
+    return IQZIP_MAX_HEADER_SIZE + nbytes + nbytes / d_block_size
+           + d_block_size * sample_bytes() + 8;
+}
+
+ssize_t
+compressor_impl::compress_buffer(const void *in, size_t nbytes, void *out,
+                                 size_t cap)
+{
+    unsigned char *dst = reinterpret_cast<unsigned char *>(out);
+    codec_backend_sptr encoder = encoder_backend();
+    aec_stream strm;
+    int status;
+
+    /* Buffers are always a single stream */
+    d_ccsds_cip_hdr.encode_iqzip_container_version(
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM);
+    d_ccsds_cip_hdr.encode_iqzip_container_flags(0);
+    d_ccsds_cip_hdr.encode_iqzip_container_predictor(0);
+    size_t hdr_size = d_ccsds_cip_hdr.write_header_to_buffer(dst, cap);
+    if (!hdr_size) {
+        std::cout << "Output buffer too small" << std::endl;
         return -1;
     }
 
-    return status;
+    init_aec_stream(&strm);
+    strm.next_in = reinterpret_cast<const unsigned char *>(in);
+    strm.avail_in = nbytes;
+    strm.next_out = dst + hdr_size;
+    strm.avail_out = cap - hdr_size;
+    status = encoder ? encoder->encode_init(&strm) : AEC_CONF_ERROR;
+    if (status != AEC_OK) {
+        std::cout << "Error in initializing stream" << std::endl;
+        print_error(status);
+        return -1;
+    }
+    uint64_t start = stream_stats::now();
+    IQZIP_PROBE1(encode__start, strm.avail_in);
+    status = encoder->encode(&strm, AEC_FLUSH);
+    IQZIP_PROBE2(encode__done, strm.total_in, strm.total_out);
+    d_stats.add_codec(start, strm.total_in, strm.total_out);
+    encoder->encode_end(&strm);
+    if (status != AEC_OK) {
+        std::cout << "Error in encoding" << std::endl;
+        print_error(status);
+        return -1;
+    }
+    /* A full output buffer may have cut the bitstream short */
+    if (strm.avail_out == 0) {
+        std::cout << "Output buffer too small" << std::endl;
+        return -1;
+    }
+    return hdr_size + strm.total_out;
 }
 
 int
 compressor_impl::compress()
 {
+    if (!d_ready) {
+        std::cout << "compress_init has not succeeded" << std::endl;
+        return -1;
+    }
+    if (segmented()) {
+        return compress_segmented();
+    }
+
     int total_out = 0;
     int input_avail = 1;
     int output_avail = 1;
     int status;
-    char *in = new char[CHUNK];
-    char *out = new char[CHUNK];
+    char *in = d_in.data();
+    char *out = d_out;
 
     d_strm.next_out = reinterpret_cast<unsigned char *>(out);
+    d_strm.avail_out = CHUNK;
 
     while (input_avail || output_avail) {
         if (d_strm.avail_in == 0 && input_avail) {
-            input_stream.read(in, CHUNK);
-            d_strm.avail_in = input_stream.gcount();
+            ssize_t avail = read_source(in, CHUNK);
+            if (avail < 0) {
+                std::cout << "Error reading input" << std::endl;
+                return -1;
+            }
+            d_strm.avail_in = avail;
             if (d_strm.avail_in != CHUNK) {
                 input_avail = 0;
             }
             d_strm.next_in = reinterpret_cast<const unsigned char *>(in);
         }
 
-        status = aec_encode(&d_strm, AEC_NO_FLUSH);
+        status = encode_step(AEC_NO_FLUSH);
         if (status != AEC_OK) {
             std::cout << "Error in encoding" << std::endl;
             print_error(status);
@@ -124,7 +286,10 @@ compressor_impl::compress()
         }
 
         if (d_strm.total_out - total_out > 0) {
-            output_stream.write(out, d_strm.total_out - total_out);
+            if (write_sink(out, d_strm.total_out - total_out)) {
+                std::cout << "Error writing output" << std::endl;
+                return -1;
+            }
             total_out = d_strm.total_out;
             output_avail = 1;
             d_strm.next_out = reinterpret_cast<unsigned char *>(out);
@@ -135,100 +300,396 @@ compressor_impl::compress()
         }
     }
 
-    status = aec_encode(&d_strm, AEC_FLUSH);
+    status = encode_step(AEC_FLUSH);
     if (status != AEC_OK) {
         std::cout << "ERROR: while flushing output" << std::endl;
         print_error(status);
         return -1;
     }
-    if (d_strm.total_out - total_out > 0) {
-        output_stream.write(out, d_strm.total_out - total_out);
+    if (d_strm.total_out - total_out > 0
+        && write_sink(out, d_strm.total_out - total_out)) {
+        std::cout << "Error writing output" << std::endl;
+        return -1;
     }
 
     return 0;
 }
 
+int
+compressor_impl::compress_segmented()
+{
+    struct segment {
+        std::vector<char> in;
+        std::vector<char> out;
+        uint64_t id;
+        bool done;
+        int status;
+    };
+
+    /* Keep every worker busy while the oldest segment is being written */
+    const uint32_t threads = d_threads ? d_threads : 1;
+    const size_t slots = 2 * threads;
+    const size_t nbytes = segment_samples() * sample_bytes();
+    std::vector<segment> ring(slots);
+    header::iqzip_segment_index index;
+    uint64_t offset = d_header_size;
+    std::deque<size_t> jobs;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+
+    for (uint32_t i = 0; i < threads; i++) {
+        workers.push_back(std::thread([&]() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                cv.wait(lock, [&]() {
+                    return stop || !jobs.empty();
+                });
+                if (jobs.empty()) {
+                    return;
+                }
+                segment &seg = ring[jobs.front()];
+                jobs.pop_front();
+                lock.unlock();
+                uint64_t start = stream_stats::now();
+                IQZIP_PROBE2(compress__segment__start, seg.id, seg.in.size());
+                int status = encode_segment(seg.in.data(), seg.in.size(),
+                                            seg.out);
+                IQZIP_PROBE3(compress__segment__done, seg.id, seg.out.size(),
+                             status);
+                d_stats.add_codec(start, seg.in.size(), seg.out.size());
+                lock.lock();
+                seg.status = status;
+                seg.done = true;
+                cv.notify_all();
+            }
+        }));
+    }
+
+    size_t next_read = 0;
+    size_t next_write = 0;
+    int input_avail = 1;
+    int status = AEC_OK;
+    while (status == AEC_OK && (input_avail || next_write < next_read)) {
+        if (input_avail && next_read - next_write < slots) {
+            segment &seg = ring[next_read % slots];
+            seg.in.resize(nbytes);
+            ssize_t read = read_source(seg.in.data(), nbytes);
+            if (read < 0) {
+                std::cout << "Error reading input" << std::endl;
+                status = -1;
+                break;
+            }
+            size_t avail = read;
+            if (avail != nbytes) {
+                input_avail = 0;
+            }
+            /* Drop the bytes of an incomplete trailing sample */
+            avail -= avail % sample_bytes();
+            if (avail == 0) {
+                continue;
+            }
+            seg.in.resize(avail);
+
+            std::lock_guard<std::mutex> lock(mtx);
+            seg.id = next_read;
+            seg.done = false;
+            jobs.push_back(next_read % slots);
+            next_read++;
+            cv.notify_all();
+            continue;
+        }
+
+        segment &seg = ring[next_write % slots];
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() {
+                return seg.done;
+            });
+        }
+        status = seg.status;
+        if (status != AEC_OK) {
+            std::cout << "Error in encoding" << std::endl;
+            print_error(status);
+            break;
+        }
+        header::iqzip_segment_header hdr(seg.out.size(),
+                                         seg.in.size() / sample_bytes());
+        if (write_sink(reinterpret_cast<const char *>(
+                           hdr.get_segment_header()), IQZIP_SEGMENT_HDR_SIZE)
+            || write_sink(seg.out.data(), seg.out.size())) {
+            std::cout << "Error writing output" << std::endl;
+            status = -1;
+            break;
+        }
+        offset += IQZIP_SEGMENT_HDR_SIZE;
+        index.add_segment(offset, seg.out.size(), hdr.decode_samples());
+        offset += seg.out.size();
+        next_write++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+        jobs.clear();
+    }
+    cv.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    if (status == AEC_OK) {
+        std::vector<uint8_t> footer;
+        index.encode(footer, offset);
+        if (write_sink(reinterpret_cast<const char *>(footer.data()),
+                       footer.size())) {
+            std::cout << "Error writing output" << std::endl;
+            status = -1;
+        }
+    }
+    return status;
+}
+
 int
 compressor_impl::stream_compress_init(const std::string fout)
+{
+    /* Open output file */
+    std::shared_ptr<file_sink> out(new file_sink(fout));
+    if (!out->is_open()) {
+        std::cout << "Error opening output file" << std::endl;
+        return -1;
+    }
+    return stream_compress_init(out);
+}
+
+int
+compressor_impl::stream_compress_init(sink_sptr out)
 {
     /* Initialize libaec stream */
     init_aec_stream();
     /* Initialize libaec stream for compression */
-    int status = aec_encode_init(&d_strm);
+    d_encoder = encoder_backend();
+    int status = d_encoder ? d_encoder->encode_init(&d_strm) : AEC_CONF_ERROR;
     if (status != AEC_OK) {
         std::cout << "Error in initializing stream" << std::endl;
         print_error(status);
     }
 
-    /* Write header to compressed file */
-    d_ccsds_cip_hdr.write_header_to_file(fout);
+    d_sink = out;
+    d_stream_avail_in = 0;
+    d_stats.reset();
+    reset_stream_latency();
+    release_memory();
+    d_out_chunk = CHUNK;
+
+    /* Write header to compressed file. Streams are never segmented */
+    d_ccsds_cip_hdr.encode_iqzip_container_version(
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM);
+    d_ccsds_cip_hdr.encode_iqzip_container_flags(0);
+    d_ccsds_cip_hdr.encode_iqzip_container_predictor(0);
+    d_header_size = write_header();
+    if (!d_header_size) {
+        std::cout << "Error writing output" << std::endl;
+        return -1;
+    }
+
+    return status;
+}
 
+int
+compressor_impl::stream_compress_init_realtime(const std::string fout,
+        size_t ring_size)
+{
     /* Open output file */
-    output_stream.open(fout, std::ios::out | std::ios::app | std::ios::binary);
-    if (!output_stream.is_open()) {
+    std::shared_ptr<file_sink> out(new file_sink(fout));
+    if (!out->is_open()) {
         std::cout << "Error opening output file" << std::endl;
         return -1;
     }
+    return stream_compress_init_realtime(out, ring_size);
+}
 
+int
+compressor_impl::stream_compress_init_realtime(sink_sptr out,
+        size_t ring_size)
+{
+    if (ring_size < 2) {
+        std::cout << "Ring size too small" << std::endl;
+        return -1;
+    }
+    std::shared_ptr<async_sink> writer(new async_sink(out, ring_size));
+    int status = stream_compress_init(writer);
+    if (status != AEC_OK) {
+        return status;
+    }
+
+    /* Every write must fit in the ring, even when it is half full */
+    d_out_chunk = std::min<size_t>(CHUNK, ring_size / 2);
+    /* Both buffers or none, so release_memory unlocks only what was locked */
+    d_locked = !lock_memory(d_tmp_stream, d_tmp_stream_size);
+    if (d_locked && lock_memory(d_out, d_out_chunk)) {
+        unlock_memory(d_tmp_stream, d_tmp_stream_size);
+        d_locked = false;
+    }
+    d_memory_locked = d_locked && writer->is_locked();
+    if (!d_memory_locked) {
+        std::cout << "Could not lock buffers in memory, check RLIMIT_MEMLOCK"
+                  << std::endl;
+    }
+    return status;
+}
+
+bool
+compressor_impl::memory_locked() const
+{
+    return d_memory_locked;
+}
+
+void
+compressor_impl::release_memory()
+{
+    if (d_locked) {
+        unlock_memory(d_tmp_stream, d_tmp_stream_size);
+        unlock_memory(d_out, d_out_chunk);
+        d_locked = false;
+    }
+    d_memory_locked = false;
+}
+
+int
+compressor_impl::encode_stream(const char *in, size_t nbytes, int flush)
+{
+    int status;
+
+    d_strm.next_in = reinterpret_cast<const unsigned char *>(in);
+    d_strm.avail_in = nbytes;
+    /* The encoder stops early only when d_out is full */
+    do {
+        d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
+        d_strm.avail_out = d_out_chunk;
+        status = encode_step(flush);
+        if (status != AEC_OK) {
+            std::cout << "Error in encoding" << std::endl;
+            print_error(status);
+            return status;
+        }
+        size_t produced = d_out_chunk - d_strm.avail_out;
+        if (produced && write_sink(d_out, produced)) {
+            std::cout << "Error writing output" << std::endl;
+            return -1;
+        }
+    }
+    while (d_strm.avail_out == 0);
+    return AEC_OK;
+}
+
+int
+compressor_impl::encode_step(int flush)
+{
+    const size_t total_in = d_strm.total_in;
+    const size_t total_out = d_strm.total_out;
+    uint64_t start = stream_stats::now();
+    IQZIP_PROBE1(encode__start, d_strm.avail_in);
+    int status = d_encoder->encode(&d_strm, flush);
+    IQZIP_PROBE2(encode__done, d_strm.total_in - total_in,
+                 d_strm.total_out - total_out);
+    d_call_ns[(int) STREAM_STAGE::CODEC] +=
+        d_stats.add_codec(start, d_strm.total_in - total_in,
+                          d_strm.total_out - total_out);
     return status;
 }
 
 int
 compressor_impl::stream_compress(const char *inbuf, size_t nbytes)
+{
+    begin_stream_call();
+    int status = stream_encode(inbuf, nbytes);
+    end_stream_call();
+    return status;
+}
+
+int
+compressor_impl::stream_encode(const char *inbuf, size_t nbytes)
 {
     int status;
-    /* Save input buffer to internal buffer */
+    /* Save small input buffers to internal buffer */
     if (d_stream_avail_in + nbytes < STREAM_CHUNK) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
+        stage_copy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
         d_stream_avail_in += nbytes;
-        d_strm.avail_in = d_stream_avail_in;
+        d_stats.add_stream_call(d_stream_avail_in);
         return AEC_OK;
     }
-    /* d_stream_avail_in + nbytes >= STREAM_CHUNK */
-    long int remainder = d_stream_avail_in + nbytes - STREAM_CHUNK;
-    while (remainder >= 0) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf,
-                    STREAM_CHUNK - d_stream_avail_in);
-        d_stream_avail_in = STREAM_CHUNK;
-        /* Ready aec_stream */
-        d_strm.avail_in = d_stream_avail_in;
-        d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
-        d_strm.next_in = reinterpret_cast<unsigned char *>(d_tmp_stream);
 
-        status = aec_encode(&d_strm, AEC_NO_FLUSH);
+    const size_t block_bytes = d_block_size * sample_bytes();
+    /* Complete the last staged block and encode the staged samples */
+    if (d_stream_avail_in) {
+        size_t fill = std::min(nbytes, (block_bytes
+                                        - d_stream_avail_in % block_bytes) % block_bytes);
+        stage_copy(&d_tmp_stream[d_stream_avail_in], inbuf, fill);
+        status = encode_stream(d_tmp_stream, d_stream_avail_in + fill,
+                               AEC_NO_FLUSH);
         if (status != AEC_OK) {
-            std::cout << "Error in encoding" << std::endl;
-            print_error(status);
             return status;
         }
-        if (d_strm.total_out - d_total_out > 0) {
-            /* Write encoded output to file */
-            output_stream.write(d_out, d_strm.total_out - d_total_out);
-            d_strm.avail_out = CHUNK;
-            d_total_out = d_strm.total_out;
-        }
-        inbuf += nbytes - remainder;
-        nbytes -= nbytes - remainder;
         d_stream_avail_in = 0;
-        d_strm.avail_in = d_stream_avail_in;
-        remainder = d_stream_avail_in + nbytes - STREAM_CHUNK;
+        inbuf += fill;
+        nbytes -= fill;
     }
-    /* If we have leftover samples copy them to stream */
-    if (nbytes) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
-        d_stream_avail_in = nbytes;
-        return AEC_OK;
+
+    /* Encode all whole blocks straight from the caller's buffer */
+    size_t direct = nbytes - nbytes % block_bytes;
+    if (direct) {
+        status = encode_stream(inbuf, direct, AEC_NO_FLUSH);
+        if (status != AEC_OK) {
+            return status;
+        }
     }
 
+    /* Keep the samples that do not fill a block for the next call */
+    stage_copy(d_tmp_stream, inbuf + direct, nbytes - direct);
+    d_stream_avail_in = nbytes - direct;
+    d_stats.add_stream_call(d_stream_avail_in);
     return AEC_OK;
 }
 
+codec_stats
+compressor_impl::get_stats()
+{
+    return d_stats.snapshot();
+}
+
+const latency_histogram &
+compressor_impl::get_latency(STREAM_STAGE stage) const
+{
+    return d_latency[(int) stage];
+}
+
+void
+compressor_impl::reset_latency()
+{
+    reset_stream_latency();
+}
+
 int
 compressor_impl::compress_fin()
 {
     int status;
 
-    status = aec_encode_end(&d_strm);
+    if (!d_ready) {
+        /* Only the files a failed compress_init opened are left to close */
+        if (d_source) {
+            d_source->close();
+            d_source.reset();
+        }
+        if (d_sink) {
+            d_sink->close();
+            d_sink.reset();
+        }
+        return -1;
+    }
+    d_ready = false;
+    status = d_encoder->encode_end(&d_strm);
     if (status != AEC_OK) {
         std::cout << "Error finishing stream" << std::endl;
         print_error(status);
@@ -238,10 +699,12 @@ compressor_impl::compress_fin()
     d_strm.next_out = nullptr;
     d_strm.state = nullptr;
 
-    input_stream.close();
-    output_stream.close();
+    d_source->close();
+    d_source.reset();
+    status = d_sink->close();
+    d_sink.reset();
 
-    return 0;
+    return status;
 }
 
 int
@@ -249,21 +712,14 @@ compressor_impl::stream_compress_fin()
 {
     int status;
 
-    d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
-    d_strm.next_in = reinterpret_cast<unsigned char *>(d_tmp_stream);
-    d_strm.avail_in = d_stream_avail_in;
-
-    status = aec_encode(&d_strm, AEC_FLUSH);
+    status = encode_stream(d_tmp_stream, d_stream_avail_in, AEC_FLUSH);
     if (status != AEC_OK) {
         std::cout << "ERROR: while flushing output" << std::endl;
-        print_error(status);
         return -1;
     }
-    if (d_strm.total_out - d_total_out > 0) {
-        output_stream.write(d_out, d_strm.total_out - d_total_out);
-    }
+    d_stream_avail_in = 0;
 
-    status = aec_encode_end(&d_strm);
+    status = d_encoder->encode_end(&d_strm);
     if (status != AEC_OK) {
         std::cout << "Error finishing stream" << std::endl;
         print_error(status);
@@ -274,10 +730,12 @@ compressor_impl::stream_compress_fin()
     d_strm.next_out = nullptr;
     d_strm.state = nullptr;
 
-    input_stream.close();
-    output_stream.close();
+    /* Real-time sinks write everything still queued before closing */
+    status = d_sink->close();
+    d_sink.reset();
+    release_memory();
 
-    return 0;
+    return status;
 }
 
 compressor_sptr
@@ -297,7 +755,11 @@ create_compressor(uint8_t version, uint8_t type,
                   uint8_t sample_resolution,
                   uint16_t cds_per_packet,
                   uint8_t restricted_codes,
-                  uint8_t endianness)
+                  uint8_t endianness,
+                  uint32_t threads,
+                  bool split_iq,
+                  uint8_t predictor,
+                  bool adaptive)
 {
     return std::shared_ptr<compressor>(new compressor_impl(version, type,
                                        sec_hdr_flag, apid, sequence_flags,
@@ -306,7 +768,50 @@ create_compressor(uint8_t version, uint8_t type,
                                        reference_sample_interval, preprocessor_status,
                                        predictor_type, mapper_type, block_size, data_sense,
                                        sample_resolution, cds_per_packet, restricted_codes,
-                                       endianness));
+                                       endianness, threads, split_iq, predictor, adaptive));
+}
+
+compressor_sptr
+create_compressor(COMPRESSION_LEVEL level, uint8_t sample_resolution,
+                  uint8_t data_sense, uint8_t endianness, uint32_t threads)
+{
+    uint8_t compression_tech_id = (uint8_t)
+                                  header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION;
+    uint16_t block_size = 16;
+    uint8_t restricted_codes = 0;
+    bool split_iq = false;
+    uint8_t predictor = (uint8_t)
+                        header::iqzip_compression_header::NATIVE_PREDICTOR::POLYNOMIAL_2;
+
+    if (level == COMPRESSION_LEVEL::FAST) {
+        block_size = 64;
+        /* Only legal up to 4 bits per sample */
+        restricted_codes = sample_resolution <= 4;
+        predictor = 0;
+    }
+    else if (sample_resolution > 24) {
+        split_iq = true;
+        predictor = 0;
+    }
+    /* The unit delay predictor of CCSDS runs unless a native one replaces it */
+    uint8_t predictor_type = predictor ?
+                             (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC :
+                             (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::UNIT_DELAY;
+
+    return std::shared_ptr<compressor>(new compressor_impl(
+                                           (uint8_t)header::PACKET_VERSION::CCSDS_PACKET_VERSION_1,
+                                           (uint8_t)header::PACKET_TYPE::CCSDS_TELECOMMAND,
+                                           (uint8_t)header::PACKET_SECONDARY_HEADER_FLAG::SEC_HDR_PRESENT,
+                                           (uint16_t)header::PACKET_APPLICATION_PROCESS_IDENTIFIER::IDLE_PACKET,
+                                           (uint8_t)header::PACKET_SEQUENCE_FLAGS::CONTINUATION_SEGMENT,
+                                           (uint16_t)0xdffe, (uint16_t)0x7efe, (uint16_t)0xffff,
+                                           compression_tech_id, (uint8_t)128, (uint8_t)1,
+                                           predictor_type,
+                                           (uint8_t)header::PREPROCESSOR_MAPPER_TYPE::PREDICTION_ERROR,
+                                           block_size, data_sense, sample_resolution, (uint16_t)1,
+                                           restricted_codes, endianness, threads, split_iq, predictor,
+                                           level == COMPRESSION_LEVEL::MAX,
+                                           level == COMPRESSION_LEVEL::FAST));
 }
 
 } // namespace compression
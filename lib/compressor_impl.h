@@ -30,6 +30,7 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "iqzip_impl.h"
 #include <iqzip/compressor.h>
@@ -42,11 +43,74 @@ class compressor_impl : public iqzip_impl, public compressor {
 
 private:
     uint32_t STREAM_CHUNK = 32768;
+    const size_t d_tmp_stream_size;
     char *d_tmp_stream;
     const uint32_t d_reference_samples_bytes;
     size_t d_stream_avail_in;
     char *d_out;
-    size_t d_total_out;
+    size_t d_out_chunk;
+    std::vector<char> d_in;
+    bool d_locked;
+    bool d_memory_locked;
+    /* Set by a successful compress_init, until compress_fin */
+    bool d_ready;
+    const uint32_t d_threads;
+    size_t d_header_size;
+    codec_backend_sptr d_encoder;
+
+    /*!
+     * Feeds nbytes of in to the stream encoder and hands all the output it
+     * produces to the sink, draining d_out as many times as needed. The
+     * encoder reads in directly, so the caller must keep it intact only for
+     * the duration of the call.
+     * @param in buffer to read samples from.
+     * @param nbytes number of bytes of in.
+     * @param flush AEC_FLUSH to terminate the stream, AEC_NO_FLUSH otherwise.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int encode_stream(const char *in, size_t nbytes, int flush);
+
+    /*!
+     * Calls the stream encoder once on d_strm, accounting the call in
+     * d_stats.
+     * @param flush AEC_FLUSH to terminate the stream, AEC_NO_FLUSH otherwise.
+     * @return the status of the encoder.
+     */
+    int encode_step(int flush);
+
+    /*!
+     * The work of stream_compress, timed by it.
+     * @param inbuf buffer to read samples from.
+     * @param nbytes number of bytes to read from buffer.
+     * @return 0 on success, !=0 otherwise.
+     */
+    int stream_encode(const char *inbuf, size_t nbytes);
+
+    /*!
+     * Unlocks the buffers locked by stream_compress_init_realtime.
+     */
+    void release_memory();
+
+    /*!
+     * Whether compress() writes a segmented file.
+     * @return true if threads, split_iq, a native predictor or adaptive
+     * segments were requested.
+     */
+    bool segmented() const;
+
+    /*!
+     * Splits the input file given in compress_init into segments, compresses
+     * them on d_threads worker threads, or one if d_threads is 0, and writes
+     * them in order to fout, followed by the segment index.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int compress_segmented();
+
+    /*!
+     * Writes the CCSDS header to d_sink.
+     * @return the size of the header in bytes, 0 if writing failed.
+     */
+    size_t write_header();
 
 public:
 
@@ -73,6 +137,18 @@ public:
      * @param cds_per_packet Secondary header number of CDSes per packet.
      * @param restricted_codes Secondary header restricted codes.
      * @param endianness Endianness of samples.
+     * @param threads Number of threads used by compress(). 0 produces a single
+     * aec bitstream, otherwise the input is compressed into a segmented file.
+     * @param split_iq Code the I and Q planes of every segment separately.
+     * compress() then always writes a segmented file.
+     * @param predictor The NATIVE_PREDICTOR of the segments. compress() then
+     * always writes a segmented file.
+     * @param adaptive Pick the block size, reference sample interval,
+     * predictor and plane split of every segment separately. compress() then
+     * always writes a segmented file.
+     * @param estimate_k Estimate the k of every block from its sum instead
+     * of searching it, with the native encoder only. Faster, a little
+     * larger and no longer the bitstream of libaec.
      */
     compressor_impl(uint8_t version, uint8_t type, uint8_t sec_hdr_flag,
                     uint16_t apid, uint8_t sequence_flags,
@@ -82,7 +158,9 @@ public:
                     uint8_t predictor_type, uint8_t mapper_type, uint16_t block_size,
                     uint8_t data_sense, uint8_t sample_resolution,
                     uint16_t cds_per_packet, uint8_t restricted_codes,
-                    uint8_t endianness);
+                    uint8_t endianness, uint32_t threads, bool split_iq,
+                    uint8_t predictor, bool adaptive = false,
+                    bool estimate_k = false);
 
     /*!
      * Default destructor. Calls compression_header destructor.
@@ -100,6 +178,15 @@ public:
      */
     int compress_init(const std::string fin, const std::string fout);
 
+    /*!
+     * Initializes necessary variables for compression from in to out. The
+     * CCSDS header is written to out.
+     * @param in the source to read samples from.
+     * @param out the sink to write the compressed data to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int compress_init(source_sptr in, sink_sptr out);
+
     /*!
      * Initializes necessary variables for stream compression. Should always be called
      * before stream compressing. It opens the fout file and the CCSDS header is written.
@@ -109,9 +196,50 @@ public:
      */
     int stream_compress_init(const std::string fout);
 
+    /*!
+     * Initializes necessary variables for stream compression to out. The
+     * CCSDS header is written to out and every compressed chunk is handed to
+     * it straight from the encoder output buffer.
+     * @param out the sink to write the compressed data to.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    int stream_compress_init(sink_sptr out);
+
+    /*!
+     * Initializes stream compression in real-time mode. The output file is
+     * written by a separate writer thread, fed through a ring of ring_size
+     * bytes. Every buffer is allocated here and locked in memory, so
+     * stream_compress makes no heap allocation and no blocking system call.
+     * @param fout Name of output file.
+     * @param ring_size size of the ring between stream_compress and the
+     * writer thread in bytes.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    int stream_compress_init_realtime(const std::string fout,
+                                      size_t ring_size);
+
+    /*!
+     * Initializes stream compression in real-time mode to out. The sink is
+     * called from the writer thread.
+     * @param out the sink to write the compressed data to.
+     * @param ring_size size of the ring between stream_compress and the
+     * writer thread in bytes.
+     * @return 0 on succes, != 0 otherwise.
+     */
+    int stream_compress_init_realtime(sink_sptr out, size_t ring_size);
+
+    /*!
+     * Whether stream_compress_init_realtime locked every buffer of the
+     * stream, its own and the ring of the writer thread, in memory.
+     * @return true if the buffers are locked.
+     */
+    bool memory_locked() const;
+
     /*!
      * Reads the input file given in compress_init, compresses it, and
-     * writes the results to fout given in compress_init.
+     * writes the results to fout given in compress_init. If the compressor
+     * was created with threads, the segments of the input are compressed in
+     * parallel.
      * @return 0 on success, != 0 otherwise.
      */
     int compress();
@@ -120,12 +248,55 @@ public:
      * Reads the buffer inbuf and when block size samples are read, compresses
      * and writes them to fout file given in stream_compress_init.
      * The bytes passed to stream compress must be a multiple of sample size.
+     * Small buffers are gathered internally up to STREAM_CHUNK bytes. Larger
+     * ones are encoded in place, only the tail that does not fill a whole
+     * block is copied and kept for the next call.
      * @param inbuf buffer to read samples from.
      * @param nbytes number of bytes to read from buffer.
      * @return 0 on success, !=0 otherwise.
      */
     int stream_compress(const char *inbuf, size_t nbytes);
 
+    /*!
+     * Compresses the nbytes bytes of in into out as a single stream, CCSDS
+     * header included. No file is involved.
+     * @param in buffer to read samples from.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the compressed data to.
+     * @param cap size of out in bytes.
+     * @return the number of bytes written to out, < 0 on error or if out is
+     * too small.
+     */
+    ssize_t compress_buffer(const void *in, size_t nbytes, void *out,
+                            size_t cap);
+
+    /*!
+     * The largest size compress_buffer may need for nbytes of input.
+     * @param nbytes number of bytes of input.
+     * @return the required capacity of the output buffer in bytes.
+     */
+    size_t compress_bound(size_t nbytes) const;
+
+    /*!
+     * The counters of the stream, reset by compress_init and
+     * stream_compress_init. Safe to call from any thread.
+     * @return a snapshot of the counters.
+     */
+    codec_stats get_stats();
+
+    /*!
+     * The latency histogram of a stage of stream_compress, reset by
+     * stream_compress_init and reset_latency.
+     * @param stage the stage.
+     * @return the histogram
+     */
+    const latency_histogram &get_latency(STREAM_STAGE stage) const;
+
+    /*!
+     * Zeroes the latency histograms of every stage.
+     */
+    void reset_latency();
+
     /*!
      * Finalizes the compression and clears aec_stream. Should always be called
      * after compress otherwise output file may not be written correctly.
@@ -17,33 +17,72 @@
  */
 
 #include "decompressor_impl.h"
+#include "aec_scanner.h"
+#include "probes.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace iqzip {
 
 namespace compression {
 
-decompressor_impl::decompressor_impl() :
+decompressor_impl::decompressor_impl(uint32_t threads, bool native) :
     iqzip_impl(),
     d_iqzip_header_size(0),
     d_tmp_stream(new char[STREAM_CHUNK]),
     d_stream_avail_in(0),
     d_out(new char[CHUNK]),
-    d_total_out(0)
+    d_threads(threads),
+    d_bit_offsets(false)
 {
+    d_native_decoder = native;
 }
 
 decompressor_impl::~decompressor_impl()
 {
+    delete[] d_tmp_stream;
+    delete[] d_out;
 }
 
 int
 decompressor_impl::decompress_init(const std::string fin,
                                    const std::string fout)
 {
-    /* Read header and save options to class fields */
-    d_iqzip_header_size = d_ccsds_cip_hdr.parse_header_from_file(fin);
+    int status = decompress_init(fin);
+    if (status != AEC_OK) {
+        return status;
+    }
+    d_fout = fout;
+
+    /* Open output file */
+    std::shared_ptr<file_sink> out(new file_sink(fout));
+    if (!out->is_open()) {
+        std::cout << "Error opening output file" << std::endl;
+        return -1;
+    }
+    d_sink = out;
+    return status;
+}
+
+int
+decompressor_impl::decompress_init(source_sptr in, sink_sptr out)
+{
+    d_fin.clear();
+    d_fout.clear();
+    d_sink = out;
+    return init_source(in);
+}
+
+void
+decompressor_impl::decode_header()
+{
     d_version = d_ccsds_cip_hdr.decode_version();
     d_type = d_ccsds_cip_hdr.decode_type();
     d_sec_hdr_flag = d_ccsds_cip_hdr.decode_secondary_header_flag();
@@ -65,27 +104,80 @@ decompressor_impl::decompress_init(const std::string fin,
     d_restricted_codes =
         d_ccsds_cip_hdr.decode_extended_parameters_restricted_code_option();
     d_endianness = d_ccsds_cip_hdr.decode_iqzip_header_endianess();
+    d_split_iq = d_ccsds_cip_hdr.decode_iqzip_container_flags()
+                 & IQZIP_CONTAINER_FLAG_SPLIT_IQ;
+    d_adaptive = d_ccsds_cip_hdr.decode_iqzip_container_flags()
+                 & IQZIP_CONTAINER_FLAG_ADAPTIVE;
+    d_raw_segments = d_ccsds_cip_hdr.decode_iqzip_container_flags()
+                     & IQZIP_CONTAINER_FLAG_RAW_SEGMENTS;
+    d_predictor = 0;
+    if (d_predictor_type == (uint8_t)
+        compression::header::PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC) {
+        d_predictor = d_ccsds_cip_hdr.decode_iqzip_container_predictor();
+    }
+}
 
-    /* Initialize libaec stream */
-    init_aec_stream();
-
-    /* Open input & output file */
-    input_stream.open(fin, std::ios::in | std::ios::binary);
-    if (!input_stream.is_open()) {
+int
+decompressor_impl::decompress_init(const std::string fin)
+{
+    /* Open input file */
+    std::shared_ptr<file_source> in(new file_source(fin));
+    if (!in->is_open()) {
         std::cout << "Error opening input file" << std::endl;
         return -1;
     }
-    output_stream.open(fout, std::ios::out | std::ios::binary);
-    if (!output_stream.is_open()) {
-        std::cout << "Error opening output file" << std::endl;
+    d_fin = fin;
+    return init_source(in);
+}
+
+int
+decompressor_impl::init_source(source_sptr in)
+{
+    char hdr[IQZIP_MAX_HEADER_SIZE];
+
+    /* Read header and save options to class fields */
+    d_source = in;
+    d_stats.reset();
+    reset_stream_latency();
+    ssize_t avail = read_source(hdr, IQZIP_MAX_HEADER_SIZE);
+    d_iqzip_header_size = avail < 0 ? 0 :
+                          d_ccsds_cip_hdr.parse_header_from_buffer(
+                              reinterpret_cast<uint8_t *>(hdr), avail);
+    if (!d_iqzip_header_size) {
+        std::cout << "Error reading header" << std::endl;
         return -1;
     }
+    decode_header();
+
+    /* Initialize libaec stream */
+    init_aec_stream();
+
+    /* Skip header. Sources that cannot seek keep the bytes read past it */
+    d_pending.clear();
+    if (d_source->seek(d_iqzip_header_size)) {
+        d_pending.assign(hdr + d_iqzip_header_size, hdr + avail);
+    }
 
-    /* Skip header from file */
-    input_stream.seekg(d_iqzip_header_size);
+    /* Locate the segments of segmented files */
+    if (d_ccsds_cip_hdr.decode_iqzip_container_version() !=
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM) {
+        if (load_segment_index()) {
+            std::cout << "Error reading segment index" << std::endl;
+            return -1;
+        }
+    }
+    else if (load_sidecar_index()) {
+        std::cout << "Sidecar index does not match input file, ignoring it"
+                  << std::endl;
+        d_segments.clear();
+        d_bit_offsets = false;
+    }
 
     /* Initialize libaec stream for decompression */
-    int status = aec_decode_init(&d_strm);
+    d_in.resize(CHUNK);
+    d_stream_avail_in = 0;
+    d_decoder = decoder_backend();
+    int status = d_decoder ? d_decoder->decode_init(&d_strm) : AEC_CONF_ERROR;
     if (status != AEC_OK) {
         std::cout << "Error in initializing stream" << std::endl;
         print_error(status);
@@ -93,29 +185,231 @@ decompressor_impl::decompress_init(const std::string fin,
     return status;
 }
 
+int
+decompressor_impl::load_segment_index()
+{
+    d_segments.clear();
+
+    if (d_ccsds_cip_hdr.decode_iqzip_container_version() ==
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::INDEXED) {
+        header::iqzip_segment_index::trailer_t trailer;
+        uint64_t index_offset;
+        uint32_t segments;
+
+        int64_t size = d_source->size();
+        if (size < IQZIP_TRAILER_SIZE
+            || d_source->seek(size - IQZIP_TRAILER_SIZE)
+            || read_source(reinterpret_cast<char *>(trailer),
+                           IQZIP_TRAILER_SIZE) != IQZIP_TRAILER_SIZE
+            || !header::iqzip_segment_index::decode_trailer(trailer,
+                    &index_offset, &segments)) {
+            return -1;
+        }
+        /* The index must fill the file up to the trailer exactly, so a
+         * corrupt segment count cannot size the allocation below */
+        if (index_offset > (uint64_t) size
+            || (uint64_t) size - index_offset
+            != (uint64_t) segments * IQZIP_INDEX_ENTRY_SIZE
+            + IQZIP_TRAILER_SIZE) {
+            return -1;
+        }
+        std::vector<uint8_t> entries((size_t) segments
+                                     * IQZIP_INDEX_ENTRY_SIZE);
+        if (d_source->seek(index_offset)
+            || read_source(reinterpret_cast<char *>(entries.data()),
+                           entries.size()) != (ssize_t) entries.size()) {
+            return -1;
+        }
+        d_segments.decode_entries(entries.data(), segments);
+    }
+    else {
+        header::iqzip_segment_header hdr;
+        uint64_t offset = d_iqzip_header_size;
+        while (true) {
+            if (d_source->seek(offset)) {
+                return -1;
+            }
+            ssize_t avail = read_source(reinterpret_cast<char *>(
+                                            hdr.get_segment_header()), IQZIP_SEGMENT_HDR_SIZE);
+            if (avail == 0) {
+                break;
+            }
+            if (avail != IQZIP_SEGMENT_HDR_SIZE) {
+                return -1;
+            }
+            offset += IQZIP_SEGMENT_HDR_SIZE;
+            d_segments.add_segment(offset, hdr.decode_compressed_bytes(),
+                                   hdr.decode_samples());
+            offset += hdr.decode_compressed_bytes();
+        }
+    }
+
+    return d_source->seek(d_iqzip_header_size);
+}
+
+int
+decompressor_impl::load_sidecar_index()
+{
+    d_segments.clear();
+    d_bit_offsets = false;
+
+    /* Sidecars are named after the input file */
+    if (d_fin.empty()) {
+        return 0;
+    }
+    std::ifstream sidecar(d_fin + IQZIP_SIDECAR_SUFFIX,
+                          std::ios::in | std::ios::binary);
+    if (!sidecar.is_open()) {
+        return 0;
+    }
+
+    header::iqzip_segment_index::trailer_t trailer;
+    uint64_t index_offset;
+    uint32_t segments;
+    sidecar.seekg(0, std::ios::end);
+    const int64_t sidecar_size = sidecar.tellg();
+    sidecar.seekg(-IQZIP_TRAILER_SIZE, std::ios::end);
+    sidecar.read(reinterpret_cast<char *>(trailer), IQZIP_TRAILER_SIZE);
+    if (!sidecar
+        || !header::iqzip_segment_index::decode_trailer(trailer, &index_offset,
+                &segments, IQZIP_SIDECAR_MAGIC)) {
+        return -1;
+    }
+    /* As in load_segment_index, the entries must fill the sidecar */
+    if (index_offset > (uint64_t) sidecar_size
+        || (uint64_t) sidecar_size - index_offset
+        != (uint64_t) segments * IQZIP_INDEX_ENTRY_SIZE + IQZIP_TRAILER_SIZE) {
+        return -1;
+    }
+    std::vector<uint8_t> entries((size_t) segments * IQZIP_INDEX_ENTRY_SIZE);
+    sidecar.seekg(index_offset);
+    sidecar.read(reinterpret_cast<char *>(entries.data()), entries.size());
+    if (!sidecar) {
+        return -1;
+    }
+    d_segments.decode_entries(entries.data(), segments);
+    d_bit_offsets = true;
+
+    /* The last segment ends at the end of the file it was built for */
+    int64_t size = d_source->size();
+    if (segments) {
+        const header::iqzip_segment_index::index_entry_t &last =
+            d_segments.get_entries().back();
+        if ((int64_t)(segment_position(last) + last.compressed_bytes) != size) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+uint64_t
+decompressor_impl::segment_position(
+    const header::iqzip_segment_index::index_entry_t &seg) const
+{
+    return d_bit_offsets ? seg.offset / 8 : seg.offset;
+}
+
+void
+decompressor_impl::align_segment(
+    const header::iqzip_segment_index::index_entry_t &seg,
+    std::vector<char> &in) const
+{
+    const uint32_t shift = d_bit_offsets ? seg.offset % 8 : 0;
+    if (!shift || in.empty()) {
+        return;
+    }
+    uint8_t *p = reinterpret_cast<uint8_t *>(in.data());
+    for (size_t i = 0; i + 1 < in.size(); i++) {
+        p[i] = (p[i] << shift) | (p[i + 1] >> (8 - shift));
+    }
+    p[in.size() - 1] <<= shift;
+}
+
+int
+decompressor_impl::build_index()
+{
+    if (d_ccsds_cip_hdr.decode_iqzip_container_version() !=
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM) {
+        std::cout << "Segmented files carry their own index" << std::endl;
+        return -1;
+    }
+    if (d_fin.empty()) {
+        std::cout << "Sidecar indexes require an input file" << std::endl;
+        return -1;
+    }
+
+    aec_stream strm;
+    init_aec_stream(&strm);
+    aec_scanner scanner(strm);
+    std::vector<aec_scanner::rsi_group_t> groups;
+    const uint32_t rsi_samples = strm.rsi * strm.block_size;
+
+    if (d_source->seek(d_iqzip_header_size)
+        || scanner.scan(*d_source, segment_samples() / rsi_samples, groups)) {
+        std::cout << "Error scanning input file" << std::endl;
+        return -1;
+    }
+    const uint64_t end = (uint64_t) d_source->size() * 8;
+    d_source->seek(d_iqzip_header_size);
+
+    d_segments.clear();
+    for (size_t i = 0; i < groups.size(); i++) {
+        uint64_t offset = d_iqzip_header_size * 8 + groups[i].bit_offset;
+        uint64_t next = i + 1 < groups.size()
+                        ? d_iqzip_header_size * 8 + groups[i + 1].bit_offset : end;
+        d_segments.add_segment(offset, (offset % 8 + next - offset + 7) / 8,
+                               groups[i].blocks * strm.block_size);
+    }
+    d_bit_offsets = true;
+
+    std::vector<uint8_t> buf;
+    d_segments.encode(buf, 0, IQZIP_SIDECAR_MAGIC);
+    std::ofstream sidecar(d_fin + IQZIP_SIDECAR_SUFFIX,
+                          std::ios::out | std::ios::binary);
+    sidecar.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+    if (!sidecar) {
+        std::cout << "Error writing sidecar index" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
 int
 decompressor_impl::decompress()
 {
+    if (d_ccsds_cip_hdr.decode_iqzip_container_version() !=
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM) {
+        return d_threads ? decompress_parallel() : decompress_segmented();
+    }
+    if (d_bit_offsets && d_threads) {
+        return decompress_parallel();
+    }
+
     int total_out = 0;
     int input_avail = 1;
     int output_avail = 1;
     int status;
-    char *in = new char[CHUNK];
-    char *out = new char[CHUNK];
+    char *in = d_in.data();
+    char *out = d_out;
 
     d_strm.next_out = reinterpret_cast<unsigned char *>(out);
+    d_strm.avail_out = CHUNK;
 
     while (input_avail || output_avail) {
         if (d_strm.avail_in == 0 && input_avail) {
-            input_stream.read(in, CHUNK);
-            d_strm.avail_in = input_stream.gcount();
+            ssize_t avail = read_input(in, CHUNK);
+            if (avail < 0) {
+                std::cout << "Error reading input" << std::endl;
+                return -1;
+            }
+            d_strm.avail_in = avail;
             if (d_strm.avail_in != CHUNK) {
                 input_avail = 0;
             }
             d_strm.next_in = reinterpret_cast<const unsigned char *>(in);
         }
 
-        status = aec_decode(&d_strm, AEC_NO_FLUSH);
+        status = decode_step();
         if (status != AEC_OK) {
             std::cout << "Error in decoding" << std::endl;
             print_error(status);
@@ -123,7 +417,10 @@ decompressor_impl::decompress()
         }
 
         if (d_strm.total_out - total_out > 0) {
-            output_stream.write(out, d_strm.total_out - total_out);
+            if (write_sink(out, d_strm.total_out - total_out)) {
+                std::cout << "Error writing output" << std::endl;
+                return -1;
+            }
             total_out = d_strm.total_out;
             output_avail = 1;
             d_strm.next_out = reinterpret_cast<unsigned char *>(out);
@@ -136,64 +433,422 @@ decompressor_impl::decompress()
     return 0;
 }
 
+int
+decompressor_impl::decompress_segmented()
+{
+    std::vector<char> in;
+    std::vector<char> out;
+    uint64_t id = 0;
+    int status;
+
+    for (const header::iqzip_segment_index::index_entry_t &seg :
+         d_segments.get_entries()) {
+        in.resize(seg.compressed_bytes);
+        if (d_source->seek(segment_position(seg))
+            || read_source(in.data(), in.size()) != (ssize_t) in.size()) {
+            std::cout << "Error reading segment" << std::endl;
+            return -1;
+        }
+        align_segment(seg, in);
+        out.resize(seg.samples * sample_bytes());
+
+        uint64_t start = stream_stats::now();
+        IQZIP_PROBE2(decompress__segment__start, id, in.size());
+        status = decode_segment(in.data(), in.size(), out.data(), out.size());
+        IQZIP_PROBE3(decompress__segment__done, id, out.size(), status);
+        d_stats.add_codec(start, in.size(), out.size());
+        id++;
+        if (status != AEC_OK) {
+            std::cout << "Error in decoding" << std::endl;
+            print_error(status);
+            return status;
+        }
+        if (write_sink(out.data(), out.size())) {
+            std::cout << "Error writing output" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+decompressor_impl::decompress_parallel()
+{
+    const std::vector<header::iqzip_segment_index::index_entry_t> &entries =
+        d_segments.get_entries();
+    const size_t bytes = sample_bytes();
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next(0);
+    std::atomic<int> status(AEC_OK);
+
+    /* Workers write straight to the output file, so it must be a file */
+    if (d_fin.empty() || d_fout.empty()) {
+        return decompress_segmented();
+    }
+
+    /* Nothing goes through the sink, the workers write directly */
+    d_sink->close();
+    int in_fd = open(d_fin.c_str(), O_RDONLY);
+    int out_fd = open(d_fout.c_str(), O_WRONLY);
+    if (in_fd < 0 || out_fd < 0) {
+        std::cout << "Error opening input or output file" << std::endl;
+        if (in_fd >= 0) {
+            close(in_fd);
+        }
+        if (out_fd >= 0) {
+            close(out_fd);
+        }
+        return -1;
+    }
+    off_t size = d_segments.total_samples() * bytes;
+    if (size && posix_fallocate(out_fd, 0, size) && ftruncate(out_fd, size)) {
+        std::cout << "Error allocating output file" << std::endl;
+        close(in_fd);
+        close(out_fd);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < d_threads; i++) {
+        workers.push_back(std::thread([&]() {
+            std::vector<char> in;
+            std::vector<char> out;
+            for (size_t j = next++; j < entries.size() && status == AEC_OK;
+                 j = next++) {
+                const header::iqzip_segment_index::index_entry_t &seg = entries[j];
+                in.resize(seg.compressed_bytes);
+                out.resize(seg.samples * bytes);
+                uint64_t start = stream_stats::now();
+                if (pread(in_fd, in.data(), in.size(), segment_position(seg))
+                    != (ssize_t) in.size()) {
+                    status = -1;
+                    break;
+                }
+                d_stats.add_io(start);
+                align_segment(seg, in);
+                start = stream_stats::now();
+                IQZIP_PROBE2(decompress__segment__start, j, in.size());
+                int ret = decode_segment(in.data(), in.size(), out.data(),
+                                         out.size());
+                IQZIP_PROBE3(decompress__segment__done, j, out.size(), ret);
+                d_stats.add_codec(start, in.size(), out.size());
+                if (ret != AEC_OK) {
+                    status = ret;
+                    break;
+                }
+                start = stream_stats::now();
+                IQZIP_PROBE1(write__start, out.size());
+                ssize_t written = pwrite(out_fd, out.data(), out.size(),
+                                         seg.first_sample * bytes);
+                IQZIP_PROBE2(write__done, out.size(),
+                             written == (ssize_t) out.size() ? 0 : -1);
+                if (written != (ssize_t) out.size()) {
+                    status = -1;
+                    break;
+                }
+                d_stats.add_io(start);
+            }
+        }));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    close(in_fd);
+    close(out_fd);
+
+    if (status != AEC_OK) {
+        std::cout << "Error in decoding" << std::endl;
+        print_error(status);
+    }
+    return status;
+}
+
+int
+decompressor_impl::decompress_range(uint64_t first_sample, uint64_t count,
+                                    void *out)
+{
+    const std::vector<header::iqzip_segment_index::index_entry_t> &entries =
+        d_segments.get_entries();
+    const size_t bytes = sample_bytes();
+    char *dst = reinterpret_cast<char *>(out);
+    std::vector<char> in;
+    std::vector<char> edge;
+    int status;
+
+    if (entries.empty()) {
+        std::cout << "Random access requires a segmented file or a sidecar index"
+                  << std::endl;
+        return -1;
+    }
+    if (first_sample + count > d_segments.total_samples()) {
+        std::cout << "Requested samples exceed the end of file" << std::endl;
+        return -1;
+    }
+
+    uint64_t sample = first_sample;
+    for (size_t i = d_segments.find_segment(first_sample);
+         sample < first_sample + count; i++) {
+        const header::iqzip_segment_index::index_entry_t &seg = entries[i];
+        /* Decode only up to the last requested sample of the segment */
+        uint64_t skip = sample - seg.first_sample;
+        uint64_t end = std::min<uint64_t>(first_sample + count - seg.first_sample,
+                                          seg.samples);
+
+        in.resize(seg.compressed_bytes);
+        if (d_source->seek(segment_position(seg))
+            || read_source(in.data(), in.size()) != (ssize_t) in.size()) {
+            std::cout << "Error reading segment" << std::endl;
+            return -1;
+        }
+        align_segment(seg, in);
+
+        /* The Q plane of a split segment follows all of its I plane, the
+         * complex predictor restores whole I/Q pairs. Adaptive segments may
+         * do either */
+        uint64_t decoded = d_split_iq || d_adaptive ? seg.samples : end;
+        if (d_predictor == (uint8_t)
+            header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS) {
+            decoded = std::min<uint64_t>(decoded + (decoded & 1), seg.samples);
+        }
+        uint64_t start = stream_stats::now();
+        IQZIP_PROBE2(decompress__segment__start, i, in.size());
+        if (raw_segment(in.size(), seg.samples * bytes)) {
+            std::memcpy(dst, &in[skip * bytes], (end - skip) * bytes);
+            status = AEC_OK;
+        }
+        else if (skip || decoded != end) {
+            edge.resize(decoded * bytes);
+            status = decode_segment(in.data(), in.size(), edge.data(), edge.size());
+            std::memcpy(dst, &edge[skip * bytes], (end - skip) * bytes);
+        }
+        else {
+            status = decode_segment(in.data(), in.size(), dst, end * bytes);
+        }
+        IQZIP_PROBE3(decompress__segment__done, i, (end - skip) * bytes,
+                     status);
+        d_stats.add_codec(start, in.size(), (end - skip) * bytes);
+        if (status != AEC_OK) {
+            std::cout << "Error in decoding" << std::endl;
+            print_error(status);
+            return status;
+        }
+        dst += (end - skip) * bytes;
+        sample += end - skip;
+    }
+    return 0;
+}
+
+ssize_t
+decompressor_impl::decompress_buffer(const void *in, size_t nbytes,
+                                     void *out, size_t cap)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(in);
+    char *dst = reinterpret_cast<char *>(out);
+    int status;
+
+    size_t hdr_size = d_ccsds_cip_hdr.parse_header_from_buffer(src, nbytes);
+    if (!hdr_size) {
+        std::cout << "Error reading header" << std::endl;
+        return -1;
+    }
+    decode_header();
+
+    uint8_t container = d_ccsds_cip_hdr.decode_iqzip_container_version();
+    if (container ==
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::SINGLE_STREAM) {
+        aec_stream strm;
+        codec_backend_sptr decoder = decoder_backend();
+        init_aec_stream(&strm);
+        strm.next_in = src + hdr_size;
+        strm.avail_in = nbytes - hdr_size;
+        strm.next_out = reinterpret_cast<unsigned char *>(dst);
+        strm.avail_out = cap;
+        status = decoder ? decoder->decode_init(&strm) : AEC_CONF_ERROR;
+        if (status != AEC_OK) {
+            std::cout << "Error in initializing stream" << std::endl;
+            print_error(status);
+            return -1;
+        }
+        uint64_t start = stream_stats::now();
+        IQZIP_PROBE1(decode__start, strm.avail_in);
+        status = decoder->decode(&strm, AEC_FLUSH);
+        IQZIP_PROBE2(decode__done, strm.total_in, strm.total_out);
+        d_stats.add_codec(start, strm.total_in, strm.total_out);
+        decoder->decode_end(&strm);
+        if (status != AEC_OK) {
+            std::cout << "Error in decoding" << std::endl;
+            print_error(status);
+            return -1;
+        }
+        if (strm.avail_out == 0 && strm.avail_in) {
+            std::cout << "Output buffer too small" << std::endl;
+            return -1;
+        }
+        return strm.total_out;
+    }
+
+    /* Segments run up to the index of indexed files */
+    size_t end = nbytes;
+    if (container ==
+        (uint8_t) header::iqzip_compression_header::CONTAINER_VERSION::INDEXED) {
+        uint64_t index_offset;
+        uint32_t segments;
+        /* The index follows the header and fills the buffer up to the
+         * trailer exactly */
+        if (nbytes < hdr_size + IQZIP_TRAILER_SIZE
+            || !header::iqzip_segment_index::decode_trailer(
+                &src[nbytes - IQZIP_TRAILER_SIZE], &index_offset, &segments)
+            || index_offset < hdr_size || index_offset > nbytes
+            || nbytes - index_offset
+            != (uint64_t) segments * IQZIP_INDEX_ENTRY_SIZE
+            + IQZIP_TRAILER_SIZE) {
+            std::cout << "Error reading segment index" << std::endl;
+            return -1;
+        }
+        end = index_offset;
+    }
+
+    header::iqzip_segment_header hdr;
+    size_t offset = hdr_size;
+    size_t total_out = 0;
+    uint64_t id = 0;
+    while (offset < end) {
+        if (end - offset < IQZIP_SEGMENT_HDR_SIZE) {
+            std::cout << "Error reading segment" << std::endl;
+            return -1;
+        }
+        hdr.set_segment_header(reinterpret_cast<const
+                               header::iqzip_segment_header::segment_header_t *>(&src[offset]));
+        offset += IQZIP_SEGMENT_HDR_SIZE;
+        size_t compressed_bytes = hdr.decode_compressed_bytes();
+        size_t out_bytes = hdr.decode_samples() * sample_bytes();
+        if (end - offset < compressed_bytes) {
+            std::cout << "Error reading segment" << std::endl;
+            return -1;
+        }
+        if (cap - total_out < out_bytes) {
+            std::cout << "Output buffer too small" << std::endl;
+            return -1;
+        }
+        uint64_t start = stream_stats::now();
+        IQZIP_PROBE2(decompress__segment__start, id, compressed_bytes);
+        status = decode_segment(reinterpret_cast<const char *>(&src[offset]),
+                                compressed_bytes, &dst[total_out], out_bytes);
+        IQZIP_PROBE3(decompress__segment__done, id, out_bytes, status);
+        d_stats.add_codec(start, compressed_bytes, out_bytes);
+        id++;
+        if (status != AEC_OK) {
+            std::cout << "Error in decoding" << std::endl;
+            print_error(status);
+            return -1;
+        }
+        offset += compressed_bytes;
+        total_out += out_bytes;
+    }
+    return total_out;
+}
+
+int
+decompressor_impl::decode_stream(const char *in, size_t nbytes)
+{
+    int status;
+
+    d_strm.next_in = reinterpret_cast<const unsigned char *>(in);
+    d_strm.avail_in = nbytes;
+    /* The decoder stops early only when d_out is full */
+    do {
+        d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
+        d_strm.avail_out = CHUNK;
+        status = decode_step();
+        if (status != AEC_OK) {
+            std::cout << "Error in decoding" << std::endl;
+            print_error(status);
+            return status;
+        }
+        size_t produced = CHUNK - d_strm.avail_out;
+        if (produced && write_sink(d_out, produced)) {
+            std::cout << "Error writing output" << std::endl;
+            return -1;
+        }
+    }
+    while (d_strm.avail_out == 0);
+    return AEC_OK;
+}
+
+int
+decompressor_impl::decode_step()
+{
+    const size_t total_in = d_strm.total_in;
+    const size_t total_out = d_strm.total_out;
+    uint64_t start = stream_stats::now();
+    IQZIP_PROBE1(decode__start, d_strm.avail_in);
+    int status = d_decoder->decode(&d_strm, AEC_NO_FLUSH);
+    IQZIP_PROBE2(decode__done, d_strm.total_in - total_in,
+                 d_strm.total_out - total_out);
+    d_call_ns[(int) STREAM_STAGE::CODEC] +=
+        d_stats.add_codec(start, d_strm.total_in - total_in,
+                          d_strm.total_out - total_out);
+    return status;
+}
+
 int
 decompressor_impl::stream_decompress(const char *inbuf,
                                      size_t nbytes)
+{
+    begin_stream_call();
+    int status = stream_decode(inbuf, nbytes);
+    end_stream_call();
+    return status;
+}
+
+int
+decompressor_impl::stream_decode(const char *inbuf, size_t nbytes)
 {
     int status;
-    /* Save input buffer to internal buffer */
+    /* Save small input buffers to internal buffer */
     if (d_stream_avail_in + nbytes < STREAM_CHUNK) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
+        stage_copy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
         d_stream_avail_in += nbytes;
-        d_strm.avail_in = d_stream_avail_in;
+        d_stats.add_stream_call(d_stream_avail_in);
         return AEC_OK;
     }
-    /* d_stream_avail_in + nbytes >= STREAM_CHUNK */
-    long int remainder = d_stream_avail_in + nbytes - STREAM_CHUNK;
-    while (remainder >= 0) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf,
-                    STREAM_CHUNK - d_stream_avail_in);
-        d_stream_avail_in = STREAM_CHUNK;
-        /* Ready aec_stream */
-        d_strm.avail_in = d_stream_avail_in;
-        d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
-        d_strm.next_in = reinterpret_cast<unsigned char *>(d_tmp_stream);
 
-        status = aec_decode(&d_strm, AEC_NO_FLUSH);
+    /* Decode the staged bytes first, they precede inbuf in the bitstream */
+    if (d_stream_avail_in) {
+        status = decode_stream(d_tmp_stream, d_stream_avail_in);
         if (status != AEC_OK) {
-            std::cout << "Error in decoding" << std::endl;
-            print_error(status);
             return status;
         }
-        if (d_strm.total_out - d_total_out > 0) {
-            /* Write encoded output to file */
-            output_stream.write(d_out, d_strm.total_out - d_total_out);
-            d_strm.avail_out = CHUNK;
-            d_total_out = d_strm.total_out;
-        }
-        inbuf += nbytes - remainder;
-        nbytes -= nbytes - remainder;
         d_stream_avail_in = 0;
-        d_strm.avail_in = d_stream_avail_in;
-        //d_stream_avail_in = d_strm.avail_in;
-        remainder = d_stream_avail_in + nbytes - STREAM_CHUNK;
     }
 
-    /* If we have leftover samples copy them to stream */
-    if (nbytes) {
-        std::memcpy(&d_tmp_stream[d_stream_avail_in], inbuf, nbytes);
-        d_stream_avail_in = nbytes;
-        return AEC_OK;
-    }
+    /* Decode the rest straight from the caller's buffer */
+    d_stats.add_stream_call(0);
+    return decode_stream(inbuf, nbytes);
+}
 
-    return AEC_OK;
+codec_stats
+decompressor_impl::get_stats()
+{
+    return d_stats.snapshot();
+}
+
+const latency_histogram &
+decompressor_impl::get_latency(STREAM_STAGE stage) const
+{
+    return d_latency[(int) stage];
+}
+
+void
+decompressor_impl::reset_latency()
+{
+    reset_stream_latency();
 }
 
 int
 decompressor_impl::decompress_fin()
 {
     int status;
-    status = aec_decode_end(&d_strm);
+    status = d_decoder->decode_end(&d_strm);
     if (status != AEC_OK) {
         std::cout << "Error finishing stream" << std::endl;
         print_error(status);
@@ -203,10 +858,7 @@ decompressor_impl::decompress_fin()
     d_strm.next_out = nullptr;
     d_strm.state = nullptr;
 
-    input_stream.close();
-    output_stream.close();
-
-    return 0;
+    return close_io();
 }
 
 int
@@ -214,21 +866,14 @@ decompressor_impl::stream_decompress_fin()
 {
     int status;
 
-    d_strm.next_out = reinterpret_cast<unsigned char *>(d_out);
-    d_strm.next_in = reinterpret_cast<unsigned char *>(d_tmp_stream);
-    d_strm.avail_in = d_stream_avail_in;
-
-    status = aec_decode(&d_strm, AEC_NO_FLUSH);
+    status = decode_stream(d_tmp_stream, d_stream_avail_in);
     if (status != AEC_OK) {
         std::cout << "ERROR: while flushing output" << std::endl;
-        print_error(status);
         return -1;
     }
-    if (d_strm.total_out - d_total_out > 0) {
-        output_stream.write(d_out, d_strm.total_out - d_total_out);
-    }
+    d_stream_avail_in = 0;
 
-    status = aec_decode_end(&d_strm);
+    status = d_decoder->decode_end(&d_strm);
     if (status != AEC_OK) {
         std::cout << "Error finishing stream" << std::endl;
         print_error(status);
@@ -238,16 +883,42 @@ decompressor_impl::stream_decompress_fin()
     d_strm.next_out = nullptr;
     d_strm.state = nullptr;
 
-    input_stream.close();
-    output_stream.close();
+    return close_io();
+}
 
-    return 0;
+ssize_t
+decompressor_impl::read_input(char *buf, size_t nbytes)
+{
+    size_t pending = std::min(nbytes, d_pending.size());
+    std::memcpy(buf, d_pending.data(), pending);
+    d_pending.erase(d_pending.begin(), d_pending.begin() + pending);
+    if (pending == nbytes) {
+        return pending;
+    }
+    ssize_t avail = read_source(buf + pending, nbytes - pending);
+    return avail < 0 ? avail : pending + avail;
+}
+
+int
+decompressor_impl::close_io()
+{
+    int status = 0;
+    if (d_source) {
+        d_source->close();
+        d_source.reset();
+    }
+    if (d_sink) {
+        status = d_sink->close();
+        d_sink.reset();
+    }
+    return status;
 }
 
 decompressor_sptr
-create_decompressor()
+create_decompressor(uint32_t threads, bool native)
 {
-    return std::shared_ptr<decompressor>(new decompressor_impl);
+    return std::shared_ptr<decompressor>(new decompressor_impl(threads,
+                                         native));
 }
 
 } // namespace compression
@@ -30,9 +30,11 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "iqzip_impl.h"
 #include <iqzip/decompressor.h>
+#include <iqzip/iqzip_container.h>
 
 namespace iqzip {
 
@@ -46,14 +48,127 @@ private:
     char *d_tmp_stream;
     size_t d_stream_avail_in;
     char *d_out;
-    size_t d_total_out;
+    std::vector<char> d_in;
+    header::iqzip_segment_index d_segments;
+    const uint32_t d_threads;
+    std::string d_fin;
+    std::string d_fout;
+    bool d_bit_offsets;
+    std::vector<char> d_pending;
+    codec_backend_sptr d_decoder;
+
+    /*!
+     * Feeds nbytes of in to the stream decoder and hands all the output it
+     * produces to the sink, draining d_out as many times as needed. The
+     * decoder reads in directly and keeps any partial code word in its own
+     * state, so nothing of in has to be kept after the call.
+     * @param in buffer to read the bitstream from.
+     * @param nbytes number of bytes of in.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decode_stream(const char *in, size_t nbytes);
+
+    /*!
+     * Calls the stream decoder once on d_strm, accounting the call in
+     * d_stats.
+     * @return the status of the decoder.
+     */
+    int decode_step();
+
+    /*!
+     * The work of stream_decompress, timed by it.
+     * @param inbuf buffer to read the bitstream from.
+     * @param nbytes number of bytes to read from buffer.
+     * @return 0 on success, !=0 otherwise.
+     */
+    int stream_decode(const char *inbuf, size_t nbytes);
+
+    /*!
+     * Reads the CCSDS header and the segment index from in and initializes
+     * the aec stream.
+     * @param in the source to decompress.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int init_source(source_sptr in);
+
+    /*!
+     * Reads the compressed input of the single stream path. The bytes read
+     * past the header of sources that cannot seek come first.
+     * @param buf the buffer to read into.
+     * @param nbytes number of bytes to read.
+     * @return the number of bytes read, < 0 on error.
+     */
+    ssize_t read_input(char *buf, size_t nbytes);
+
+    /*!
+     * Closes and releases d_source and d_sink.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int close_io();
+
+    /*!
+     * Copies the options of the parsed CCSDS header to the class fields.
+     */
+    void decode_header();
+
+    /*!
+     * Fills d_segments with the segments of a segmented input file. The
+     * index of indexed files is read from the end of the file, otherwise the
+     * segment headers are scanned.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int load_segment_index();
+
+    /*!
+     * Fills d_segments from the sidecar index of a single stream input file,
+     * if there is one.
+     * @return 0 on success or if there is no sidecar, != 0 if the sidecar
+     * does not match the input file.
+     */
+    int load_sidecar_index();
+
+    /*!
+     * The file offset of the first byte of a segment bitstream.
+     * @param seg the segment.
+     * @return the offset in bytes.
+     */
+    uint64_t segment_position(
+        const header::iqzip_segment_index::index_entry_t &seg) const;
+
+    /*!
+     * Shifts the bitstream of a segment read from a sidecar indexed file, so
+     * that the first bit of the segment is the first bit of in.
+     * @param seg the segment.
+     * @param in the bytes of the segment, read from segment_position().
+     */
+    void align_segment(const header::iqzip_segment_index::index_entry_t &seg,
+                       std::vector<char> &in) const;
+
+    /*!
+     * Decompresses the segments of a segmented input file one after the
+     * other and writes the results to fout given in decompress_init.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decompress_segmented();
+
+    /*!
+     * Decompresses the segments of a segmented input file on d_threads
+     * worker threads. The output file is preallocated and every worker
+     * writes its segment directly at its final offset.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decompress_parallel();
 
 public:
 
     /*!
-     *
+     * Constructor.
+     * @param threads Number of threads used by decompress() for segmented
+     * files. 0 decodes the segments one after the other.
+     * @param native true to decode every file with aec_native_decoder, false
+     * to use it only for files the native encoder wrote.
      */
-    decompressor_impl();
+    decompressor_impl(uint32_t threads, bool native);
 
     /*!
      * Default destructor. Calls iqzip_compression_header destructor.
@@ -71,22 +186,98 @@ public:
      */
     int decompress_init(const std::string fin, const std::string fout);
 
+    /*!
+     * Initializes necessary variables for random access decompression with
+     * decompress_range. Only the fin file is opened. The CCSDS header and the
+     * segment index are read from the file specified by fin.
+     * @param fin Name of input file.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decompress_init(const std::string fin);
+
+    /*!
+     * Initializes necessary variables for decompression from in to out. The
+     * CCSDS header is read from in. Segmented input requires a source that
+     * can seek.
+     * @param in the source to read the compressed data from.
+     * @param out the sink to write the samples to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decompress_init(source_sptr in, sink_sptr out);
+
     /*!
      * Reads the input file given in iqzip_decompress_init, decompresses it, and
-     * writes the results to fout given in iqzip_decompress_init.
+     * writes the results to fout given in iqzip_decompress_init. The
+     * segments of segmented files are decompressed in parallel if the
+     * decompressor was created with threads.
      * @return 0 on succes, != 0 otherwise.
      */
     int decompress();
 
+    /*!
+     * Decompresses count samples starting at first_sample. Only the
+     * segments that cover the requested samples are read and decoded.
+     * Requires a segmented input file or a sidecar index.
+     * @param first_sample index of the first sample to decompress.
+     * @param count number of samples to decompress.
+     * @param out buffer of at least count samples to write the samples to.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decompress_range(uint64_t first_sample, uint64_t count, void *out);
+
+    /*!
+     * Indexes the single stream input file given in decompress_init. The
+     * bitstream is walked once and every reference sample interval boundary
+     * is recorded in the sidecar index next to the input file, which
+     * decompress_init picks up from then on.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int build_index();
+
+    /*!
+     * Decompresses the nbytes bytes of in, CCSDS header included, into out.
+     * No file is involved.
+     * @param in buffer holding a complete compressed file.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the samples to.
+     * @param cap size of out in bytes.
+     * @return the number of bytes written to out, < 0 on error or if out is
+     * too small.
+     */
+    ssize_t decompress_buffer(const void *in, size_t nbytes, void *out,
+                              size_t cap);
+
     /*!
      * Reads the input file given in iqzip_decompress_init, decompresses it,
      * and writes the results to fout given in iqzip_decompress_init.
+     * Small buffers are gathered internally up to STREAM_CHUNK bytes, larger
+     * ones are decoded in place without copying them.
      * @param inbuf buffer to read samples from.
      * @param nbytes number of bytes to read from buffer.
      * @return 0 on success, !=0 otherwise.
      */
     int stream_decompress(const char *inbuf, size_t nbytes);
 
+    /*!
+     * The counters of the stream, reset by decompress_init. Safe to call
+     * from any thread.
+     * @return a snapshot of the counters.
+     */
+    codec_stats get_stats();
+
+    /*!
+     * The latency histogram of a stage of stream_decompress, reset by
+     * decompress_init and reset_latency.
+     * @param stage the stage.
+     * @return the histogram
+     */
+    const latency_histogram &get_latency(STREAM_STAGE stage) const;
+
+    /*!
+     * Zeroes the latency histograms of every stage.
+     */
+    void reset_latency();
+
     /*!
      * Finalizes the decompression and clears aec_stream. Should always be called
      * after iqzip_decompress otherwise output file may not be written correctly.
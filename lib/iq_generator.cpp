@@ -0,0 +1,210 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/iq_generator.h>
+#include <algorithm>
+#include <cmath>
+
+namespace iqzip {
+
+namespace compression {
+
+/* Overdrive of CLIPPED, relative to the amplitude */
+#define CLIP_OVERDRIVE 4.0
+/* Pole of the filter that smooths the QPSK symbol transitions */
+#define QPSK_SMOOTHING 0.5
+
+static const IQ_SIGNAL mixed_signals[] = {
+    IQ_SIGNAL::NOISE, IQ_SIGNAL::TONE, IQ_SIGNAL::QPSK, IQ_SIGNAL::FSK,
+    IQ_SIGNAL::QUIET, IQ_SIGNAL::CLIPPED
+};
+
+iq_generator_config
+default_iq_generator_config(IQ_SIGNAL signal)
+{
+    iq_generator_config config;
+    config.signal = signal;
+    config.sample_resolution = 16;
+    config.data_sense = 0;
+    config.endianness = 1;
+    config.amplitude = 0.5;
+    config.noise = 0.01;
+    config.frequency = 0.0123;
+    config.samples_per_symbol = 8;
+    config.burst_pairs = 16384;
+    config.gap_pairs = 4096;
+    config.segment_pairs = 262144;
+    config.seed = 1;
+    return config;
+}
+
+iq_generator::iq_generator(const iq_generator_config &config) :
+    d_config(config),
+    d_rng(config.seed),
+    d_spare(0),
+    d_has_spare(false),
+    d_pair(0),
+    d_phase(0),
+    d_symbol_i(0),
+    d_symbol_q(0),
+    d_base_i(0),
+    d_base_q(0)
+{
+    d_config.sample_resolution = std::max<uint8_t>(
+                                     d_config.sample_resolution, 1);
+    d_config.sample_resolution = std::min<uint8_t>(
+                                     d_config.sample_resolution, 32);
+    d_config.samples_per_symbol = std::max<uint32_t>(
+                                      d_config.samples_per_symbol, 1);
+    d_config.segment_pairs = std::max<uint32_t>(d_config.segment_pairs, 1);
+    if (d_config.sample_resolution > 24) {
+        d_sample_bytes = 4;
+    }
+    else if (d_config.sample_resolution > 16) {
+        d_sample_bytes = 3;
+    }
+    else if (d_config.sample_resolution > 8) {
+        d_sample_bytes = 2;
+    }
+    else {
+        d_sample_bytes = 1;
+    }
+    d_full_scale = std::ldexp(1.0, d_config.sample_resolution - 1) - 1;
+}
+
+size_t
+iq_generator::pair_bytes() const
+{
+    return 2 * d_sample_bytes;
+}
+
+/*
+ * Box-Muller on uniforms made of the top 53 bits of the generator, whose
+ * sequence the standard fixes, unlike the one of std::normal_distribution.
+ */
+double
+iq_generator::gaussian()
+{
+    if (d_has_spare) {
+        d_has_spare = false;
+        return d_spare;
+    }
+    double u1 = ((d_rng() >> 11) + 1) * 0x1.0p-53;
+    double u2 = (d_rng() >> 11) * 0x1.0p-53;
+    double r = std::sqrt(-2 * std::log(u1));
+    d_spare = r * std::sin(2 * M_PI * u2);
+    d_has_spare = true;
+    return r * std::cos(2 * M_PI * u2);
+}
+
+IQ_SIGNAL
+iq_generator::signal_at(uint64_t pair) const
+{
+    if (d_config.signal != IQ_SIGNAL::MIXED) {
+        return d_config.signal;
+    }
+    size_t kinds = sizeof(mixed_signals) / sizeof(mixed_signals[0]);
+    return mixed_signals[pair / d_config.segment_pairs % kinds];
+}
+
+void
+iq_generator::next_pair(double *i, double *q)
+{
+    const double a = d_config.amplitude;
+    const uint64_t period = (uint64_t) d_config.burst_pairs
+                            + d_config.gap_pairs;
+    const bool burst = !period || d_pair % period < d_config.burst_pairs;
+    const bool symbol_start = d_pair % d_config.samples_per_symbol == 0;
+
+    *i = 0;
+    *q = 0;
+    switch (signal_at(d_pair)) {
+    case IQ_SIGNAL::QUIET:
+        d_pair++;
+        return;
+    case IQ_SIGNAL::TONE:
+    case IQ_SIGNAL::CLIPPED:
+        d_phase = std::fmod(d_phase + 2 * M_PI * d_config.frequency, 2 * M_PI);
+        *i = a * std::cos(d_phase);
+        *q = a * std::sin(d_phase);
+        if (signal_at(d_pair) == IQ_SIGNAL::CLIPPED) {
+            *i *= CLIP_OVERDRIVE;
+            *q *= CLIP_OVERDRIVE;
+        }
+        break;
+    case IQ_SIGNAL::QPSK:
+        if (symbol_start) {
+            uint64_t bits = d_rng();
+            d_symbol_i = burst ? ((bits & 1) ? M_SQRT1_2 : -M_SQRT1_2) : 0;
+            d_symbol_q = burst ? ((bits & 2) ? M_SQRT1_2 : -M_SQRT1_2) : 0;
+        }
+        d_base_i += QPSK_SMOOTHING * (d_symbol_i - d_base_i);
+        d_base_q += QPSK_SMOOTHING * (d_symbol_q - d_base_q);
+        *i = a * d_base_i;
+        *q = a * d_base_q;
+        break;
+    case IQ_SIGNAL::FSK:
+        if (symbol_start) {
+            d_symbol_i = (d_rng() & 1) ? 1 : -1;
+        }
+        d_phase = std::fmod(d_phase
+                            + 2 * M_PI * d_config.frequency * d_symbol_i,
+                            2 * M_PI);
+        if (burst) {
+            *i = a * std::cos(d_phase);
+            *q = a * std::sin(d_phase);
+        }
+        break;
+    default:
+        break;
+    }
+    *i += d_config.noise * gaussian();
+    *q += d_config.noise * gaussian();
+    d_pair++;
+}
+
+void
+iq_generator::store(double v, char *out) const
+{
+    const int64_t max = (int64_t) d_full_scale;
+    int64_t s = std::llround(v * d_full_scale);
+    s = std::min(std::max(s, -max - 1), max);
+    if (d_config.data_sense) {
+        s += max + 1;
+    }
+    for (size_t b = 0; b < d_sample_bytes; b++) {
+        size_t pos = d_config.endianness ? b : d_sample_bytes - 1 - b;
+        out[pos] = (char)((uint64_t) s >> (8 * b));
+    }
+}
+
+void
+iq_generator::generate(uint64_t pairs, char *out)
+{
+    for (uint64_t p = 0; p < pairs; p++) {
+        double i, q;
+        next_pair(&i, &q);
+        store(i, out);
+        store(q, out + d_sample_bytes);
+        out += 2 * d_sample_bytes;
+    }
+}
+
+} // namespace compression
+
+} // namespace iqzip
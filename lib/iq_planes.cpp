@@ -0,0 +1,451 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "iq_planes.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IQ_PLANES_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IQ_PLANES_NEON
+#endif
+
+namespace iqzip {
+
+namespace compression {
+
+/*
+ * Every kernel handles as many I/Q pairs as its vectors allow and returns
+ * how many it did. The generic code finishes the rest.
+ */
+typedef size_t (*split_kernel_t)(const char *in, size_t pairs, char *i_plane,
+                                 char *q_plane);
+typedef size_t (*merge_kernel_t)(const char *i_plane, const char *q_plane,
+                                 size_t pairs, char *out);
+
+static size_t
+split_none(const char *, size_t, char *, char *)
+{
+    return 0;
+}
+
+static size_t
+merge_none(const char *, const char *, size_t, char *)
+{
+    return 0;
+}
+
+#if defined(IQ_PLANES_X86)
+
+/* SSE2 is part of x86_64, it is the baseline there */
+__attribute__((target("sse2"))) static size_t
+split8_sse2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &in[2 * p]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &in[2 * p + 16]);
+        __m128i i = _mm_packus_epi16(_mm_and_si128(a, mask),
+                                     _mm_and_si128(b, mask));
+        __m128i q = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                     _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *) &i_plane[p], i);
+        _mm_storeu_si128((__m128i *) &q_plane[p], q);
+    }
+    return n;
+}
+
+__attribute__((target("sse2"))) static size_t
+split16_sse2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &in[4 * p]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &in[4 * p + 16]);
+        /* Sign extension makes the saturating pack exact */
+        __m128i i = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                    _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i q = _mm_packs_epi32(_mm_srai_epi32(a, 16),
+                                    _mm_srai_epi32(b, 16));
+        _mm_storeu_si128((__m128i *) &i_plane[2 * p], i);
+        _mm_storeu_si128((__m128i *) &q_plane[2 * p], q);
+    }
+    return n;
+}
+
+__attribute__((target("sse2"))) static size_t
+split32_sse2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 3;
+    for (size_t p = 0; p < n; p += 4) {
+        __m128 a = _mm_loadu_ps((const float *) &in[8 * p]);
+        __m128 b = _mm_loadu_ps((const float *) &in[8 * p + 16]);
+        _mm_storeu_ps((float *) &i_plane[4 * p],
+                      _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps((float *) &q_plane[4 * p],
+                      _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return n;
+}
+
+__attribute__((target("sse2"))) static size_t
+merge8_sse2(const char *i_plane, const char *q_plane, size_t pairs, char *out)
+{
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        __m128i i = _mm_loadu_si128((const __m128i *) &i_plane[p]);
+        __m128i q = _mm_loadu_si128((const __m128i *) &q_plane[p]);
+        _mm_storeu_si128((__m128i *) &out[2 * p], _mm_unpacklo_epi8(i, q));
+        _mm_storeu_si128((__m128i *) &out[2 * p + 16], _mm_unpackhi_epi8(i, q));
+    }
+    return n;
+}
+
+__attribute__((target("sse2"))) static size_t
+merge16_sse2(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        __m128i i = _mm_loadu_si128((const __m128i *) &i_plane[2 * p]);
+        __m128i q = _mm_loadu_si128((const __m128i *) &q_plane[2 * p]);
+        _mm_storeu_si128((__m128i *) &out[4 * p], _mm_unpacklo_epi16(i, q));
+        _mm_storeu_si128((__m128i *) &out[4 * p + 16],
+                         _mm_unpackhi_epi16(i, q));
+    }
+    return n;
+}
+
+__attribute__((target("sse2"))) static size_t
+merge32_sse2(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 3;
+    for (size_t p = 0; p < n; p += 4) {
+        __m128i i = _mm_loadu_si128((const __m128i *) &i_plane[4 * p]);
+        __m128i q = _mm_loadu_si128((const __m128i *) &q_plane[4 * p]);
+        _mm_storeu_si128((__m128i *) &out[8 * p], _mm_unpacklo_epi32(i, q));
+        _mm_storeu_si128((__m128i *) &out[8 * p + 16],
+                         _mm_unpackhi_epi32(i, q));
+    }
+    return n;
+}
+
+/*
+ * The AVX2 packs and unpacks work within 128-bit lanes, the lanes are put
+ * back in order with a cross-lane permute.
+ */
+__attribute__((target("avx2"))) static size_t
+split8_avx2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    size_t n = pairs & ~(size_t) 31;
+    for (size_t p = 0; p < n; p += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &in[2 * p]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &in[2 * p + 32]);
+        __m256i i = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                        _mm256_and_si256(b, mask));
+        __m256i q = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                        _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *) &i_plane[p],
+                            _mm256_permute4x64_epi64(i, 0xd8));
+        _mm256_storeu_si256((__m256i *) &q_plane[p],
+                            _mm256_permute4x64_epi64(q, 0xd8));
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t
+split16_avx2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &in[4 * p]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &in[4 * p + 32]);
+        __m256i i = _mm256_packs_epi32(
+                        _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                        _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+        __m256i q = _mm256_packs_epi32(_mm256_srai_epi32(a, 16),
+                                       _mm256_srai_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *) &i_plane[2 * p],
+                            _mm256_permute4x64_epi64(i, 0xd8));
+        _mm256_storeu_si256((__m256i *) &q_plane[2 * p],
+                            _mm256_permute4x64_epi64(q, 0xd8));
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t
+split32_avx2(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        __m256i a = _mm256_permutevar8x32_epi32(
+                        _mm256_loadu_si256((const __m256i *) &in[8 * p]), order);
+        __m256i b = _mm256_permutevar8x32_epi32(
+                        _mm256_loadu_si256((const __m256i *) &in[8 * p + 32]), order);
+        _mm256_storeu_si256((__m256i *) &i_plane[4 * p],
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *) &q_plane[4 * p],
+                            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t
+merge8_avx2(const char *i_plane, const char *q_plane, size_t pairs, char *out)
+{
+    size_t n = pairs & ~(size_t) 31;
+    for (size_t p = 0; p < n; p += 32) {
+        __m256i i = _mm256_loadu_si256((const __m256i *) &i_plane[p]);
+        __m256i q = _mm256_loadu_si256((const __m256i *) &q_plane[p]);
+        __m256i lo = _mm256_unpacklo_epi8(i, q);
+        __m256i hi = _mm256_unpackhi_epi8(i, q);
+        _mm256_storeu_si256((__m256i *) &out[2 * p],
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) &out[2 * p + 32],
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t
+merge16_avx2(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        __m256i i = _mm256_loadu_si256((const __m256i *) &i_plane[2 * p]);
+        __m256i q = _mm256_loadu_si256((const __m256i *) &q_plane[2 * p]);
+        __m256i lo = _mm256_unpacklo_epi16(i, q);
+        __m256i hi = _mm256_unpackhi_epi16(i, q);
+        _mm256_storeu_si256((__m256i *) &out[4 * p],
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) &out[4 * p + 32],
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t
+merge32_avx2(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        __m256i i = _mm256_loadu_si256((const __m256i *) &i_plane[4 * p]);
+        __m256i q = _mm256_loadu_si256((const __m256i *) &q_plane[4 * p]);
+        __m256i lo = _mm256_unpacklo_epi32(i, q);
+        __m256i hi = _mm256_unpackhi_epi32(i, q);
+        _mm256_storeu_si256((__m256i *) &out[8 * p],
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) &out[8 * p + 32],
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return n;
+}
+
+#elif defined(IQ_PLANES_NEON)
+
+static size_t
+split8_neon(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        uint8x16x2_t v = vld2q_u8((const uint8_t *) &in[2 * p]);
+        vst1q_u8((uint8_t *) &i_plane[p], v.val[0]);
+        vst1q_u8((uint8_t *) &q_plane[p], v.val[1]);
+    }
+    return n;
+}
+
+static size_t
+split16_neon(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        uint16x8x2_t v = vld2q_u16((const uint16_t *) &in[4 * p]);
+        vst1q_u16((uint16_t *) &i_plane[2 * p], v.val[0]);
+        vst1q_u16((uint16_t *) &q_plane[2 * p], v.val[1]);
+    }
+    return n;
+}
+
+static size_t
+split32_neon(const char *in, size_t pairs, char *i_plane, char *q_plane)
+{
+    size_t n = pairs & ~(size_t) 3;
+    for (size_t p = 0; p < n; p += 4) {
+        uint32x4x2_t v = vld2q_u32((const uint32_t *) &in[8 * p]);
+        vst1q_u32((uint32_t *) &i_plane[4 * p], v.val[0]);
+        vst1q_u32((uint32_t *) &q_plane[4 * p], v.val[1]);
+    }
+    return n;
+}
+
+static size_t
+merge8_neon(const char *i_plane, const char *q_plane, size_t pairs, char *out)
+{
+    size_t n = pairs & ~(size_t) 15;
+    for (size_t p = 0; p < n; p += 16) {
+        uint8x16x2_t v;
+        v.val[0] = vld1q_u8((const uint8_t *) &i_plane[p]);
+        v.val[1] = vld1q_u8((const uint8_t *) &q_plane[p]);
+        vst2q_u8((uint8_t *) &out[2 * p], v);
+    }
+    return n;
+}
+
+static size_t
+merge16_neon(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 7;
+    for (size_t p = 0; p < n; p += 8) {
+        uint16x8x2_t v;
+        v.val[0] = vld1q_u16((const uint16_t *) &i_plane[2 * p]);
+        v.val[1] = vld1q_u16((const uint16_t *) &q_plane[2 * p]);
+        vst2q_u16((uint16_t *) &out[4 * p], v);
+    }
+    return n;
+}
+
+static size_t
+merge32_neon(const char *i_plane, const char *q_plane, size_t pairs,
+             char *out)
+{
+    size_t n = pairs & ~(size_t) 3;
+    for (size_t p = 0; p < n; p += 4) {
+        uint32x4x2_t v;
+        v.val[0] = vld1q_u32((const uint32_t *) &i_plane[4 * p]);
+        v.val[1] = vld1q_u32((const uint32_t *) &q_plane[4 * p]);
+        vst2q_u32((uint32_t *) &out[8 * p], v);
+    }
+    return n;
+}
+
+#endif
+
+/*!
+ * The kernels of the best instruction set of the CPU, indexed by the
+ * sample size in bytes. 3 byte samples always take the generic path.
+ */
+typedef struct iq_kernels_t {
+    const char *isa;
+    split_kernel_t split[5];
+    merge_kernel_t merge[5];
+} iq_kernels_t;
+
+static iq_kernels_t
+select_kernels()
+{
+    iq_kernels_t k = {
+        "generic",
+        {split_none, split_none, split_none, split_none, split_none},
+        {merge_none, merge_none, merge_none, merge_none, merge_none}
+    };
+#if defined(IQ_PLANES_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        k.isa = "avx2";
+        k.split[1] = split8_avx2;
+        k.split[2] = split16_avx2;
+        k.split[4] = split32_avx2;
+        k.merge[1] = merge8_avx2;
+        k.merge[2] = merge16_avx2;
+        k.merge[4] = merge32_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        k.isa = "sse2";
+        k.split[1] = split8_sse2;
+        k.split[2] = split16_sse2;
+        k.split[4] = split32_sse2;
+        k.merge[1] = merge8_sse2;
+        k.merge[2] = merge16_sse2;
+        k.merge[4] = merge32_sse2;
+    }
+#elif defined(IQ_PLANES_NEON)
+    k.isa = "neon";
+    k.split[1] = split8_neon;
+    k.split[2] = split16_neon;
+    k.split[4] = split32_neon;
+    k.merge[1] = merge8_neon;
+    k.merge[2] = merge16_neon;
+    k.merge[4] = merge32_neon;
+#endif
+    return k;
+}
+
+static const iq_kernels_t &
+kernels()
+{
+    static const iq_kernels_t k = select_kernels();
+    return k;
+}
+
+void
+deinterleave_iq(const char *in, size_t samples, size_t sample_bytes,
+                char *i_plane, char *q_plane)
+{
+    size_t pairs = samples / 2;
+    size_t done = kernels().split[sample_bytes](in, pairs, i_plane, q_plane);
+    for (size_t p = done; p < pairs; p++) {
+        std::memcpy(&i_plane[p * sample_bytes], &in[2 * p * sample_bytes],
+                    sample_bytes);
+        std::memcpy(&q_plane[p * sample_bytes], &in[(2 * p + 1) * sample_bytes],
+                    sample_bytes);
+    }
+    if (samples % 2) {
+        std::memcpy(&i_plane[pairs * sample_bytes],
+                    &in[2 * pairs * sample_bytes], sample_bytes);
+    }
+}
+
+void
+interleave_iq(const char *i_plane, const char *q_plane, size_t samples,
+              size_t sample_bytes, char *out)
+{
+    size_t pairs = samples / 2;
+    size_t done = kernels().merge[sample_bytes](i_plane, q_plane, pairs, out);
+    for (size_t p = done; p < pairs; p++) {
+        std::memcpy(&out[2 * p * sample_bytes], &i_plane[p * sample_bytes],
+                    sample_bytes);
+        std::memcpy(&out[(2 * p + 1) * sample_bytes], &q_plane[p * sample_bytes],
+                    sample_bytes);
+    }
+    if (samples % 2) {
+        std::memcpy(&out[2 * pairs * sample_bytes],
+                    &i_plane[pairs * sample_bytes], sample_bytes);
+    }
+}
+
+const char *
+iq_planes_isa()
+{
+    return kernels().isa;
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,73 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief I/Q plane separation
+ *
+ * Complex baseband recordings interleave the in-phase and quadrature
+ * components, I0 Q0 I1 Q1 ... The predictor of the Adaptive Entropy Coder
+ * estimates every sample from the previous one, so on such input it predicts
+ * every I from a Q and vice versa. These kernels split the samples into an I
+ * and a Q plane, so that each plane can be coded on its own, and merge them
+ * back after decoding. The kernels are vectorized with SSE2, AVX2 or NEON and
+ * the fastest one the CPU supports is picked at runtime.
+ */
+
+#ifndef IQ_PLANES_H
+#define IQ_PLANES_H
+
+#include <cstddef>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * Splits interleaved samples into an I and a Q plane. With an odd number of
+ * samples the I plane holds one sample more than the Q plane.
+ * @param in the interleaved samples.
+ * @param samples number of samples of in.
+ * @param sample_bytes the size of every sample in bytes.
+ * @param i_plane buffer for the (samples + 1) / 2 I samples.
+ * @param q_plane buffer for the samples / 2 Q samples.
+ */
+void deinterleave_iq(const char *in, size_t samples, size_t sample_bytes,
+                     char *i_plane, char *q_plane);
+
+/*!
+ * Merges an I and a Q plane back into interleaved samples. The inverse of
+ * deinterleave_iq.
+ * @param i_plane the (samples + 1) / 2 I samples.
+ * @param q_plane the samples / 2 Q samples.
+ * @param samples number of samples of out.
+ * @param sample_bytes the size of every sample in bytes.
+ * @param out buffer for the interleaved samples.
+ */
+void interleave_iq(const char *i_plane, const char *q_plane, size_t samples,
+                   size_t sample_bytes, char *out);
+
+/*!
+ * @return the name of the instruction set the kernels use on this CPU.
+ */
+const char *iq_planes_isa();
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* IQ_PLANES_H */
@@ -17,7 +17,9 @@
  */
 
 #include <iqzip/iqzip_compression_header.h>
+#include <algorithm>
 #include <stdexcept>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
@@ -51,6 +53,7 @@ iqzip_compression_header::iqzip_compression_header(
     d_sample_resolution(sample_resolution),
     d_restricted_codes(restricted_codes)
 {
+    memset(&d_container_header, 0, sizeof(iqzip_container_header_t));
     encode();
 
     d_primary_header = new ccsds_packet_primary_header(version, type,
@@ -87,6 +90,7 @@ iqzip_compression_header::iqzip_compression_header() :
     d_sample_resolution(0),
     d_restricted_codes(0)
 {
+    memset(&d_container_header, 0, sizeof(iqzip_container_header_t));
     d_primary_header = new ccsds_packet_primary_header();
     d_cip = new compression_identification_packet();
 }
@@ -95,41 +99,124 @@ iqzip_compression_header::~iqzip_compression_header()
 {
 }
 
-void
+size_t
 iqzip_compression_header::write_header_to_file(std::string path)
 {
+    uint8_t buffer[IQZIP_MAX_HEADER_SIZE];
+    size_t hdr_size = write_header_to_buffer(buffer, IQZIP_MAX_HEADER_SIZE);
+
     FILE *f = fopen(path.c_str(), "wb");
-    fwrite(&(d_primary_header->get_primary_header()),
-           sizeof(ccsds_packet_primary_header::packet_primary_header_t), 1,
-           f);
-    fwrite(&(d_cip->get_source_data_fixed()),
-           sizeof(compression_identification_packet::source_data_fixed_t), 1,
-           f);
-    fwrite(&(d_cip->get_source_data_variable().preprocessor),
-           sizeof(compression_identification_packet::preprocessor_t), 1, f);
-    fwrite(&(d_cip->get_source_data_variable().entropy_coder),
-           sizeof(compression_identification_packet::entropy_coder_t), 1, f);
-    //TODO: Add a parameter that indicates the use of Instrument Configuration subfield
-    if (d_block_size > 16 || d_rsi > 255 || d_restricted_codes) {
-        fwrite(
-            &(d_cip->get_source_data_variable().extended_parameters),
-            sizeof(compression_identification_packet::extended_parameters_t), 1,
-            f);
-    }
-    if (d_block_size > 64) {
-        fwrite(&d_iqzip_header, sizeof(iqzip_compression_header_t), 1, f);
+    if (!f) {
+        throw std::runtime_error("File writing error");
     }
+    fwrite(buffer, 1, hdr_size, f);
     fclose(f);
+    return hdr_size;
 }
 
 size_t
 iqzip_compression_header::parse_header_from_file(std::string path)
 {
+    uint8_t buffer[IQZIP_MAX_HEADER_SIZE];
     size_t result;
     size_t hdr_size;
-    size_t max_header_size;
-    uint8_t *buffer;
-    FILE *f;
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        throw std::runtime_error("File reading error");
+    }
+    result = fread(buffer, 1, IQZIP_MAX_HEADER_SIZE, f);
+    fclose(f);
+
+    if (!(hdr_size = parse_header_from_buffer(buffer, result))) {
+        throw std::runtime_error("File reading error");
+    }
+    return hdr_size;
+}
+
+size_t
+iqzip_compression_header::write_header_to_buffer(uint8_t *buf, size_t cap)
+{
+    size_t hdr_size;
+    compression_identification_packet::preprocessor_t preprocessor;
+    compression_identification_packet::extended_parameters_t extended_parameters;
+    /* LSB first samples need the IQzip header to say so, and only the
+     * container flag makes a reader look for it below 65 sample blocks */
+    bool container = d_container_header.version != (uint8_t)(
+                         CONTAINER_VERSION::SINGLE_STREAM)
+                     || d_iqzip_header.endianness == (uint8_t) ENDIANNESS::LITTLE;
+    bool extended = d_block_size > 16 || d_rsi > 255 || d_restricted_codes
+                    || container;
+    bool iqzip = d_block_size > 64 || container;
+
+    hdr_size = CCSDS_PRIMARY_HEADER_SIZE + SOURCE_DATA_FIXED_SIZE
+               + PREPROCESSOR_SUBFIELD_SIZE + ENTROPY_CODER_SUBFIELD_SIZE;
+    //TODO: Add a parameter that indicates the use of Instrument Configuration subfield
+    if (extended) {
+        hdr_size += EXTENDED_PARAMETERS_SUBFIELD_SIZE;
+    }
+    if (iqzip) {
+        hdr_size += IQZIP_COMPRESSION_HDR_SIZE;
+    }
+    if (container) {
+        hdr_size += IQZIP_CONTAINER_HDR_SIZE;
+    }
+    if (hdr_size > cap) {
+        return 0;
+    }
+
+    memcpy(preprocessor, d_cip->get_source_data_variable().preprocessor,
+           sizeof(compression_identification_packet::preprocessor_t));
+    memcpy(extended_parameters,
+           d_cip->get_source_data_variable().extended_parameters,
+           sizeof(compression_identification_packet::extended_parameters_t));
+    if (container) {
+        /* Force the Extended Parameters subfield so the container flag is seen */
+        preprocessor[1] |= (uint8_t)(
+                               PREPROCESSOR_BLOCK_SIZE::APPLICATION_SPECIFIC) << 6;
+        extended_parameters[1] |= IQZIP_CONTAINER_PRESENT_MASK;
+    }
+    if (container && d_container_header.predictor) {
+        /* The native predictor replaces the unit delay one */
+        preprocessor[0] = (preprocessor[0] & ~(PREPROCESSOR_STATUS_MASK
+                                               | PREPROCESSOR_PREDICTOR_TYPE_MASK))
+                          | (uint8_t)(PREPROCESSOR_STATUS::PRESENT) << 5
+                          | (uint8_t)(PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC) << 2;
+    }
+
+    memcpy(buf, &(d_primary_header->get_primary_header()),
+           sizeof(ccsds_packet_primary_header::packet_primary_header_t));
+    buf += CCSDS_PRIMARY_HEADER_SIZE;
+    memcpy(buf, &(d_cip->get_source_data_fixed()),
+           sizeof(compression_identification_packet::source_data_fixed_t));
+    buf += SOURCE_DATA_FIXED_SIZE;
+    memcpy(buf, &preprocessor,
+           sizeof(compression_identification_packet::preprocessor_t));
+    buf += PREPROCESSOR_SUBFIELD_SIZE;
+    memcpy(buf, &(d_cip->get_source_data_variable().entropy_coder),
+           sizeof(compression_identification_packet::entropy_coder_t));
+    buf += ENTROPY_CODER_SUBFIELD_SIZE;
+    if (extended) {
+        memcpy(buf, &extended_parameters,
+               sizeof(compression_identification_packet::extended_parameters_t));
+        buf += EXTENDED_PARAMETERS_SUBFIELD_SIZE;
+    }
+    if (iqzip) {
+        memcpy(buf, &d_iqzip_header, sizeof(iqzip_compression_header_t));
+        buf += IQZIP_COMPRESSION_HDR_SIZE;
+    }
+    if (container) {
+        memcpy(buf, &d_container_header, sizeof(iqzip_container_header_t));
+    }
+    return hdr_size;
+}
+
+size_t
+iqzip_compression_header::parse_header_from_buffer(const uint8_t *buf,
+        size_t nbytes)
+{
+    size_t hdr_size;
+    uint8_t buffer[IQZIP_MAX_HEADER_SIZE];
     ccsds_packet_primary_header::packet_primary_header_t *hdr_primary;
     compression_identification_packet::source_data_variable_t *hdr_src_cnf;
     compression_identification_packet::source_data_fixed_t *hdr_src_cnf_fixed;
@@ -137,16 +224,10 @@ iqzip_compression_header::parse_header_from_file(std::string path)
 
     hdr_size = CCSDS_PRIMARY_HEADER_SIZE + SOURCE_DATA_FIXED_SIZE
                + PREPROCESSOR_SUBFIELD_SIZE + ENTROPY_CODER_SUBFIELD_SIZE;
-    max_header_size = MAX_CIP_HEADER_SIZE_BYTES + IQZIP_COMPRESSION_HDR_SIZE;
 
-    buffer = (uint8_t *) malloc(sizeof(uint8_t) * max_header_size);
-    f = fopen(path.c_str(), "rb");
-    result = fread(buffer, 1, max_header_size, f);
-    if (result != max_header_size) {
-        throw std::runtime_error("File reading error");
-        exit(3);
-    }
-    fclose(f);
+    /* Short inputs are zero padded, the header size is checked at the end */
+    memset(buffer, 0, IQZIP_MAX_HEADER_SIZE);
+    memcpy(buffer, buf, std::min<size_t>(nbytes, IQZIP_MAX_HEADER_SIZE));
     hdr_primary =
         (ccsds_packet_primary_header::packet_primary_header_t *)(&buffer[0]);
     hdr_src_cnf =
@@ -164,21 +245,35 @@ iqzip_compression_header::parse_header_from_file(std::string path)
     d_primary_header->set_primary_header(hdr_primary);
     d_cip->set_source_data_fixed(hdr_src_cnf_fixed);
     d_cip->set_source_data_variable(hdr_src_cnf);
-    set_iqzip_compression_header(iqzip_hdr);
+
+    /* Files without an IQzip header hold MSB first samples */
+    memset(&d_iqzip_header, 0, sizeof(iqzip_compression_header_t));
+    memset(&d_container_header, 0, sizeof(iqzip_container_header_t));
 
     /* Retrieve header size */
     if (!(d_block_size = decode_preprocessor_block_size())) {
+        bool container = hdr_src_cnf->extended_parameters[1] &
+                         IQZIP_CONTAINER_PRESENT_MASK;
         d_block_size = decode_extended_parameters_block_size();
         hdr_size += EXTENDED_PARAMETERS_SUBFIELD_SIZE;
-        if (!d_block_size) {
+        if (!d_block_size || container) {
+            set_iqzip_compression_header(iqzip_hdr);
             hdr_size += IQZIP_COMPRESSION_HDR_SIZE;
         }
+        if (container) {
+            memcpy(&d_container_header, &buffer[hdr_size],
+                   sizeof(iqzip_container_header_t));
+            hdr_size += IQZIP_CONTAINER_HDR_SIZE;
+        }
+    }
+
+    if (nbytes < hdr_size) {
+        return 0;
     }
 
     /* FIXME: Take into consideration the CCSDS secondary header and the
      * Instrument Configuration subfield */
     return hdr_size;
-
 }
 
 iqzip_compression_header::iqzip_compression_header_t &
@@ -490,6 +585,42 @@ iqzip_compression_header::decode_iqzip_header_reference_sample_interval() const
     return d_iqzip_header.rsi;
 }
 
+void
+iqzip_compression_header::encode_iqzip_container_version(uint8_t version)
+{
+    d_container_header.version = version;
+}
+
+uint8_t
+iqzip_compression_header::decode_iqzip_container_version() const
+{
+    return d_container_header.version;
+}
+
+void
+iqzip_compression_header::encode_iqzip_container_flags(uint8_t flags)
+{
+    d_container_header.flags = flags;
+}
+
+uint8_t
+iqzip_compression_header::decode_iqzip_container_flags() const
+{
+    return d_container_header.flags;
+}
+
+void
+iqzip_compression_header::encode_iqzip_container_predictor(uint8_t predictor)
+{
+    d_container_header.predictor = predictor;
+}
+
+uint8_t
+iqzip_compression_header::decode_iqzip_container_predictor() const
+{
+    return d_container_header.predictor;
+}
+
 } // namespace header
 } // namespace compression
 } // namespace iqzip
@@ -0,0 +1,263 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/iqzip_container.h>
+#include <algorithm>
+#include <cstring>
+
+namespace iqzip {
+
+namespace compression {
+
+namespace header {
+
+iqzip_segment_params::iqzip_segment_params(uint16_t block_size, uint16_t rsi,
+        uint8_t predictor, uint8_t flags)
+{
+    d_segment_params[0] = block_size >> 8;
+    d_segment_params[1] = block_size;
+    d_segment_params[2] = rsi >> 8;
+    d_segment_params[3] = rsi;
+    d_segment_params[4] = predictor;
+    d_segment_params[5] = flags;
+}
+
+iqzip_segment_params::iqzip_segment_params()
+{
+    memset(d_segment_params, 0, sizeof(segment_params_t));
+}
+
+iqzip_segment_params::~iqzip_segment_params()
+{
+}
+
+iqzip_segment_params::segment_params_t &
+iqzip_segment_params::get_segment_params()
+{
+    return d_segment_params;
+}
+
+void
+iqzip_segment_params::set_segment_params(const segment_params_t *params)
+{
+    memcpy(d_segment_params, params, sizeof(segment_params_t));
+}
+
+uint16_t
+iqzip_segment_params::decode_block_size() const
+{
+    return ((uint16_t)d_segment_params[0] << 8) | d_segment_params[1];
+}
+
+uint16_t
+iqzip_segment_params::decode_reference_sample_interval() const
+{
+    return ((uint16_t)d_segment_params[2] << 8) | d_segment_params[3];
+}
+
+uint8_t
+iqzip_segment_params::decode_predictor() const
+{
+    return d_segment_params[4];
+}
+
+uint8_t
+iqzip_segment_params::decode_flags() const
+{
+    return d_segment_params[5];
+}
+
+iqzip_segment_header::iqzip_segment_header(uint32_t compressed_bytes,
+        uint32_t samples)
+{
+    encode_compressed_bytes(compressed_bytes);
+    encode_samples(samples);
+}
+
+iqzip_segment_header::iqzip_segment_header()
+{
+    memset(d_segment_header, 0, sizeof(segment_header_t));
+}
+
+iqzip_segment_header::~iqzip_segment_header()
+{
+}
+
+iqzip_segment_header::segment_header_t &
+iqzip_segment_header::get_segment_header()
+{
+    return d_segment_header;
+}
+
+void
+iqzip_segment_header::set_segment_header(const segment_header_t *hdr)
+{
+    memcpy(d_segment_header, hdr, sizeof(segment_header_t));
+}
+
+void
+iqzip_segment_header::encode_compressed_bytes(uint32_t compressed_bytes)
+{
+    d_segment_header[0] = compressed_bytes >> 24;
+    d_segment_header[1] = compressed_bytes >> 16;
+    d_segment_header[2] = compressed_bytes >> 8;
+    d_segment_header[3] = compressed_bytes;
+}
+
+void
+iqzip_segment_header::encode_samples(uint32_t samples)
+{
+    d_segment_header[4] = samples >> 24;
+    d_segment_header[5] = samples >> 16;
+    d_segment_header[6] = samples >> 8;
+    d_segment_header[7] = samples;
+}
+
+uint32_t
+iqzip_segment_header::decode_compressed_bytes() const
+{
+    return ((uint32_t)d_segment_header[0] << 24)
+           | ((uint32_t)d_segment_header[1] << 16)
+           | ((uint32_t)d_segment_header[2] << 8)
+           | d_segment_header[3];
+}
+
+uint32_t
+iqzip_segment_header::decode_samples() const
+{
+    return ((uint32_t)d_segment_header[4] << 24)
+           | ((uint32_t)d_segment_header[5] << 16)
+           | ((uint32_t)d_segment_header[6] << 8)
+           | d_segment_header[7];
+}
+
+iqzip_segment_index::iqzip_segment_index() :
+    d_total_samples(0)
+{
+}
+
+iqzip_segment_index::~iqzip_segment_index()
+{
+}
+
+void
+iqzip_segment_index::add_segment(uint64_t offset, uint32_t compressed_bytes,
+                                 uint32_t samples)
+{
+    index_entry_t entry;
+    entry.offset = offset;
+    entry.compressed_bytes = compressed_bytes;
+    entry.first_sample = d_total_samples;
+    entry.samples = samples;
+    d_entries.push_back(entry);
+    d_total_samples += samples;
+}
+
+void
+iqzip_segment_index::clear()
+{
+    d_entries.clear();
+    d_total_samples = 0;
+}
+
+const std::vector<iqzip_segment_index::index_entry_t> &
+iqzip_segment_index::get_entries() const
+{
+    return d_entries;
+}
+
+uint64_t
+iqzip_segment_index::total_samples() const
+{
+    return d_total_samples;
+}
+
+size_t
+iqzip_segment_index::find_segment(uint64_t sample) const
+{
+    /* The first segment past the sample is the one after its segment */
+    std::vector<index_entry_t>::const_iterator it = std::upper_bound(
+                d_entries.begin(), d_entries.end(), sample,
+    [](uint64_t s, const index_entry_t &entry) {
+        return s < entry.first_sample;
+    });
+    return it - d_entries.begin() - 1;
+}
+
+static void
+put_be(uint8_t *buf, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) {
+        buf[i] = value >> (8 * (bytes - 1 - i));
+    }
+}
+
+static uint64_t
+get_be(const uint8_t *buf, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+void
+iqzip_segment_index::encode(std::vector<uint8_t> &buf,
+                            uint64_t index_offset, const char *magic) const
+{
+    buf.resize(d_entries.size() * IQZIP_INDEX_ENTRY_SIZE + IQZIP_TRAILER_SIZE);
+    uint8_t *p = buf.data();
+    for (const index_entry_t &entry : d_entries) {
+        put_be(&p[0], entry.offset, 8);
+        put_be(&p[8], entry.compressed_bytes, 4);
+        put_be(&p[12], entry.first_sample, 8);
+        put_be(&p[20], entry.samples, 4);
+        p += IQZIP_INDEX_ENTRY_SIZE;
+    }
+    memcpy(&p[0], magic, 4);
+    put_be(&p[4], d_entries.size(), 4);
+    put_be(&p[8], index_offset, 8);
+}
+
+bool
+iqzip_segment_index::decode_trailer(const trailer_t trailer,
+                                    uint64_t *index_offset, uint32_t *segments,
+                                    const char *magic)
+{
+    if (memcmp(trailer, magic, 4)) {
+        return false;
+    }
+    *segments = get_be(&trailer[4], 4);
+    *index_offset = get_be(&trailer[8], 8);
+    return true;
+}
+
+void
+iqzip_segment_index::decode_entries(const uint8_t *buf, uint32_t segments)
+{
+    clear();
+    for (uint32_t i = 0; i < segments; i++) {
+        const uint8_t *p = &buf[i * IQZIP_INDEX_ENTRY_SIZE];
+        add_segment(get_be(&p[0], 8), get_be(&p[8], 4), get_be(&p[20], 4));
+    }
+}
+
+} // namespace header
+} // namespace compression
+} // namespace iqzip
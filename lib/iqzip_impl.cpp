@@ -16,9 +16,15 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include "iqzip_impl.h"
+#include "aec_encoder.h"
+#include "iq_planes.h"
+#include "probes.h"
+#include <iqzip/iqzip_container.h>
 
 namespace iqzip {
 
@@ -41,7 +47,16 @@ iqzip_impl::iqzip_impl() :
     d_sample_resolution(0),
     d_cds_per_packet(0),
     d_restricted_codes(0),
-    d_endianness(0)
+    d_endianness(0),
+    d_split_iq(false),
+    d_predictor(0),
+    d_adaptive(false),
+    d_estimate_k(false),
+    d_raw_segments(false),
+    d_native_decoder(false),
+    d_stats(false),
+    d_call_start(0),
+    d_call_ns()
 {
     d_ccsds_cip_hdr = compression::header::iqzip_compression_header();
 }
@@ -73,7 +88,26 @@ iqzip_impl::iqzip_impl(uint8_t version, uint8_t type, uint8_t sec_hdr_flag,
     d_sample_resolution(sample_resolution),
     d_cds_per_packet(cds_per_packet),
     d_restricted_codes(restricted_codes),
-    d_endianness(endianness)
+    d_endianness(endianness),
+    d_split_iq(false),
+    d_predictor(0),
+    d_adaptive(false),
+    d_estimate_k(false),
+    d_raw_segments(false),
+    d_native_decoder(false),
+    d_stats(true),
+    d_call_start(0),
+    d_call_ns()
+{
+    init_header();
+}
+
+iqzip_impl::~iqzip_impl()
+{
+}
+
+void
+iqzip_impl::init_header()
 {
     /* Initialize IQ CCSDS header */
     d_ccsds_cip_hdr = compression::header::iqzip_compression_header(
@@ -84,35 +118,385 @@ iqzip_impl::iqzip_impl(uint8_t version, uint8_t type, uint8_t sec_hdr_flag,
                           d_sample_resolution, d_cds_per_packet, d_restricted_codes, d_endianness);
 }
 
-iqzip_impl::~iqzip_impl()
+void
+iqzip_impl::init_aec_stream(void)
 {
+    init_aec_stream(&d_strm);
+    d_strm.avail_out = CHUNK;
 }
 
 void
-iqzip_impl::init_aec_stream(void)
+iqzip_impl::init_aec_stream(aec_stream *strm) const
 {
-    d_strm.avail_in = 0;
-    d_strm.avail_out = CHUNK;
-    d_strm.bits_per_sample = d_sample_resolution;
-    d_strm.block_size = d_block_size;
-    d_strm.flags = 0;
+    strm->avail_in = 0;
+    strm->avail_out = 0;
+    strm->bits_per_sample = d_sample_resolution;
+    strm->block_size = d_block_size;
+    strm->flags = 0;
     /* Always use 3 bytes for 24bits samples and don't enforce */
-    d_strm.flags |= AEC_DATA_3BYTE;
-    d_strm.flags |= AEC_NOT_ENFORCE;
+    strm->flags |= AEC_DATA_3BYTE;
+    strm->flags |= AEC_NOT_ENFORCE;
     /* Shift option bit to corresponding bit in flag to initialize flags */
-    d_strm.flags |= (~(d_data_sense << (uint8_t) log2(AEC_DATA_SIGNED)))
-                    & AEC_DATA_SIGNED;
-    d_strm.flags |= (~(d_endianness << (uint8_t) log2(AEC_DATA_MSB)))
-                    & AEC_DATA_MSB;
-    d_strm.flags |= d_preprocessor_status << (uint8_t) log2(AEC_DATA_PREPROCESS);
-    d_strm.flags |= d_restricted_codes << (uint8_t) log2(AEC_RESTRICTED);
-    //d_strm.flags |= AEC_PAD_RSI;
-    d_strm.next_in = nullptr;
-    d_strm.next_out = nullptr;
-    d_strm.rsi = d_reference_sample_interval;
-    d_strm.state = nullptr;
-    d_strm.total_in = 0;
-    d_strm.total_out = 0;
+    strm->flags |= (~(d_data_sense << (uint8_t) log2(AEC_DATA_SIGNED)))
+                   & AEC_DATA_SIGNED;
+    strm->flags |= (~(d_endianness << (uint8_t) log2(AEC_DATA_MSB)))
+                   & AEC_DATA_MSB;
+    strm->flags |= d_preprocessor_status << (uint8_t) log2(AEC_DATA_PREPROCESS);
+    strm->flags |= d_restricted_codes << (uint8_t) log2(AEC_RESTRICTED);
+    /* Only the native encoder knows the flag */
+    if (d_estimate_k && d_compression_tech_id == (uint8_t)
+        compression::header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION) {
+        strm->flags |= AEC_NATIVE_ESTIMATE_K;
+    }
+    //strm->flags |= AEC_PAD_RSI;
+    strm->next_in = nullptr;
+    strm->next_out = nullptr;
+    strm->rsi = d_reference_sample_interval;
+    strm->state = nullptr;
+    strm->total_in = 0;
+    strm->total_out = 0;
+}
+
+compression::codec_backend_sptr
+iqzip_impl::encoder_backend() const
+{
+    return compression::create_codec_backend(d_compression_tech_id);
+}
+
+compression::codec_backend_sptr
+iqzip_impl::decoder_backend() const
+{
+    /* The native decoder reads the bitstream of libaec as well */
+    if (d_native_decoder) {
+        return compression::create_codec_backend((uint8_t)
+                compression::header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION);
+    }
+    return compression::create_codec_backend(d_compression_tech_id);
+}
+
+size_t
+iqzip_impl::sample_bytes() const
+{
+    if (d_sample_resolution > 24) {
+        return 4;
+    }
+    else if (d_sample_resolution > 16) {
+        /* AEC_DATA_3BYTE is always set */
+        return 3;
+    }
+    else if (d_sample_resolution > 8) {
+        return 2;
+    }
+    return 1;
+}
+
+compression::sample_format_t
+iqzip_impl::sample_format() const
+{
+    compression::sample_format_t fmt;
+    fmt.bytes = sample_bytes();
+    fmt.bits = d_sample_resolution;
+    fmt.is_signed = !d_data_sense;
+    fmt.msb = !d_endianness;
+    return fmt;
+}
+
+size_t
+iqzip_impl::segment_samples() const
+{
+    size_t rsi_samples = (size_t) d_reference_sample_interval * d_block_size;
+    size_t rsis = SEGMENT_CHUNK / (rsi_samples * sample_bytes());
+    if (d_split_iq) {
+        rsis = rsis < 2 ? 2 : rsis & ~(size_t) 1;
+    }
+    return (rsis ? rsis : 1) * rsi_samples;
+}
+
+iqzip_impl::segment_coding_t
+iqzip_impl::coding() const
+{
+    segment_coding_t c;
+    c.block_size = d_block_size;
+    c.rsi = d_reference_sample_interval;
+    c.predictor = d_predictor;
+    c.split_iq = d_split_iq;
+    return c;
+}
+
+iqzip_impl::segment_coding_t
+iqzip_impl::select_coding(const char *in, size_t nbytes) const
+{
+    static const uint16_t block_sizes[] = {8, 16, 32, 64};
+    static const uint16_t intervals[] = {16, 64, 256};
+    const uint8_t predictors = d_sample_resolution > 24 ? 0 :
+                               d_sample_resolution > 16 ?
+                               (uint8_t) compression::header::iqzip_compression_header::NATIVE_PREDICTOR::IQ_DELTA :
+                               (uint8_t) compression::header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS;
+    /* The first sixteenth of a full segment, in whole I/Q pairs */
+    const size_t pair = 2 * sample_bytes();
+    size_t trial = std::min<size_t>(nbytes, SEGMENT_CHUNK / 16);
+    trial -= trial % pair;
+
+    segment_coding_t best = coding();
+    if (!trial) {
+        return best;
+    }
+    size_t best_size = SIZE_MAX;
+    std::vector<char> out;
+    /* Ties keep the candidate tried first */
+    auto consider = [&](const segment_coding_t &c) {
+        if (encode_segment(in, trial, c, out, 0) == AEC_OK
+            && out.size() < best_size) {
+            best_size = out.size();
+            best = c;
+        }
+    };
+
+    segment_coding_t c = best;
+    for (uint8_t predictor = 0; predictor <= predictors; predictor++) {
+        for (int split_iq = 0; split_iq < 2; split_iq++) {
+            c.predictor = predictor;
+            c.split_iq = split_iq;
+            consider(c);
+        }
+    }
+    c = best;
+    for (uint16_t block_size : block_sizes) {
+        c.block_size = block_size;
+        consider(c);
+    }
+    c = best;
+    for (uint16_t rsi : intervals) {
+        c.rsi = rsi;
+        consider(c);
+    }
+    return best;
+}
+
+bool
+iqzip_impl::raw_segment(size_t nbytes, size_t out_bytes) const
+{
+    return d_raw_segments && nbytes == out_bytes;
+}
+
+int
+iqzip_impl::encode_segment(const char *in, size_t nbytes,
+                           std::vector<char> &out) const
+{
+    /* Noise is not worth a trial, let alone coding */
+    if (d_raw_segments
+        && compression::estimate_coded_bits(sample_format(), in,
+                nbytes / sample_bytes()) >= 8 * (uint64_t) nbytes) {
+        out.assign(in, in + nbytes);
+        return AEC_OK;
+    }
+
+    int status;
+    if (!d_adaptive) {
+        status = encode_segment(in, nbytes, coding(), out, 0);
+    }
+    else {
+        segment_coding_t c = select_coding(in, nbytes);
+        status = encode_segment(in, nbytes, c, out, IQZIP_SEGMENT_PARAMS_SIZE);
+        /* The trial only saw the start of the segment, the parameters of the
+         * compressor may still code all of it smaller */
+        const segment_coding_t base = coding();
+        if (status == AEC_OK
+            && (c.block_size != base.block_size || c.rsi != base.rsi
+                || c.predictor != base.predictor
+                || c.split_iq != base.split_iq)) {
+            std::vector<char> alt;
+            if (encode_segment(in, nbytes, base, alt,
+                               IQZIP_SEGMENT_PARAMS_SIZE) == AEC_OK
+                && alt.size() < out.size()) {
+                out.swap(alt);
+                c = base;
+            }
+        }
+        if (status == AEC_OK) {
+            compression::header::iqzip_segment_params params(c.block_size,
+                    c.rsi, c.predictor,
+                    c.split_iq ? IQZIP_CONTAINER_FLAG_SPLIT_IQ : 0);
+            memcpy(out.data(), params.get_segment_params(),
+                   IQZIP_SEGMENT_PARAMS_SIZE);
+        }
+    }
+
+    /* A coded segment must be smaller than a raw one to tell them apart */
+    if (status == AEC_OK && d_raw_segments && out.size() >= nbytes) {
+        out.assign(in, in + nbytes);
+    }
+    return status;
+}
+
+int
+iqzip_impl::encode_segment(const char *in, size_t nbytes,
+                           const segment_coding_t &c, std::vector<char> &out,
+                           size_t offset) const
+{
+    compression::codec_backend_sptr encoder = encoder_backend();
+    aec_stream strm;
+
+    if (!encoder) {
+        return AEC_CONF_ERROR;
+    }
+    init_aec_stream(&strm);
+    strm.block_size = c.block_size;
+    strm.rsi = c.rsi;
+    if (c.predictor) {
+        /* Mapped prediction errors are unsigned and coded as they are */
+        strm.flags &= ~(AEC_DATA_PREPROCESS | AEC_DATA_SIGNED);
+    }
+
+    size_t samples = nbytes / sample_bytes();
+    std::vector<char> mapped;
+    if (c.predictor) {
+        mapped.resize(nbytes);
+        compression::predictor_encode(c.predictor, sample_format(), in, samples,
+                                      mapped.data());
+        in = mapped.data();
+    }
+
+    /* Code the I plane and then the Q plane as one bitstream */
+    std::vector<char> planes;
+    if (c.split_iq) {
+        planes.resize(nbytes);
+        compression::deinterleave_iq(in, samples, sample_bytes(),
+                                     planes.data(),
+                                     &planes[(samples + 1) / 2 * sample_bytes()]);
+        in = planes.data();
+    }
+
+    return encoder->encode_segment(&strm, in, nbytes, out, offset);
+}
+
+int
+iqzip_impl::decode_segment(const char *in, size_t nbytes, char *out,
+                           size_t out_bytes) const
+{
+    if (raw_segment(nbytes, out_bytes)) {
+        memcpy(out, in, out_bytes);
+        return AEC_OK;
+    }
+    if (!d_adaptive) {
+        return decode_segment(in, nbytes, coding(), out, out_bytes);
+    }
+
+    compression::header::iqzip_segment_params params;
+    if (nbytes < IQZIP_SEGMENT_PARAMS_SIZE) {
+        return AEC_DATA_ERROR;
+    }
+    params.set_segment_params(reinterpret_cast<const compression::header::
+                              iqzip_segment_params::segment_params_t *>(in));
+    segment_coding_t c;
+    c.block_size = params.decode_block_size();
+    c.rsi = params.decode_reference_sample_interval();
+    c.predictor = params.decode_predictor();
+    c.split_iq = params.decode_flags() & IQZIP_CONTAINER_FLAG_SPLIT_IQ;
+    if (c.predictor > (uint8_t)
+        compression::header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS) {
+        return AEC_DATA_ERROR;
+    }
+    return decode_segment(in + IQZIP_SEGMENT_PARAMS_SIZE,
+                          nbytes - IQZIP_SEGMENT_PARAMS_SIZE, c, out, out_bytes);
+}
+
+int
+iqzip_impl::decode_segment(const char *in, size_t nbytes,
+                           const segment_coding_t &c, char *out,
+                           size_t out_bytes) const
+{
+    compression::codec_backend_sptr decoder = decoder_backend();
+    aec_stream strm;
+    int status;
+
+    if (!decoder) {
+        return AEC_CONF_ERROR;
+    }
+    init_aec_stream(&strm);
+    strm.block_size = c.block_size;
+    strm.rsi = c.rsi;
+    if (c.predictor) {
+        strm.flags &= ~(AEC_DATA_PREPROCESS | AEC_DATA_SIGNED);
+    }
+
+    /* Split segments are decoded to their planes first */
+    std::vector<char> planes;
+    char *dst = out;
+    if (c.split_iq) {
+        planes.resize(out_bytes);
+        dst = planes.data();
+    }
+
+    status = decoder->decode_segment(&strm, in, nbytes, dst, out_bytes);
+
+    if (status == AEC_OK && c.split_iq) {
+        size_t samples = out_bytes / sample_bytes();
+        compression::interleave_iq(planes.data(),
+                                   &planes[(samples + 1) / 2 * sample_bytes()],
+                                   samples, sample_bytes(), out);
+    }
+    if (status == AEC_OK && c.predictor) {
+        compression::predictor_decode(c.predictor, sample_format(), out,
+                                      out_bytes / sample_bytes(), out);
+    }
+    return status;
+}
+
+ssize_t
+iqzip_impl::read_source(char *buf, size_t nbytes)
+{
+    uint64_t start = compression::stream_stats::now();
+    ssize_t avail = d_source->read(buf, nbytes);
+    d_stats.add_io(start);
+    return avail;
+}
+
+int
+iqzip_impl::write_sink(const char *buf, size_t nbytes)
+{
+    uint64_t start = compression::stream_stats::now();
+    IQZIP_PROBE1(write__start, nbytes);
+    int status = d_sink->write(buf, nbytes);
+    IQZIP_PROBE2(write__done, nbytes, status);
+    d_call_ns[(int) compression::STREAM_STAGE::WRITE] += d_stats.add_io(start);
+    return status;
+}
+
+void
+iqzip_impl::begin_stream_call()
+{
+    for (size_t i = 0; i < STREAM_STAGES; i++) {
+        d_call_ns[i] = 0;
+    }
+    d_call_start = compression::stream_stats::now();
+}
+
+void
+iqzip_impl::end_stream_call()
+{
+    d_call_ns[(int) compression::STREAM_STAGE::CALL] =
+        compression::stream_stats::now() - d_call_start;
+    for (size_t i = 0; i < STREAM_STAGES; i++) {
+        d_latency[i].record(d_call_ns[i]);
+    }
+}
+
+void
+iqzip_impl::stage_copy(char *dst, const char *src, size_t nbytes)
+{
+    uint64_t start = compression::stream_stats::now();
+    std::memcpy(dst, src, nbytes);
+    d_call_ns[(int) compression::STREAM_STAGE::COPY] +=
+        compression::stream_stats::now() - start;
+}
+
+void
+iqzip_impl::reset_stream_latency()
+{
+    for (size_t i = 0; i < STREAM_STAGES; i++) {
+        d_latency[i].reset();
+    }
 }
 
 void
@@ -20,10 +20,15 @@
 #define IQZIP_IMPL_H
 
 #include <cmath>
-#include <fstream>
+#include <vector>
 
 #include <libaec.h>
 #include <iqzip/iqzip_compression_header.h>
+#include <iqzip/stream_io.h>
+#include <iqzip/codec_backend.h>
+#include <iqzip/latency_histogram.h>
+#include "predictor.h"
+#include "stream_stats.h"
 
 namespace iqzip {
 
@@ -31,11 +36,12 @@ class iqzip_impl {
 
 protected:
     uint32_t CHUNK = 10485760;
+    uint32_t SEGMENT_CHUNK = 1048576;
     compression::header::iqzip_compression_header d_ccsds_cip_hdr;
     aec_stream d_strm;
 
-    std::ofstream output_stream;
-    std::ifstream input_stream;
+    compression::source_sptr d_source;
+    compression::sink_sptr d_sink;
 
     uint8_t d_version;
     uint8_t d_type;
@@ -56,6 +62,31 @@ protected:
     uint16_t d_cds_per_packet;
     uint8_t d_restricted_codes;
     uint8_t d_endianness;
+    bool d_split_iq;
+    uint8_t d_predictor;
+    bool d_adaptive;
+    /* Estimate the k of every block instead of searching it, native
+     * encoder only */
+    bool d_estimate_k;
+    bool d_raw_segments;
+    bool d_native_decoder;
+    /* Compressing if built with the coding parameters, decompressing with
+     * the default constructor */
+    compression::stream_stats d_stats;
+    compression::latency_histogram d_latency[STREAM_STAGES];
+    /* The start of the current stream call and the time of its stages */
+    uint64_t d_call_start;
+    uint64_t d_call_ns[STREAM_STAGES];
+
+    /*!
+     * The parameters a segment is coded with
+     */
+    typedef struct segment_coding_t {
+        uint16_t block_size;
+        uint16_t rsi;
+        uint8_t predictor;
+        bool split_iq;
+    } segment_coding_t;
 
     /*!
      * Default constructor
@@ -99,12 +130,186 @@ protected:
      */
     virtual ~iqzip_impl();
 
+    /*!
+     * Builds the CCSDS header from the class members.
+     */
+    void init_header();
+
     /*!
      * Initializes the aec stream from the class members. Used in init*
      * functions.
      */
     void init_aec_stream(void);
 
+    /*!
+     * Initializes an aec stream other than d_strm from the class members.
+     * Used by the segment encoders and decoders that run concurrently.
+     * @param strm the aec stream to initialize
+     */
+    void init_aec_stream(aec_stream *strm) const;
+
+    /*!
+     * Creates the codec backend that encodes with the compression technique
+     * ID.
+     * @return the backend, nullptr if none is registered for the ID
+     */
+    compression::codec_backend_sptr encoder_backend() const;
+
+    /*!
+     * Creates the codec backend that decodes with the compression technique
+     * ID, or the native one if d_native_decoder is set.
+     * @return the backend, nullptr if none is registered for the ID
+     */
+    compression::codec_backend_sptr decoder_backend() const;
+
+    /*!
+     * The number of bytes every sample occupies in the uncompressed data.
+     * @return the sample size in bytes
+     */
+    size_t sample_bytes() const;
+
+    /*!
+     * The layout of the samples, as the native predictors need it.
+     * @return the sample format
+     */
+    compression::sample_format_t sample_format() const;
+
+    /*!
+     * The number of samples of every segment of a segmented file. Segments
+     * always span an integer number of reference sample intervals, and an
+     * even number of them if d_split_iq is set, so that the Q plane of a
+     * segment starts at a reference sample interval of its own.
+     * @return the segment size in samples
+     */
+    size_t segment_samples() const;
+
+    /*!
+     * The segment parameters of the class members.
+     * @return d_block_size, d_reference_sample_interval, d_predictor and
+     * d_split_iq
+     */
+    segment_coding_t coding() const;
+
+    /*!
+     * Picks the parameters of an adaptive segment. The predictor and the
+     * plane split are tried first on the first samples of the segment, then
+     * the block size with the best of them and last the reference sample
+     * interval.
+     * @param in the uncompressed samples of the segment.
+     * @param nbytes number of bytes of in.
+     * @return the parameters that coded the trial samples the smallest
+     */
+    segment_coding_t select_coding(const char *in, size_t nbytes) const;
+
+    /*!
+     * Whether a segment is stored as its samples.
+     * @param nbytes compressed size of the segment in bytes.
+     * @param out_bytes uncompressed size of the segment in bytes.
+     * @return true if d_raw_segments is set and the sizes match
+     */
+    bool raw_segment(size_t nbytes, size_t out_bytes) const;
+
+    /*!
+     * Compresses a segment into an independent aec bitstream. If
+     * d_adaptive is set, the parameters are picked by select_coding, or are
+     * the ones of coding() if those code the whole segment smaller, and are
+     * written before the bitstream. Otherwise they are the ones of coding().
+     * If d_raw_segments is set, a segment that is estimated or coded not to
+     * shrink is stored as its samples instead.
+     * It does not touch any class member, so it can be called from
+     * many threads.
+     * @param in the uncompressed samples of the segment.
+     * @param nbytes number of bytes of in.
+     * @param out the vector that holds the bitstream on return.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int encode_segment(const char *in, size_t nbytes,
+                       std::vector<char> &out) const;
+
+    /*!
+     * Compresses a segment with the parameters of c. If c has a predictor,
+     * the samples are replaced by the mapped errors of that predictor and the
+     * preprocessor of libaec is disabled. If c splits the planes, the I plane
+     * of the segment is coded first, followed by the Q plane.
+     * @param in the uncompressed samples of the segment.
+     * @param nbytes number of bytes of in.
+     * @param c the segment parameters.
+     * @param out the vector that holds the bitstream on return.
+     * @param offset the bytes of out to keep before the bitstream.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int encode_segment(const char *in, size_t nbytes,
+                       const segment_coding_t &c, std::vector<char> &out,
+                       size_t offset) const;
+
+    /*!
+     * Decompresses a segment written by encode_segment, with the parameters
+     * it carries if d_adaptive is set or with the ones of coding(). Raw
+     * segments are copied as they are. It does
+     * not touch any class member, so it can be called from many threads.
+     * @param in the compressed bitstream of the segment.
+     * @param nbytes number of bytes of in.
+     * @param out buffer to write the decompressed samples to.
+     * @param out_bytes the uncompressed size of the segment in bytes.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decode_segment(const char *in, size_t nbytes, char *out,
+                       size_t out_bytes) const;
+
+    /*!
+     * Decompresses the aec bitstream of a segment, merging the I and Q planes
+     * back if c splits them and inverting the predictor of c.
+     * @param in the compressed bitstream of the segment.
+     * @param nbytes number of bytes of in.
+     * @param c the segment parameters.
+     * @param out buffer to write the decompressed samples to.
+     * @param out_bytes the uncompressed size of the segment in bytes.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int decode_segment(const char *in, size_t nbytes,
+                       const segment_coding_t &c, char *out,
+                       size_t out_bytes) const;
+
+    /*!
+     * Reads from d_source, accounting the time in d_stats.
+     * @param buf buffer to read to.
+     * @param nbytes number of bytes to read.
+     * @return as source::read
+     */
+    ssize_t read_source(char *buf, size_t nbytes);
+
+    /*!
+     * Writes to d_sink, accounting the time in d_stats.
+     * @param buf buffer to write.
+     * @param nbytes number of bytes of buf.
+     * @return as sink::write
+     */
+    int write_sink(const char *buf, size_t nbytes);
+
+    /*!
+     * Starts timing the stages of a stream call.
+     */
+    void begin_stream_call();
+
+    /*!
+     * Records the stages of the stream call in d_latency.
+     */
+    void end_stream_call();
+
+    /*!
+     * Copies stream input to or from the staging buffer, accounting the
+     * time in the COPY stage of the stream call.
+     * @param dst the destination.
+     * @param src the source.
+     * @param nbytes number of bytes to copy.
+     */
+    void stage_copy(char *dst, const char *src, size_t nbytes);
+
+    /*!
+     * Zeroes the latency histograms of every stage.
+     */
+    void reset_stream_latency();
+
     /*!
      * Virtual function to print error messages from super classes.
      * @param the value of the error
@@ -0,0 +1,158 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/latency_histogram.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace iqzip {
+
+namespace compression {
+
+#define RELAXED std::memory_order_relaxed
+
+latency_histogram::latency_histogram()
+{
+    reset();
+}
+
+size_t
+latency_histogram::index(uint64_t ns)
+{
+    if (ns < 2 * SUB_BUCKETS) {
+        return ns;
+    }
+    /* The top SUB_BUCKET_BITS + 1 bits of ns, after the octave */
+    size_t shift = 63 - __builtin_clzll(ns) - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKETS + (ns >> shift);
+}
+
+uint64_t
+latency_histogram::upper_bound(size_t index)
+{
+    if (index < 2 * SUB_BUCKETS) {
+        return index;
+    }
+    size_t shift = index / SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t)(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    return lower + (((uint64_t) 1 << shift) - 1);
+}
+
+void
+latency_histogram::record(uint64_t ns)
+{
+    d_counts[index(ns)].fetch_add(1, RELAXED);
+    uint64_t cur = d_max.load(RELAXED);
+    while (ns > cur && !d_max.compare_exchange_weak(cur, ns, RELAXED)) {
+    }
+}
+
+void
+latency_histogram::reset()
+{
+    for (size_t i = 0; i < BUCKETS; i++) {
+        d_counts[i].store(0, RELAXED);
+    }
+    d_max.store(0, RELAXED);
+}
+
+uint64_t
+latency_histogram::count() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        total += d_counts[i].load(RELAXED);
+    }
+    return total;
+}
+
+uint64_t
+latency_histogram::max() const
+{
+    return d_max.load(RELAXED);
+}
+
+uint64_t
+latency_histogram::percentile(double percentile) const
+{
+    std::vector<latency_bucket> b = buckets();
+    uint64_t total = 0;
+    for (const latency_bucket &bucket : b) {
+        total += bucket.count;
+    }
+    if (!total) {
+        return 0;
+    }
+
+    /* The rank of the value, at least the first one */
+    double rank = percentile / 100 * total;
+    uint64_t seen = 0;
+    for (const latency_bucket &bucket : b) {
+        seen += bucket.count;
+        if (seen >= rank) {
+            return std::min(bucket.upper_ns, max());
+        }
+    }
+    return max();
+}
+
+std::vector<latency_bucket>
+latency_histogram::buckets() const
+{
+    std::vector<latency_bucket> b;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        uint64_t count = d_counts[i].load(RELAXED);
+        if (count) {
+            b.push_back({upper_bound(i), count});
+        }
+    }
+    return b;
+}
+
+std::string
+latency_histogram::to_json() const
+{
+    static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    std::vector<latency_bucket> b = buckets();
+    uint64_t total = 0;
+    for (const latency_bucket &bucket : b) {
+        total += bucket.count;
+    }
+    char field[64];
+
+    snprintf(field, sizeof(field), "{\"count\": %llu, \"max\": %llu",
+             (unsigned long long) total, (unsigned long long) max());
+    std::string json = field;
+    for (double p : percentiles) {
+        snprintf(field, sizeof(field), ", \"p%g\": %llu", p,
+                 (unsigned long long) percentile(p));
+        json += field;
+    }
+    json += ", \"buckets\": [";
+    for (size_t i = 0; i < b.size(); i++) {
+        snprintf(field, sizeof(field), "%s[%llu, %llu]", i ? ", " : "",
+                 (unsigned long long) b[i].upper_ns,
+                 (unsigned long long) b[i].count);
+        json += field;
+    }
+    return json + "]}";
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,491 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "predictor.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <iqzip/iqzip_compression_header.h>
+
+namespace iqzip {
+
+namespace compression {
+
+typedef header::iqzip_compression_header::NATIVE_PREDICTOR native_predictor;
+
+/* Building for AVX2 too needs ifunc support from the loader */
+#if defined(__x86_64__) && defined(__GLIBC__)
+#define PREDICTOR_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define PREDICTOR_CLONES
+#endif
+
+/*
+ * Loops specialized on the sample size and byte order, so that the compiler
+ * unrolls the byte loop and vectorizes the 1 and 2 byte little endian cases.
+ */
+template <size_t BYTES, bool MSB>
+PREDICTOR_CLONES static void
+load_samples_t(const uint8_t *p, size_t samples, uint32_t bits, bool is_signed,
+               int32_t *x)
+{
+    const uint32_t shift = 32 - bits;
+    for (size_t i = 0; i < samples; i++, p += BYTES) {
+        uint32_t u = 0;
+        for (size_t b = 0; b < BYTES; b++) {
+            u |= (uint32_t) p[b] << 8 * (MSB ? BYTES - 1 - b : b);
+        }
+        /* Only the low bits hold the sample, as for libaec */
+        x[i] = is_signed ? (int32_t)(u << shift) >> shift
+               : (int32_t)((u << shift) >> shift);
+    }
+}
+
+template <size_t BYTES, bool MSB>
+PREDICTOR_CLONES static void
+store_samples_t(const int32_t *x, size_t samples, uint8_t *p)
+{
+    for (size_t i = 0; i < samples; i++, p += BYTES) {
+        uint32_t u = x[i];
+        for (size_t b = 0; b < BYTES; b++) {
+            p[b] = u >> 8 * (MSB ? BYTES - 1 - b : b);
+        }
+    }
+}
+
+template <bool MSB>
+static void
+load_samples_bo(const sample_format_t &fmt, const uint8_t *p, size_t samples,
+                int32_t *x)
+{
+    switch (fmt.bytes) {
+    case 1:
+        load_samples_t<1, MSB>(p, samples, fmt.bits, fmt.is_signed, x);
+        break;
+    case 2:
+        load_samples_t<2, MSB>(p, samples, fmt.bits, fmt.is_signed, x);
+        break;
+    case 3:
+        load_samples_t<3, MSB>(p, samples, fmt.bits, fmt.is_signed, x);
+        break;
+    default:
+        load_samples_t<4, MSB>(p, samples, fmt.bits, fmt.is_signed, x);
+        break;
+    }
+}
+
+template <bool MSB>
+static void
+store_samples_bo(const sample_format_t &fmt, const int32_t *x, size_t samples,
+                 uint8_t *p)
+{
+    switch (fmt.bytes) {
+    case 1:
+        store_samples_t<1, MSB>(x, samples, p);
+        break;
+    case 2:
+        store_samples_t<2, MSB>(x, samples, p);
+        break;
+    case 3:
+        store_samples_t<3, MSB>(x, samples, p);
+        break;
+    default:
+        store_samples_t<4, MSB>(x, samples, p);
+        break;
+    }
+}
+
+static void
+load_samples(const sample_format_t &fmt, const char *in, size_t samples,
+             int32_t *x)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(in);
+    if (fmt.msb) {
+        load_samples_bo<true>(fmt, p, samples, x);
+    }
+    else {
+        load_samples_bo<false>(fmt, p, samples, x);
+    }
+}
+
+static void
+store_samples(const sample_format_t &fmt, const int32_t *x, size_t samples,
+              char *out)
+{
+    uint8_t *p = reinterpret_cast<uint8_t *>(out);
+    if (fmt.msb) {
+        store_samples_bo<true>(fmt, x, samples, p);
+    }
+    else {
+        store_samples_bo<false>(fmt, x, samples, p);
+    }
+}
+
+/*
+ * The estimate of sample i of an I/Q interleaved sequence from the samples
+ * before it. Channel c = i % 2 only looks at its own history, except for the
+ * IQ-aware delta that adds the last step of I to the estimate of Q.
+ */
+static inline int32_t
+predict(uint8_t predictor, const int32_t *x, size_t i)
+{
+    switch ((native_predictor) predictor) {
+    case native_predictor::POLYNOMIAL_2:
+        if (i >= 4) {
+            return 2 * x[i - 2] - x[i - 4];
+        }
+        return i >= 2 ? x[i - 2] : 0;
+    case native_predictor::CHANNEL_DELTA:
+        return i >= 2 ? x[i - 2] : 0;
+    case native_predictor::IQ_DELTA:
+        if (i >= 3 && (i & 1)) {
+            return x[i - 2] + x[i - 1] - x[i - 3];
+        }
+        return i >= 2 ? x[i - 2] : 0;
+    default:
+        return 0;
+    }
+}
+
+/* The history every predictor needs before the generic loops apply */
+#define PREDICTOR_WARMUP 4
+
+/*
+ * The prediction error mapper of CCSDS 121.0-B, section 4.3. The estimate is
+ * clamped to the sample range first, which makes every mapped value fit in
+ * the sample resolution.
+ */
+static inline int32_t
+map(int32_t x, int32_t p, int32_t xmin, int32_t xmax)
+{
+    p = std::min(std::max(p, xmin), xmax);
+    int32_t delta = x - p;
+    int32_t theta = std::min(p - xmin, xmax - p);
+    int32_t abs_delta = delta < 0 ? -delta : delta;
+    int32_t folded = delta < 0 ? 2 * abs_delta - 1 : 2 * delta;
+    return abs_delta <= theta ? folded : theta + abs_delta;
+}
+
+/* Branch free loops over the samples past the warmup, one per predictor */
+PREDICTOR_CLONES static void
+map_block(uint8_t predictor, const int32_t *x, size_t samples, int32_t xmin,
+          int32_t xmax, int32_t *m)
+{
+    switch ((native_predictor) predictor) {
+    case native_predictor::POLYNOMIAL_2:
+        for (size_t i = PREDICTOR_WARMUP; i < samples; i++) {
+            m[i] = map(x[i], 2 * x[i - 2] - x[i - 4], xmin, xmax);
+        }
+        break;
+    case native_predictor::CHANNEL_DELTA:
+        for (size_t i = PREDICTOR_WARMUP; i < samples; i++) {
+            m[i] = map(x[i], x[i - 2], xmin, xmax);
+        }
+        break;
+    case native_predictor::IQ_DELTA:
+        for (size_t i = PREDICTOR_WARMUP; i < samples; i++) {
+            m[i] = map(x[i], x[i - 2] + (int32_t)(i & 1) * (x[i - 1] - x[i - 3]),
+                       xmin, xmax);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static inline int32_t
+unmap(int32_t m, int32_t p, int32_t xmin, int32_t xmax)
+{
+    p = std::min(std::max(p, xmin), xmax);
+    int32_t theta = std::min(p - xmin, xmax - p);
+    if (m <= 2 * theta) {
+        return p + ((m & 1) ? -((m + 1) >> 1) : m >> 1);
+    }
+    /* Past the fold the error lies on the side with more room */
+    return p + (theta == p - xmin ? m - theta : theta - m);
+}
+
+static void
+sample_range(const sample_format_t &fmt, int32_t *xmin, int32_t *xmax)
+{
+    if (fmt.is_signed) {
+        *xmin = -(int32_t)(1u << (fmt.bits - 1));
+        *xmax = (int32_t)(1u << (fmt.bits - 1)) - 1;
+    }
+    else {
+        *xmin = 0;
+        *xmax = (int32_t)((1ull << fmt.bits) - 1);
+    }
+}
+
+/* Taps of the complex NLMS predictor, in I/Q pairs */
+#define NLMS_TAPS 4
+/* Fraction bits of the fixed point weights */
+#define NLMS_WEIGHT_BITS 24
+/* Weights are kept within +-8, far past any stable predictor */
+#define NLMS_WEIGHT_MAX (1 << (NLMS_WEIGHT_BITS + 3))
+/* The step size is 2^-NLMS_MU_SHIFT */
+#define NLMS_MU_SHIFT 3
+/* Keeps the step bounded when the history is silent */
+#define NLMS_EPSILON (1 << 10)
+
+/*
+ * State of the complex NLMS predictor. Tap k holds the pair k + 1 steps
+ * back, centered around zero.
+ */
+typedef struct nlms_state_t {
+    int32_t wr[NLMS_TAPS];
+    int32_t wi[NLMS_TAPS];
+    int32_t zr[NLMS_TAPS];
+    int32_t zi[NLMS_TAPS];
+} nlms_state_t;
+
+static inline int64_t
+round_shift(int64_t v, uint32_t shift)
+{
+    return (v + ((int64_t) 1 << (shift - 1))) >> shift;
+}
+
+static inline int32_t
+clamp_weight(int64_t w)
+{
+    return (int32_t) std::min<int64_t>(std::max<int64_t>(w, -NLMS_WEIGHT_MAX),
+                                       NLMS_WEIGHT_MAX);
+}
+
+/* Starts as a unit delay on the complex samples */
+static void
+nlms_init(nlms_state_t *st)
+{
+    for (size_t k = 0; k < NLMS_TAPS; k++) {
+        st->wr[k] = 0;
+        st->wi[k] = 0;
+        st->zr[k] = 0;
+        st->zi[k] = 0;
+    }
+    st->wr[0] = 1 << NLMS_WEIGHT_BITS;
+}
+
+static inline void
+nlms_predict(const nlms_state_t *st, int32_t *pr, int32_t *pi)
+{
+    int64_t ar = 0;
+    int64_t ai = 0;
+    for (size_t k = 0; k < NLMS_TAPS; k++) {
+        ar += (int64_t) st->wr[k] * st->zr[k] - (int64_t) st->wi[k] * st->zi[k];
+        ai += (int64_t) st->wr[k] * st->zi[k] + (int64_t) st->wi[k] * st->zr[k];
+    }
+    *pr = (int32_t) round_shift(ar, NLMS_WEIGHT_BITS);
+    *pi = (int32_t) round_shift(ai, NLMS_WEIGHT_BITS);
+}
+
+/*
+ * w += mu * e * conj(z) / (epsilon + |z|^2), with one integer division per
+ * pair. The reciprocal of the energy is taken on its 16 most significant
+ * bits, which keeps every product within 64 bits for samples of up to 16
+ * bits.
+ */
+static inline void
+nlms_update(nlms_state_t *st, int32_t zr, int32_t zi, int32_t er, int32_t ei)
+{
+    int64_t energy = NLMS_EPSILON;
+    for (size_t k = 0; k < NLMS_TAPS; k++) {
+        energy += (int64_t) st->zr[k] * st->zr[k]
+                  + (int64_t) st->zi[k] * st->zi[k];
+    }
+    /* energy is at least NLMS_EPSILON, the quotient fits in 32 bits */
+    int bits = 64 - __builtin_clzll((uint64_t) energy);
+    uint32_t shift = bits > 16 ? bits - 16 : 0;
+    int64_t recip = (uint32_t)(1u << 30) / (uint32_t)(energy >> shift);
+    uint32_t down = 30 + shift + NLMS_MU_SHIFT - NLMS_WEIGHT_BITS;
+
+    for (size_t k = 0; k < NLMS_TAPS; k++) {
+        int64_t tr = (int64_t) er * st->zr[k] + (int64_t) ei * st->zi[k];
+        int64_t ti = (int64_t) ei * st->zr[k] - (int64_t) er * st->zi[k];
+        st->wr[k] = clamp_weight(st->wr[k] + round_shift(tr * recip, down));
+        st->wi[k] = clamp_weight(st->wi[k] + round_shift(ti * recip, down));
+    }
+    for (size_t k = NLMS_TAPS - 1; k > 0; k--) {
+        st->zr[k] = st->zr[k - 1];
+        st->zi[k] = st->zi[k - 1];
+    }
+    st->zr[0] = zr;
+    st->zi[0] = zi;
+}
+
+/*
+ * Runs the complex NLMS predictor over the pairs of x. The encoder maps x
+ * into m, the decoder unmaps m into x, so both see the same history and
+ * adapt the weights identically. m and x may be the same array. A trailing
+ * I sample without its Q is predicted from the previous I.
+ */
+template <bool DECODE>
+static void
+nlms_run(int32_t *x, int32_t *m, size_t samples, int32_t xmin, int32_t xmax)
+{
+    /* The weights see zero mean samples */
+    const int32_t mid = xmin < 0 ? 0 : (int32_t)((xmax + 1u) >> 1);
+    nlms_state_t st;
+    nlms_init(&st);
+
+    size_t i = 0;
+    for (; i + 1 < samples; i += 2) {
+        int32_t pr, pi;
+        nlms_predict(&st, &pr, &pi);
+        pr = std::min(std::max(pr + mid, xmin), xmax);
+        pi = std::min(std::max(pi + mid, xmin), xmax);
+        if (DECODE) {
+            x[i] = unmap(m[i], pr, xmin, xmax);
+            x[i + 1] = unmap(m[i + 1], pi, xmin, xmax);
+        }
+        else {
+            m[i] = map(x[i], pr, xmin, xmax);
+            m[i + 1] = map(x[i + 1], pi, xmin, xmax);
+        }
+        nlms_update(&st, x[i] - mid, x[i + 1] - mid, x[i] - pr, x[i + 1] - pi);
+    }
+    if (i < samples) {
+        int32_t p = i ? x[i - 2] : mid;
+        if (DECODE) {
+            x[i] = unmap(m[i], p, xmin, xmax);
+        }
+        else {
+            m[i] = map(x[i], p, xmin, xmax);
+        }
+    }
+}
+
+void
+predictor_encode(uint8_t predictor, const sample_format_t &fmt,
+                 const char *in, size_t samples, char *out)
+{
+    std::vector<int32_t> x(samples);
+    std::vector<int32_t> m(samples);
+    int32_t xmin, xmax;
+
+    sample_range(fmt, &xmin, &xmax);
+    load_samples(fmt, in, samples, x.data());
+    if (predictor == (uint8_t) native_predictor::COMPLEX_NLMS) {
+        nlms_run<false>(x.data(), m.data(), samples, xmin, xmax);
+    }
+    else {
+        for (size_t i = 0; i < std::min<size_t>(samples, PREDICTOR_WARMUP); i++) {
+            m[i] = map(x[i], predict(predictor, x.data(), i), xmin, xmax);
+        }
+        map_block(predictor, x.data(), samples, xmin, xmax, m.data());
+    }
+    store_samples(fmt, m.data(), samples, out);
+}
+
+void
+predictor_decode(uint8_t predictor, const sample_format_t &fmt,
+                 const char *in, size_t samples, char *out)
+{
+    std::vector<int32_t> x(samples);
+    int32_t xmin, xmax;
+
+    sample_range(fmt, &xmin, &xmax);
+    /* Mapped values are unsigned */
+    sample_format_t mapped = fmt;
+    mapped.is_signed = false;
+    load_samples(mapped, in, samples, x.data());
+    if (predictor == (uint8_t) native_predictor::COMPLEX_NLMS) {
+        nlms_run<true>(x.data(), x.data(), samples, xmin, xmax);
+    }
+    else {
+        for (size_t i = 0; i < samples; i++) {
+            x[i] = unmap(x[i], predict(predictor, x.data(), i), xmin, xmax);
+        }
+    }
+    store_samples(fmt, x.data(), samples, out);
+}
+
+/* The estimate looks at one window of samples out of every ESTIMATE_STRIDE */
+#define ESTIMATE_WINDOW 512
+#define ESTIMATE_STRIDE 4
+/* The block size the estimate assumes */
+#define ESTIMATE_BLOCK 16
+
+/*
+ * Bits of a block of mapped values with the best split sample option, or
+ * verbatim. Zero blocks and the second extension only pay off on data that
+ * compresses anyway, so they are left out.
+ */
+static uint64_t
+block_bits(const int32_t *m, size_t n, uint32_t bits)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += m[i];
+    }
+
+    /* The best k lies within one of the log2 of the mean */
+    uint32_t k0 = 0;
+    while (k0 + 1 < bits && (sum >> (k0 + 1)) >= n) {
+        k0++;
+    }
+    uint64_t best = (uint64_t) n * bits;
+    for (uint32_t k = k0 ? k0 - 1 : 0; k <= k0 + 1 && k < bits; k++) {
+        uint64_t len = (uint64_t) n * (k + 1);
+        for (size_t i = 0; i < n; i++) {
+            len += (uint32_t) m[i] >> k;
+        }
+        best = std::min(best, len);
+    }
+    /* Option id */
+    return best + (bits > 16 ? 5 : bits > 8 ? 4 : 3);
+}
+
+uint64_t
+estimate_coded_bits(const sample_format_t &fmt, const char *in,
+                    size_t samples)
+{
+    std::vector<int32_t> x(ESTIMATE_WINDOW);
+    std::vector<int32_t> m(ESTIMATE_WINDOW);
+    /* No predictor, unit delay and channel delta, by their lag */
+    uint64_t cost[3] = {0, 0, 0};
+    uint64_t seen = 0;
+    int32_t xmin, xmax;
+
+    sample_range(fmt, &xmin, &xmax);
+    for (size_t w = 0; w < samples; w += ESTIMATE_WINDOW * ESTIMATE_STRIDE) {
+        size_t n = std::min<size_t>(ESTIMATE_WINDOW, samples - w);
+        load_samples(fmt, &in[w * fmt.bytes], n, x.data());
+        for (size_t lag = 0; lag < 3; lag++) {
+            for (size_t i = 0; i < n; i++) {
+                m[i] = lag && i >= lag ? map(x[i], x[i - lag], xmin, xmax)
+                       : x[i] - xmin;
+            }
+            for (size_t b = 0; b < n; b += ESTIMATE_BLOCK) {
+                cost[lag] += block_bits(&m[b],
+                                        std::min<size_t>(ESTIMATE_BLOCK, n - b),
+                                        fmt.bits);
+            }
+        }
+        seen += n;
+    }
+    if (!seen) {
+        return 0;
+    }
+    return std::min(std::min(cost[0], cost[1]), cost[2]) * samples / seen;
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,103 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Native predictors and mapper
+ *
+ * Application specific alternatives to the unit delay predictor of libaec.
+ * The samples are treated as interleaved I/Q pairs, so every predictor
+ * estimates a sample from the history of its own channel. The prediction
+ * error is mapped to an unsigned integer of the same resolution with the
+ * prediction error mapper of the CCSDS 121.0-B Blue Book, so libaec codes
+ * the result with its preprocessor disabled.
+ *
+ * The forward transform has no dependency between samples and is written
+ * as plain loops over 32 bit integers that the compiler vectorizes. They
+ * are built for AVX2 and for the baseline, the right clone is picked at
+ * load time. The inverse needs every decoded sample before the next one, so
+ * it is sequential.
+ *
+ * The complex NLMS predictor treats every I/Q pair as one complex sample
+ * and adapts its weights to the signal, both ways in fixed point so the
+ * decoder tracks the encoder bit for bit. It is sequential in both
+ * directions and handles samples of up to 16 bits.
+ */
+
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * The layout of the samples in memory
+ */
+typedef struct sample_format_t {
+    size_t bytes;
+    uint32_t bits;
+    bool is_signed;
+    bool msb;
+} sample_format_t;
+
+/*!
+ * Replaces samples with their mapped prediction errors.
+ * @param predictor one of iqzip_compression_header::NATIVE_PREDICTOR.
+ * @param fmt the layout of the samples, in and out alike.
+ * @param in the samples.
+ * @param samples number of samples of in.
+ * @param out buffer for the mapped prediction errors. They are unsigned and
+ * fit in fmt.bits.
+ */
+void predictor_encode(uint8_t predictor, const sample_format_t &fmt,
+                      const char *in, size_t samples, char *out);
+
+/*!
+ * Restores the samples from their mapped prediction errors. The inverse of
+ * predictor_encode, in and out may be the same buffer.
+ * @param predictor one of iqzip_compression_header::NATIVE_PREDICTOR.
+ * @param fmt the layout of the samples, in and out alike.
+ * @param in the mapped prediction errors.
+ * @param samples number of samples of in.
+ * @param out buffer for the samples.
+ */
+void predictor_decode(uint8_t predictor, const sample_format_t &fmt,
+                      const char *in, size_t samples, char *out);
+
+/*!
+ * Estimates the size of the aec bitstream of samples, without coding them.
+ * Windows spread over the samples are mapped with no predictor, with the
+ * unit delay predictor and with the delta of each channel, and every block
+ * of them is costed with the split sample option that suits it best. The
+ * estimate is the cheapest of the three, scaled to all of the samples.
+ * @param fmt the layout of the samples.
+ * @param in the samples.
+ * @param samples number of samples of in.
+ * @return the estimated size in bits
+ */
+uint64_t estimate_coded_bits(const sample_format_t &fmt, const char *in,
+                             size_t samples);
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* PREDICTOR_H */
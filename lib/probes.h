@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief USDT probes
+ *
+ * Static tracepoints of the iqzip provider, for bpftrace, perf or
+ * SystemTap to attach to a running process. They are built with the
+ * ENABLE_USDT CMake option, which requires sys/sdt.h, and are a single nop
+ * each until a tracer attaches. Without the option they compile to nothing
+ * and their arguments are not evaluated.
+ *
+ * Probes come in start and done pairs, named with dashes in the tracers,
+ * e.g. usdt:libiqzip.so:iqzip:encode-start:
+ * - encode-start (bytes available), encode-done (bytes consumed, bytes
+ *   produced), around every call of the encoder
+ * - decode-start and decode-done, the same around the decoder
+ * - write-start (bytes), write-done (bytes, status), around every write
+ *   of the output
+ * - compress-segment-start (segment, bytes), compress-segment-done
+ *   (segment, compressed bytes, status), around the coding of a segment
+ * - decompress-segment-start (segment, compressed bytes),
+ *   decompress-segment-done (segment, bytes, status), the same for
+ *   decoding
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef IQZIP_USDT
+
+#include <sys/sdt.h>
+
+#define IQZIP_PROBE1(name, a) STAP_PROBE1(iqzip, name, a)
+#define IQZIP_PROBE2(name, a, b) STAP_PROBE2(iqzip, name, a, b)
+#define IQZIP_PROBE3(name, a, b, c) STAP_PROBE3(iqzip, name, a, b, c)
+
+#else
+
+/* sizeof keeps the arguments used without evaluating them */
+#define IQZIP_PROBE1(name, a) do { (void) sizeof(a); } while (0)
+#define IQZIP_PROBE2(name, a, b) \
+    do { (void) sizeof(a); (void) sizeof(b); } while (0)
+#define IQZIP_PROBE3(name, a, b, c) \
+    do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); } while (0)
+
+#endif /* IQZIP_USDT */
+
+#endif /* PROBES_H */
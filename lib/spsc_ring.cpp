@@ -0,0 +1,143 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spsc_ring.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace iqzip {
+
+namespace compression {
+
+int
+lock_memory(void *buf, size_t nbytes)
+{
+    if (!nbytes) {
+        return 0;
+    }
+    /* Fault every page in now rather than on first use */
+    volatile char *p = reinterpret_cast<volatile char *>(buf);
+    const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < nbytes; i += page) {
+        p[i] = p[i];
+    }
+    return mlock(buf, nbytes);
+}
+
+void
+unlock_memory(void *buf, size_t nbytes)
+{
+    if (nbytes) {
+        munlock(buf, nbytes);
+    }
+}
+
+void *
+cache_aligned::operator new(size_t size)
+{
+    void *p;
+    if (posix_memalign(&p, SPSC_CACHE_LINE, size)) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void
+cache_aligned::operator delete(void *p)
+{
+    free(p);
+}
+
+spsc_ring::spsc_ring(size_t capacity) :
+    d_buf(capacity),
+    d_locked(false),
+    d_head(0),
+    d_tail(0)
+{
+}
+
+spsc_ring::~spsc_ring()
+{
+    if (d_locked) {
+        unlock_memory(d_buf.data(), d_buf.size());
+    }
+}
+
+int
+spsc_ring::lock()
+{
+    d_locked = !lock_memory(d_buf.data(), d_buf.size());
+    return d_locked ? 0 : -1;
+}
+
+size_t
+spsc_ring::capacity() const
+{
+    return d_buf.size();
+}
+
+size_t
+spsc_ring::size() const
+{
+    return d_head.load(std::memory_order_acquire)
+           - d_tail.load(std::memory_order_acquire);
+}
+
+bool
+spsc_ring::push(const char *buf, size_t nbytes)
+{
+    const uint64_t head = d_head.load(std::memory_order_relaxed);
+    const uint64_t tail = d_tail.load(std::memory_order_acquire);
+    if (nbytes > d_buf.size() - (head - tail)) {
+        return false;
+    }
+    /* Copy up to the end of the storage, then wrap around */
+    size_t pos = head % d_buf.size();
+    size_t first = std::min(nbytes, d_buf.size() - pos);
+    std::memcpy(&d_buf[pos], buf, first);
+    std::memcpy(&d_buf[0], buf + first, nbytes - first);
+    d_head.store(head + nbytes, std::memory_order_release);
+    return true;
+}
+
+size_t
+spsc_ring::peek(const char **span) const
+{
+    const uint64_t tail = d_tail.load(std::memory_order_relaxed);
+    const uint64_t head = d_head.load(std::memory_order_acquire);
+    size_t pos = tail % d_buf.size();
+    *span = &d_buf[pos];
+    return std::min<uint64_t>(head - tail, d_buf.size() - pos);
+}
+
+void
+spsc_ring::consume(size_t nbytes)
+{
+    d_tail.store(d_tail.load(std::memory_order_relaxed) + nbytes,
+                 std::memory_order_release);
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,139 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Lock-free single producer, single consumer byte ring
+ *
+ * spsc_ring passes bytes from one thread to another without locks, system
+ * calls or allocations. The storage is allocated once in the constructor and
+ * can be locked in memory, so the producer side is safe to call from real-time
+ * threads.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iqzip {
+
+namespace compression {
+
+/*!
+ * Touches every page of buf and locks it in memory, so that accessing it
+ * never causes a page fault.
+ * @param buf the memory to lock.
+ * @param nbytes number of bytes of buf.
+ * @return 0 on success, != 0 if the pages could not be locked.
+ */
+int lock_memory(void *buf, size_t nbytes);
+
+/*!
+ * Unlocks memory locked by lock_memory.
+ * @param buf the memory to unlock.
+ * @param nbytes number of bytes of buf.
+ */
+void unlock_memory(void *buf, size_t nbytes);
+
+/* The counters of a ring sit on cache lines of their own */
+#define SPSC_CACHE_LINE 64
+
+/*!
+ * Base of the classes that hold cache line aligned members. Before C++17
+ * new ignores alignments beyond the one of std::max_align_t, so objects of
+ * those classes are allocated with posix_memalign instead.
+ */
+class cache_aligned {
+
+public:
+
+    static void *operator new(size_t size);
+
+    static void operator delete(void *p);
+};
+
+class spsc_ring : public cache_aligned {
+
+public:
+
+    /*!
+     * Constructor.
+     * @param capacity the size of the ring in bytes.
+     */
+    spsc_ring(size_t capacity);
+
+    ~spsc_ring();
+
+    /*!
+     * Locks the storage of the ring in memory.
+     * @return 0 on success, != 0 otherwise.
+     */
+    int lock();
+
+    /*!
+     * @return the size of the ring in bytes.
+     */
+    size_t capacity() const;
+
+    /*!
+     * The number of bytes written but not consumed yet. Exact only when
+     * called from the producer or the consumer thread.
+     * @return the fill level in bytes.
+     */
+    size_t size() const;
+
+    /*!
+     * Appends nbytes of buf to the ring. Producer side.
+     * @param buf the bytes to append.
+     * @param nbytes number of bytes of buf.
+     * @return true on success, false if they do not fit. Nothing is written
+     * in that case.
+     */
+    bool push(const char *buf, size_t nbytes);
+
+    /*!
+     * Get the oldest bytes of the ring that are contiguous in memory.
+     * Consumer side.
+     * @param span the start of the bytes on return.
+     * @return the number of bytes at span, 0 if the ring is empty.
+     */
+    size_t peek(const char **span) const;
+
+    /*!
+     * Releases the nbytes oldest bytes of the ring to the producer. Consumer
+     * side.
+     * @param nbytes number of bytes to release, up to what peek returned.
+     */
+    void consume(size_t nbytes);
+
+private:
+    std::vector<char> d_buf;
+    bool d_locked;
+    /* The producer and the consumer advance their own counter only */
+    alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> d_head;
+    alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> d_tail;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* SPSC_RING_H */
@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/stream_io.h>
+
+namespace iqzip {
+
+namespace compression {
+
+file_sink::file_sink(const std::string path) :
+    d_stream(path, std::ios::out | std::ios::binary)
+{
+}
+
+file_sink::~file_sink()
+{
+}
+
+bool
+file_sink::is_open() const
+{
+    return d_stream.is_open();
+}
+
+int
+file_sink::write(const char *buf, size_t nbytes)
+{
+    d_stream.write(buf, nbytes);
+    return d_stream ? 0 : -1;
+}
+
+int
+file_sink::close()
+{
+    if (d_stream.is_open()) {
+        d_stream.close();
+    }
+    return d_stream ? 0 : -1;
+}
+
+file_source::file_source(const std::string path) :
+    d_stream(path, std::ios::in | std::ios::binary)
+{
+}
+
+file_source::~file_source()
+{
+}
+
+bool
+file_source::is_open() const
+{
+    return d_stream.is_open();
+}
+
+ssize_t
+file_source::read(char *buf, size_t nbytes)
+{
+    d_stream.read(buf, nbytes);
+    if (d_stream.bad()) {
+        return -1;
+    }
+    return d_stream.gcount();
+}
+
+int
+file_source::seek(uint64_t offset)
+{
+    d_stream.clear();
+    d_stream.seekg(offset);
+    return d_stream ? 0 : -1;
+}
+
+int64_t
+file_source::size()
+{
+    d_stream.clear();
+    std::streampos pos = d_stream.tellg();
+    d_stream.seekg(0, std::ios::end);
+    int64_t size = d_stream.tellg();
+    d_stream.seekg(pos);
+    return size;
+}
+
+int
+file_source::close()
+{
+    if (d_stream.is_open()) {
+        d_stream.close();
+    }
+    return 0;
+}
+
+} // namespace compression
+
+} // namespace iqzip
@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stream_stats.h"
+
+#include <chrono>
+
+namespace iqzip {
+
+namespace compression {
+
+#define RELAXED std::memory_order_relaxed
+
+/*
+ * Raises a high water mark. Only the coding thread raises the marks, but
+ * the loop keeps them right if threads ever race.
+ */
+static void
+raise_mark(std::atomic<uint64_t> &mark, uint64_t value)
+{
+    uint64_t cur = mark.load(RELAXED);
+    while (value > cur && !mark.compare_exchange_weak(cur, value, RELAXED)) {
+    }
+}
+
+stream_stats::stream_stats(bool compressing) :
+    d_compressing(compressing)
+{
+    reset();
+}
+
+uint64_t
+stream_stats::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t
+stream_stats::add_codec(uint64_t start, size_t in, size_t out)
+{
+    uint64_t ns = now() - start;
+    d_codec_ns.fetch_add(ns, RELAXED);
+    d_codec_calls.fetch_add(1, RELAXED);
+    d_bytes_in.fetch_add(in, RELAXED);
+    d_bytes_out.fetch_add(out, RELAXED);
+    raise_mark(d_output_high_water, out);
+    return ns;
+}
+
+uint64_t
+stream_stats::add_io(uint64_t start)
+{
+    uint64_t ns = now() - start;
+    d_io_ns.fetch_add(ns, RELAXED);
+    d_io_calls.fetch_add(1, RELAXED);
+    return ns;
+}
+
+void
+stream_stats::add_stream_call(size_t staged)
+{
+    d_stream_calls.fetch_add(1, RELAXED);
+    raise_mark(d_staged_high_water, staged);
+}
+
+void
+stream_stats::reset()
+{
+    d_bytes_in.store(0, RELAXED);
+    d_bytes_out.store(0, RELAXED);
+    d_codec_ns.store(0, RELAXED);
+    d_io_ns.store(0, RELAXED);
+    d_codec_calls.store(0, RELAXED);
+    d_io_calls.store(0, RELAXED);
+    d_stream_calls.store(0, RELAXED);
+    d_staged_high_water.store(0, RELAXED);
+    d_output_high_water.store(0, RELAXED);
+    d_window_in.store(0, RELAXED);
+    d_window_out.store(0, RELAXED);
+}
+
+double
+stream_stats::ratio(uint64_t in, uint64_t out) const
+{
+    uint64_t compressed = d_compressing ? out : in;
+    uint64_t samples = d_compressing ? in : out;
+    return compressed ? (double) samples / compressed : 0;
+}
+
+codec_stats
+stream_stats::snapshot()
+{
+    codec_stats s;
+    s.bytes_in = d_bytes_in.load(RELAXED);
+    s.bytes_out = d_bytes_out.load(RELAXED);
+    s.codec_ns = d_codec_ns.load(RELAXED);
+    s.io_ns = d_io_ns.load(RELAXED);
+    s.codec_calls = d_codec_calls.load(RELAXED);
+    s.io_calls = d_io_calls.load(RELAXED);
+    s.stream_calls = d_stream_calls.load(RELAXED);
+    s.staged_high_water = d_staged_high_water.load(RELAXED);
+    s.output_high_water = d_output_high_water.load(RELAXED);
+    s.ratio = ratio(s.bytes_in, s.bytes_out);
+    /* A reset in between leaves the window behind the counters */
+    uint64_t window_in = d_window_in.exchange(s.bytes_in, RELAXED);
+    uint64_t window_out = d_window_out.exchange(s.bytes_out, RELAXED);
+    if (window_in > s.bytes_in || window_out > s.bytes_out) {
+        window_in = 0;
+        window_out = 0;
+    }
+    s.current_ratio = ratio(s.bytes_in - window_in, s.bytes_out - window_out);
+    return s;
+}
+
+} // namespace compression
+
+} // namespace iqzip
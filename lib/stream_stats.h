@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \brief Counters behind get_stats()
+ *
+ * stream_stats keeps the counters of a compressor or a decompressor in
+ * relaxed atomics, so the coding threads update them without locks and a
+ * monitoring thread reads them at any time.
+ */
+
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <iqzip/codec_stats.h>
+
+namespace iqzip {
+
+namespace compression {
+
+class stream_stats {
+
+public:
+
+    /*!
+     * @param compressing true if bytes_in are samples and bytes_out
+     * compressed data, false for the opposite.
+     */
+    stream_stats(bool compressing);
+
+    /*!
+     * A monotonic timestamp for the add_ functions.
+     * @return the time in nanoseconds
+     */
+    static uint64_t now();
+
+    /*!
+     * Accounts a call of the encoder or the decoder.
+     * @param start the now() before the call.
+     * @param in bytes the call consumed.
+     * @param out bytes the call produced.
+     * @return the duration of the call in nanoseconds
+     */
+    uint64_t add_codec(uint64_t start, size_t in, size_t out);
+
+    /*!
+     * Accounts a read of the source or a write of the sink.
+     * @param start the now() before the call.
+     * @return the duration of the call in nanoseconds
+     */
+    uint64_t add_io(uint64_t start);
+
+    /*!
+     * Accounts a call of stream_compress or stream_decompress.
+     * @param staged bytes held back for the next call on return.
+     */
+    void add_stream_call(size_t staged);
+
+    /*!
+     * Zeroes every counter, for a new stream.
+     */
+    void reset();
+
+    /*!
+     * Reads the counters and starts a new window for current_ratio.
+     * @return the snapshot
+     */
+    codec_stats snapshot();
+
+private:
+    const bool d_compressing;
+    std::atomic<uint64_t> d_bytes_in;
+    std::atomic<uint64_t> d_bytes_out;
+    std::atomic<uint64_t> d_codec_ns;
+    std::atomic<uint64_t> d_io_ns;
+    std::atomic<uint64_t> d_codec_calls;
+    std::atomic<uint64_t> d_io_calls;
+    std::atomic<uint64_t> d_stream_calls;
+    std::atomic<uint64_t> d_staged_high_water;
+    std::atomic<uint64_t> d_output_high_water;
+    /* The bytes of the previous snapshot */
+    std::atomic<uint64_t> d_window_in;
+    std::atomic<uint64_t> d_window_out;
+
+    double ratio(uint64_t in, uint64_t out) const;
+};
+
+} // namespace compression
+
+} // namespace iqzip
+
+#endif /* STREAM_STATS_H */
@@ -0,0 +1,300 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iqzip/ccsds_types.h>
+#include <iqzip/compressor.h>
+#include <iqzip/iqzip_compression_header.h>
+#include <iqzip/tuner.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace iqzip {
+
+namespace compression {
+
+/* The sample is read in chunks of this size */
+#define TUNE_CHUNK 1048576
+
+/*
+ * A source over a buffer in memory
+ */
+class buffer_source : public source {
+
+public:
+    buffer_source(const std::vector<char> &buf) :
+        d_buf(buf),
+        d_pos(0)
+    {
+    }
+
+    ssize_t read(char *buf, size_t nbytes)
+    {
+        nbytes = std::min(nbytes, d_buf.size() - d_pos);
+        memcpy(buf, &d_buf[d_pos], nbytes);
+        d_pos += nbytes;
+        return nbytes;
+    }
+
+    int seek(uint64_t offset)
+    {
+        if (offset > d_buf.size()) {
+            return -1;
+        }
+        d_pos = offset;
+        return 0;
+    }
+
+    int64_t size()
+    {
+        return d_buf.size();
+    }
+
+private:
+    const std::vector<char> &d_buf;
+    size_t d_pos;
+};
+
+/*
+ * A sink that only counts the bytes written to it
+ */
+class counting_sink : public sink {
+
+public:
+    counting_sink() :
+        d_bytes(0)
+    {
+    }
+
+    int write(const char * /* buf */, size_t nbytes)
+    {
+        d_bytes += nbytes;
+        return 0;
+    }
+
+    uint64_t bytes() const
+    {
+        return d_bytes;
+    }
+
+private:
+    uint64_t d_bytes;
+};
+
+static size_t
+sample_size(uint8_t sample_resolution)
+{
+    if (sample_resolution > 24) {
+        return 4;
+    }
+    else if (sample_resolution > 16) {
+        return 3;
+    }
+    else if (sample_resolution > 8) {
+        return 2;
+    }
+    return 1;
+}
+
+/*
+ * Reads about sample_bytes of fin, in chunks spread evenly over the file and
+ * aligned to I/Q pairs.
+ */
+static int
+read_sample(const std::string fin, uint64_t sample_bytes, size_t pair_bytes,
+            std::vector<char> &sample)
+{
+    file_source in(fin);
+    if (!in.is_open()) {
+        std::cout << "Error opening input file" << std::endl;
+        return -1;
+    }
+    int64_t size = in.size();
+    if (size < 0) {
+        std::cout << "Error reading input" << std::endl;
+        return -1;
+    }
+
+    const size_t chunk = TUNE_CHUNK - TUNE_CHUNK % pair_bytes;
+    uint64_t chunks = std::max<uint64_t>(sample_bytes / chunk, 1);
+    uint64_t stride = (uint64_t) size / chunks;
+    if ((uint64_t) size <= sample_bytes || stride < chunk) {
+        chunks = 1;
+        stride = 0;
+    }
+    stride -= stride % pair_bytes;
+    size_t len = chunks == 1 ? std::min<uint64_t>(size, sample_bytes) : chunk;
+
+    sample.resize(chunks * len);
+    size_t avail = 0;
+    for (uint64_t i = 0; i < chunks; i++) {
+        ssize_t read;
+        if (in.seek(i * stride)
+            || (read = in.read(&sample[avail], len)) < 0) {
+            std::cout << "Error reading input" << std::endl;
+            return -1;
+        }
+        avail += read;
+    }
+    sample.resize(avail - avail % pair_bytes);
+    in.close();
+    return 0;
+}
+
+/*
+ * Compresses sample with the parameters of r and fills in its outcome.
+ */
+static int
+run_trial(const std::vector<char> &sample, uint8_t sample_resolution,
+          uint8_t data_sense, uint8_t endianness, tune_result &r)
+{
+    compressor_sptr comp = create_compressor(
+                               (uint8_t)header::PACKET_VERSION::CCSDS_PACKET_VERSION_1,
+                               (uint8_t)header::PACKET_TYPE::CCSDS_TELECOMMAND,
+                               (uint8_t)header::PACKET_SECONDARY_HEADER_FLAG::SEC_HDR_PRESENT,
+                               (uint16_t)header::PACKET_APPLICATION_PROCESS_IDENTIFIER::IDLE_PACKET,
+                               (uint8_t)header::PACKET_SEQUENCE_FLAGS::CONTINUATION_SEGMENT,
+                               (uint16_t)0xdffe, (uint16_t)0x7efe, (uint16_t)0xffff,
+                               (uint8_t)header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION,
+                               r.reference_sample_interval, (uint8_t)1,
+                               (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC,
+                               (uint8_t)header::PREPROCESSOR_MAPPER_TYPE::PREDICTION_ERROR,
+                               r.block_size, data_sense, sample_resolution, (uint16_t)1,
+                               r.restricted_codes, endianness, 0, r.split_iq, r.predictor);
+    std::shared_ptr<buffer_source> in(new buffer_source(sample));
+    std::shared_ptr<counting_sink> out(new counting_sink());
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    int status = comp->compress_init(in, out);
+    if (status == 0) {
+        status = comp->compress();
+    }
+    if (status == 0) {
+        status = comp->compress_fin();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (status != 0) {
+        return status;
+    }
+
+    r.in_bytes = sample.size();
+    r.out_bytes = out->bytes();
+    r.ratio = (double) r.in_bytes / r.out_bytes;
+    r.mbps = r.in_bytes / 1e6 / std::max(elapsed.count(), 1e-9);
+    return 0;
+}
+
+int
+tune(const std::string fin, uint64_t sample_bytes, uint8_t sample_resolution,
+     uint8_t data_sense, uint8_t endianness, uint32_t threads,
+     std::vector<tune_result> &results)
+{
+    static const uint16_t block_sizes[] = {8, 16, 32, 64, 128};
+    static const uint8_t intervals[] = {16, 64, 255};
+    std::vector<char> sample;
+
+    if (read_sample(fin, sample_bytes, 2 * sample_size(sample_resolution),
+                    sample)) {
+        return -1;
+    }
+    if (sample.empty()) {
+        std::cout << "Input is too short to tune" << std::endl;
+        return -1;
+    }
+
+    /* Skip the combinations the coder or the predictors do not support */
+    results.clear();
+    for (uint16_t block_size : block_sizes) {
+        for (uint8_t rsi : intervals) {
+            /* Restricted codes only exist for up to 4 bits per sample */
+            for (uint8_t restricted = 0; restricted <= (sample_resolution <= 4);
+                 restricted++) {
+                for (uint8_t predictor = 0; predictor <= (uint8_t)
+                     header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS;
+                     predictor++) {
+                    if ((predictor && sample_resolution > 24)
+                        || (predictor == (uint8_t)
+                            header::iqzip_compression_header::NATIVE_PREDICTOR::COMPLEX_NLMS
+                            && sample_resolution > 16)) {
+                        continue;
+                    }
+                    for (int split_iq = 0; split_iq < 2; split_iq++) {
+                        tune_result r;
+                        memset(&r, 0, sizeof(r));
+                        r.block_size = block_size;
+                        r.reference_sample_interval = rsi;
+                        r.restricted_codes = restricted;
+                        r.predictor = predictor;
+                        r.split_iq = split_iq;
+                        results.push_back(r);
+                    }
+                }
+            }
+        }
+    }
+
+    if (!threads) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    std::atomic<size_t> next(0);
+    std::atomic<int> status(0);
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < threads; i++) {
+        workers.push_back(std::thread([&]() {
+            size_t j;
+            while (!status && (j = next++) < results.size()) {
+                if (run_trial(sample, sample_resolution, data_sense,
+                              endianness, results[j])) {
+                    status = -1;
+                }
+            }
+        }));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    return status;
+}
+
+std::vector<tune_result>
+pareto_front(const std::vector<tune_result> &results)
+{
+    std::vector<tune_result> sorted(results);
+    std::vector<tune_result> front;
+
+    /* From the fastest down, keep whatever beats the ratio of all faster */
+    std::sort(sorted.begin(), sorted.end(),
+    [](const tune_result & a, const tune_result & b) {
+        return a.mbps != b.mbps ? a.mbps > b.mbps : a.ratio > b.ratio;
+    });
+    for (const tune_result &r : sorted) {
+        if (front.empty() || r.ratio > front.back().ratio) {
+            front.push_back(r);
+        }
+    }
+    return front;
+}
+
+} // namespace compression
+
+} // namespace iqzip
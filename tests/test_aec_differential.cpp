@@ -0,0 +1,294 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that the native encoder writes the bitstream of libaec byte for
+ * byte, for every sample resolution, block size and a range of reference
+ * sample intervals. libaec codes the input in a single call, the native
+ * encoder in small pieces of input and output. The native decoder must
+ * decode the bitstream of libaec as libaec does.
+ */
+
+#include <iqzip/ccsds_types.h>
+#include <iqzip/codec_backend.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace iqzip::compression;
+
+/* Input and output pieces of the native encoder, prime to the sample sizes */
+#define IN_PIECE        1001
+#define OUT_PIECE       777
+/* The samples of the longest configurations are capped to keep the test
+ * short */
+#define MAX_SAMPLES     100003
+
+static size_t
+sample_bytes(uint32_t bits, uint32_t flags)
+{
+    if (bits > 16) {
+        return bits <= 24 && (flags & AEC_DATA_3BYTE) ? 3 : 4;
+    }
+    return bits > 8 ? 2 : 1;
+}
+
+/*
+ * Random walks of every slope, so all the code options are chosen, with
+ * constant stretches for the zero blocks. Samples are stored in their
+ * resolution, sign bit included.
+ */
+static void
+generate(uint32_t bits, uint32_t flags, size_t samples, std::mt19937 &rng,
+         std::vector<unsigned char> &out)
+{
+    const size_t bytes = sample_bytes(bits, flags);
+    const uint64_t range = (uint64_t) 1 << bits;
+    const uint64_t mask = range - 1;
+    std::uniform_int_distribution<int> slope(0, (int) bits);
+    std::uniform_int_distribution<uint64_t> any(0, mask);
+
+    out.resize(samples * bytes);
+    uint64_t x = any(rng);
+    int step = 0;
+    for (size_t i = 0; i < samples; i++) {
+        if (i % 512 == 0) {
+            step = slope(rng);
+        }
+        if (step) {
+            std::uniform_int_distribution<uint64_t> delta(0, ((uint64_t) 1
+                    << step) - 1);
+            x = (x + delta(rng) - ((uint64_t) 1 << (step - 1))) & mask;
+        }
+        for (size_t b = 0; b < bytes; b++) {
+            size_t shift = 8 * (flags & AEC_DATA_MSB ? bytes - 1 - b : b);
+            out[i * bytes + b] = (unsigned char)(x >> shift);
+        }
+    }
+}
+
+static void
+set_params(aec_stream *strm, uint32_t bits, uint32_t block_size,
+           uint32_t rsi, uint32_t flags)
+{
+    memset(strm, 0, sizeof(*strm));
+    strm->bits_per_sample = bits;
+    strm->block_size = block_size;
+    strm->rsi = rsi;
+    strm->flags = flags;
+}
+
+/*
+ * Encodes in with the native encoder, IN_PIECE and OUT_PIECE bytes at a
+ * time.
+ * @return AEC_OK on success, an AEC error code otherwise.
+ */
+static int
+encode_pieces(codec_backend_sptr backend, aec_stream *strm,
+              const std::vector<unsigned char> &in,
+              std::vector<unsigned char> &out)
+{
+    int status = backend->encode_init(strm);
+    if (status != AEC_OK) {
+        return status;
+    }
+    out.clear();
+    const size_t bytes = sample_bytes(strm->bits_per_sample, strm->flags);
+    std::vector<unsigned char> piece(OUT_PIECE);
+    size_t offset = 0;
+    for (;;) {
+        size_t n = std::min((size_t) IN_PIECE, in.size() - offset);
+        bool last = offset + n == in.size();
+        strm->next_in = &in[offset];
+        strm->avail_in = n;
+        do {
+            strm->next_out = piece.data();
+            strm->avail_out = piece.size();
+            status = backend->encode(strm, last ? AEC_FLUSH : AEC_NO_FLUSH);
+            if (status != AEC_OK) {
+                return status;
+            }
+            out.insert(out.end(), piece.data(), strm->next_out);
+        }
+        while (strm->avail_out == 0 || (!last && strm->avail_in >= bytes));
+        /* Partial samples stay in next_in for the next piece */
+        offset += n - strm->avail_in;
+        if (last) {
+            break;
+        }
+    }
+    return backend->encode_end(strm);
+}
+
+/*
+ * @return 0 if both backends agree on the configuration, 1 otherwise.
+ */
+static int
+check(codec_backend_sptr libaec, codec_backend_sptr native, uint32_t bits,
+      uint32_t block_size, uint32_t rsi, uint32_t flags, std::mt19937 &rng)
+{
+    /* Whole intervals, then a partial interval ending in a partial block */
+    size_t samples = std::min((size_t) MAX_SAMPLES,
+                              (size_t) 2 * rsi * block_size
+                              + rsi * block_size / 2 + block_size / 2 + 1);
+    std::vector<unsigned char> in;
+    generate(bits, flags, samples, rng, in);
+
+    aec_stream strm;
+    set_params(&strm, bits, block_size, rsi, flags);
+    std::vector<char> expected;
+    int status = libaec->encode_segment(&strm, (const char *) in.data(),
+                                        in.size(), expected, 0);
+    if (status != AEC_OK) {
+        std::cout << "libaec failed with " << status << std::endl;
+        return 1;
+    }
+
+    set_params(&strm, bits, block_size, rsi, flags);
+    std::vector<unsigned char> coded;
+    status = encode_pieces(native, &strm, in, coded);
+    if (status != AEC_OK) {
+        std::cout << "The native encoder failed with " << status << std::endl;
+        return 1;
+    }
+    if (coded.size() != expected.size()
+        || memcmp(coded.data(), expected.data(), coded.size())) {
+        std::cout << "The native encoder wrote " << coded.size()
+                  << " bytes, libaec " << expected.size() << std::endl;
+        return 1;
+    }
+
+    set_params(&strm, bits, block_size, rsi, flags);
+    std::vector<char> restored(in.size());
+    status = libaec->decode_segment(&strm, expected.data(), expected.size(),
+                                    restored.data(), restored.size());
+    set_params(&strm, bits, block_size, rsi, flags);
+    std::vector<char> decoded(in.size());
+    if (status != AEC_OK
+        || native->decode_segment(&strm, expected.data(), expected.size(),
+                                  decoded.data(), decoded.size()) != AEC_OK
+        || decoded != restored) {
+        std::cout << "The decoders disagree" << std::endl;
+        return 1;
+    }
+
+    /* Signed samples come back sign extended, the encoder drops those bits */
+    std::vector<unsigned char> recoded;
+    set_params(&strm, bits, block_size, rsi, flags);
+    if (flags & AEC_DATA_SIGNED) {
+        status = encode_pieces(native, &strm,
+                               std::vector<unsigned char>(decoded.begin(),
+                                       decoded.end()), recoded);
+        status = status != AEC_OK || recoded != coded;
+    }
+    else {
+        status = memcmp(decoded.data(), in.data(), in.size());
+    }
+    if (status) {
+        std::cout << "The native decoder did not restore the input"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Bits above the resolution must not change the bitstream of the native
+ * encoder. Signed samples are sign extended, unsigned ones get noise.
+ * @return 0 if they do not, 1 otherwise.
+ */
+static int
+check_out_of_range(codec_backend_sptr native, uint32_t flags,
+                   std::mt19937 &rng)
+{
+    const uint32_t bits = 12;
+    std::vector<unsigned char> in;
+    generate(bits, flags, 4096, rng, in);
+    std::vector<unsigned char> wide(in);
+    std::uniform_int_distribution<int> noise(0, 15);
+    for (size_t i = 0; i < wide.size(); i += 2) {
+        if (flags & AEC_DATA_SIGNED) {
+            wide[i + 1] |= wide[i + 1] & 0x08 ? 0xf0 : 0;
+        }
+        else {
+            wide[i + 1] |= noise(rng) << 4;
+        }
+    }
+
+    aec_stream strm;
+    std::vector<unsigned char> expected, coded;
+    set_params(&strm, bits, 16, 64, flags);
+    int status = encode_pieces(native, &strm, in, expected);
+    set_params(&strm, bits, 16, 64, flags);
+    if (status != AEC_OK || encode_pieces(native, &strm, wide, coded) != AEC_OK
+        || coded != expected) {
+        std::cout << "Bits above the resolution changed the bitstream"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int
+main()
+{
+    static const uint32_t block_sizes[] = {8, 16, 32, 64};
+    static const uint32_t rsis[] = {1, 3, 64, 128, 4096};
+    std::mt19937 rng(121);
+
+    codec_backend_sptr libaec = create_codec_backend((uint8_t)
+                                header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION);
+    codec_backend_sptr native = create_codec_backend((uint8_t)
+                                header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION);
+    if (!libaec || !native) {
+        std::cout << "Missing codec backend" << std::endl;
+        return 1;
+    }
+
+    size_t configurations = 0;
+    int failed = 0;
+    for (uint32_t bits = 1; bits <= 32; bits++) {
+        for (uint32_t block_size : block_sizes) {
+            for (uint32_t rsi : rsis) {
+                /* Every configuration takes turns at the data flags */
+                uint32_t flags = AEC_DATA_PREPROCESS;
+                flags |= configurations & 1 ? AEC_DATA_SIGNED : 0;
+                flags |= configurations & 2 ? AEC_DATA_MSB : 0;
+                flags |= configurations & 4 ? AEC_DATA_3BYTE : 0;
+                flags &= configurations % 7 == 6 ? ~AEC_DATA_PREPROCESS : ~0u;
+                flags |= bits <= 4 && configurations & 8 ? AEC_RESTRICTED : 0;
+                configurations++;
+                if (check(libaec, native, bits, block_size, rsi, flags, rng)) {
+                    std::cout << "n " << bits << " J " << block_size
+                              << " rsi " << rsi << " flags " << flags
+                              << std::endl;
+                    failed++;
+                }
+            }
+        }
+    }
+    failed += check_out_of_range(native, AEC_DATA_PREPROCESS, rng);
+    failed += check_out_of_range(native,
+                                 AEC_DATA_PREPROCESS | AEC_DATA_SIGNED, rng);
+
+    std::cout << configurations << " configurations, " << failed
+              << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
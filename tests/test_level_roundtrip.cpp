@@ -0,0 +1,188 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that every compression level writes files the decompressor reads
+ * back, for sample resolutions up to 32 bits in both byte orders and data
+ * senses, and that their CIP records the predictor they use. The files are
+ * only written to memory.
+ */
+
+#include <iqzip/compressor.h>
+#include <iqzip/decompressor.h>
+#include <iqzip/iq_generator.h>
+#include <iqzip/iqzip_compression_header.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace iqzip::compression;
+
+/* The block size of the FAST level */
+#define MAX_BLOCK_SIZE  64
+
+/*
+ * Appends everything written to a vector
+ */
+class memory_sink : public sink {
+public:
+    memory_sink(std::vector<char> &buf) :
+        d_buf(buf)
+    {
+        d_buf.clear();
+    }
+
+    int
+    write(const char *buf, size_t nbytes)
+    {
+        d_buf.insert(d_buf.end(), buf, buf + nbytes);
+        return 0;
+    }
+
+private:
+    std::vector<char> &d_buf;
+};
+
+/*
+ * Reads a vector, seeking anywhere in it
+ */
+class memory_source : public source {
+public:
+    memory_source(const std::vector<char> &buf) :
+        d_buf(buf),
+        d_pos(0)
+    {
+    }
+
+    ssize_t
+    read(char *buf, size_t nbytes)
+    {
+        size_t n = std::min(nbytes, d_buf.size() - d_pos);
+        memcpy(buf, &d_buf[d_pos], n);
+        d_pos += n;
+        return n;
+    }
+
+    int
+    seek(uint64_t offset)
+    {
+        if (offset > d_buf.size()) {
+            return -1;
+        }
+        d_pos = offset;
+        return 0;
+    }
+
+    int64_t
+    size()
+    {
+        return d_buf.size();
+    }
+
+private:
+    const std::vector<char> &d_buf;
+    size_t d_pos;
+};
+
+/*
+ * @return 0 if the level restores the samples, 1 otherwise.
+ */
+static int
+check(COMPRESSION_LEVEL level, const iq_generator_config &config)
+{
+    iq_generator gen(config);
+    /* Two full segments and a short one. Single streams pad their last
+     * block, so the samples fill whole blocks of the largest size */
+    uint64_t pairs = (5 << 20) / 2 / gen.pair_bytes();
+    pairs -= pairs % (MAX_BLOCK_SIZE / 2);
+    std::vector<char> in(pairs * gen.pair_bytes());
+    gen.generate(pairs, in.data());
+
+    std::vector<char> coded;
+    compressor_sptr comp = create_compressor(level, config.sample_resolution,
+                           config.data_sense, config.endianness);
+    source_sptr src(new memory_source(in));
+    sink_sptr dst(new memory_sink(coded));
+    if (comp->compress_init(src, dst) || comp->compress()
+        || comp->compress_fin()) {
+        std::cout << "Compression failed" << std::endl;
+        return 1;
+    }
+
+    /* The unit delay predictor runs unless a native one is recorded */
+    header::iqzip_compression_header hdr;
+    if (!hdr.parse_header_from_buffer((const uint8_t *) coded.data(),
+                                      coded.size())) {
+        std::cout << "Invalid header" << std::endl;
+        return 1;
+    }
+    uint8_t predictor_type = hdr.decode_iqzip_container_predictor() ?
+                             (uint8_t) header::PREPROCESSOR_PREDICTOR_TYPE::APPLICATION_SPECIFIC :
+                             (uint8_t) header::PREPROCESSOR_PREDICTOR_TYPE::UNIT_DELAY;
+    if (hdr.decode_preprocessor_predictor_type() != predictor_type) {
+        std::cout << "Wrong predictor type" << std::endl;
+        return 1;
+    }
+
+    std::vector<char> out;
+    decompressor_sptr decomp = create_decompressor();
+    src.reset(new memory_source(coded));
+    dst.reset(new memory_sink(out));
+    if (decomp->decompress_init(src, dst) || decomp->decompress()
+        || decomp->decompress_fin()) {
+        std::cout << "Decompression failed" << std::endl;
+        return 1;
+    }
+    if (out != in) {
+        std::cout << "The samples differ" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int
+main()
+{
+    static const COMPRESSION_LEVEL levels[] = {
+        COMPRESSION_LEVEL::FAST, COMPRESSION_LEVEL::DEFAULT,
+        COMPRESSION_LEVEL::MAX
+    };
+    static const uint8_t resolutions[] = {8, 12, 16, 24, 32};
+
+    int failed = 0;
+    for (COMPRESSION_LEVEL level : levels) {
+        for (uint8_t resolution : resolutions) {
+            /* Signed LSB first and unsigned MSB first */
+            for (uint8_t format = 0; format < 2; format++) {
+                iq_generator_config config =
+                    default_iq_generator_config(IQ_SIGNAL::MIXED);
+                config.sample_resolution = resolution;
+                config.data_sense = format;
+                config.endianness = !format;
+                if (check(level, config)) {
+                    std::cout << "level " << (int) level << " n "
+                              << (int) resolution << " data sense "
+                              << (int) format << std::endl;
+                    failed++;
+                }
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
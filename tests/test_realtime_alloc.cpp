@@ -0,0 +1,212 @@
+/* -*- c++ -*- */
+/*
+ *  Copyright (C) 2019, Libre Space Foundation <https://libre.space/>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that stream_compress makes no heap allocation once
+ * stream_compress_init_realtime has returned, with libaec and with the
+ * native coder. Every allocation of the
+ * process goes through the malloc family below on glibc, which operator new
+ * calls too, or through operator new elsewhere. They count the ones made by
+ * the main thread while it is inside stream_compress.
+ */
+
+#include <iqzip/ccsds_types.h>
+#include <iqzip/compressor.h>
+#include <iqzip/iq_generator.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace iqzip::compression;
+
+/* Set by the thread under test around the calls that must not allocate */
+static thread_local bool counting = false;
+static std::atomic<uint64_t> allocations(0);
+
+static void
+count_allocation()
+{
+    if (counting) {
+        allocations++;
+    }
+}
+
+#ifdef __GLIBC__
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t n, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+
+    void *
+    malloc(size_t size)
+    {
+        count_allocation();
+        return __libc_malloc(size);
+    }
+
+    void *
+    calloc(size_t n, size_t size)
+    {
+        count_allocation();
+        return __libc_calloc(n, size);
+    }
+
+    void *
+    realloc(void *p, size_t size)
+    {
+        count_allocation();
+        return __libc_realloc(p, size);
+    }
+}
+#else
+/* Without the malloc family, at least the allocations of C++ code */
+void *
+operator new(size_t size)
+{
+    count_allocation();
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *
+operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *
+operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    count_allocation();
+    return std::malloc(size ? size : 1);
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void
+operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+#endif
+
+/*
+ * Discards the output, the writer thread is not under test
+ */
+class null_sink : public sink {
+public:
+    int
+    write(const char *, size_t)
+    {
+        return 0;
+    }
+};
+
+/*
+ * Streams the samples through the backend in calls of every size of calls.
+ * @return the number of allocations made in stream_compress, or -1 if
+ * compressing failed.
+ */
+static int64_t
+run(uint8_t compression_tech_id, const std::vector<char> &in,
+    const iq_generator_config &config, const size_t *calls, size_t ncalls)
+{
+    /* The ring holds the whole output, however late the writer runs */
+    const size_t ring_size = 4 << 20;
+
+    compressor_sptr comp = create_compressor(
+                               (uint8_t)header::PACKET_VERSION::CCSDS_PACKET_VERSION_1,
+                               (uint8_t)header::PACKET_TYPE::CCSDS_TELECOMMAND,
+                               (uint8_t)header::PACKET_SECONDARY_HEADER_FLAG::SEC_HDR_PRESENT,
+                               (uint16_t)header::PACKET_APPLICATION_PROCESS_IDENTIFIER::IDLE_PACKET,
+                               (uint8_t)header::PACKET_SEQUENCE_FLAGS::CONTINUATION_SEGMENT,
+                               (uint16_t)0xdffe, (uint16_t)0x7efe, (uint16_t)0xffff,
+                               compression_tech_id, (uint8_t)16, (uint8_t)1,
+                               (uint8_t)header::PREPROCESSOR_PREDICTOR_TYPE::UNIT_DELAY,
+                               (uint8_t)header::PREPROCESSOR_MAPPER_TYPE::PREDICTION_ERROR,
+                               (uint16_t)16, config.data_sense, config.sample_resolution,
+                               (uint16_t)1, (uint8_t)0, config.endianness, 0, false, 0);
+    sink_sptr out(new null_sink());
+    if (comp->stream_compress_init_realtime(out, ring_size)) {
+        std::cout << "stream_compress_init_realtime failed" << std::endl;
+        return -1;
+    }
+
+    allocations = 0;
+    size_t offset = 0;
+    for (size_t i = 0; offset < in.size(); i++) {
+        size_t nbytes = std::min(calls[i % ncalls], in.size() - offset);
+        counting = true;
+        int status = comp->stream_compress(&in[offset], nbytes);
+        counting = false;
+        if (status) {
+            std::cout << "stream_compress failed" << std::endl;
+            return -1;
+        }
+        offset += nbytes;
+    }
+    if (comp->stream_compress_fin()) {
+        std::cout << "stream_compress_fin failed" << std::endl;
+        return -1;
+    }
+    return allocations;
+}
+
+int
+main()
+{
+    /* Both the staged and the in place paths of stream_compress. Blocks are
+     * 32 bytes, so the calls below one block and those that end inside one
+     * leave samples staged for the next call */
+    static const size_t calls[] = {4096, 100002, 262144, 12, 6, 30};
+    static const header::COMPRESSION_TECHNIQUE_IDENTIFICATION backends[] = {
+        header::COMPRESSION_TECHNIQUE_IDENTIFICATION::CCSDS_LOSSLESS_COMPRESSION,
+        header::COMPRESSION_TECHNIQUE_IDENTIFICATION::NATIVE_LOSSLESS_COMPRESSION
+    };
+
+    iq_generator_config config = default_iq_generator_config(IQ_SIGNAL::MIXED);
+    config.segment_pairs = 65536;
+    iq_generator gen(config);
+    std::vector<char> in(2 << 20);
+    gen.generate(in.size() / gen.pair_bytes(), in.data());
+
+    int failed = 0;
+    for (header::COMPRESSION_TECHNIQUE_IDENTIFICATION backend : backends) {
+        int64_t n = run((uint8_t) backend, in, config, calls,
+                        sizeof(calls) / sizeof(calls[0]));
+        std::cout << "Backend " << (int) backend << ": " << n
+                  << " allocations in stream_compress" << std::endl;
+        failed += n != 0;
+    }
+    return failed ? 1 : 0;
+}